@@ -16,9 +16,18 @@ filter_order = 2;
 ts = (1/1000);	%800Hz sampling rate
 accel_data_path = "accel_data.txt";
 
-file_accel_data = fopen(accel_data_path,"rb");
-[val,count] = fread(file_accel_data,Inf,"uint16");
-fclose(file_accel_data);
+%A capture file from host/capture says what its columns are - see load_capture.m.  The old RealTerm
+%captures are just bytes, and reading them as uint16 is how wrong_endian_data.png happened.
+if(strcmp(accel_data_path(max(1,end-3):end), ".cap"))
+	%Counts, not g, like the old captures - the filters below are designed for those
+	[accel_g, val, column] = load_capture(accel_data_path, "accel_y8");
+	count = length(val);
+	ts = 1/column.rate_hz;
+else
+	file_accel_data = fopen(accel_data_path,"rb");
+	[val,count] = fread(file_accel_data,Inf,"uint16");
+	fclose(file_accel_data);
+end
 
 %Generate a time vector from t=0 to the end determined by count and sampling time
 tmax = (count-1)*ts;
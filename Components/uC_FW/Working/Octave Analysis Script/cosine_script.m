@@ -1,16 +1,37 @@
 %This script generates a raised cosine waveform that only has values which are 
 %powers of 2
+%
+%The firmware version of the step detector (step_detect.c) uses this window.  Every tap is a power
+%of two, so the window is a sum of nested rectangular windows with power-of-two weights, and each of
+%those is a running sum - no multiplies.
 
-cos_points = 400;
-t_cos = -.5*pi():(pi()/cos_points):.5*pi();
+%Same width as the 250-point window in accel_script.m, but on the 20Hz decimated signal
+cos_points = 7;
+centre = (cos_points-1)/2;
+t_cos = (-centre:centre)*(pi()/cos_points);
 
-power = -16;
-new_cos = zeros(size(t_cos))
+cos_filt = cos(t_cos);
 
+%Round each tap to the nearest power of two - nearest in log2, since that's the error that matters
+%when the taps differ by factors of 2
+new_cos = 2.^round(log2(cos_filt));
 
-for i=1:cos_points
-	
-	if(t_cos(i) >= 2^power:
-		new_cos(i) = 2^power
-	endif;
-endfor;
\ No newline at end of file
+printf("Cosine:         %s\r\n",num2str(cos_filt,"%6.3f"))
+printf("Power of 2:     %s\r\n",num2str(new_cos,"%6.3f"))
+printf("Window gain:    %g\r\n",sum(new_cos))
+
+%Split into nested boxes: each distinct tap value is a step up from the one outside it
+levels = unique(new_cos);
+previous = 0;
+for i=1:length(levels)
+	half_width = max(abs((0:cos_points-1)(new_cos >= levels(i)) - centre));
+	printf("Box %d: delays %d-%d, weight %g\r\n",i,centre-half_width,centre+half_width,levels(i)-previous)
+	previous = levels(i);
+endfor;
+
+figure(1)
+hold off
+stem(t_cos,cos_filt)
+hold on
+stem(t_cos,new_cos,'r')
+title("Raised cosine window and its power-of-two version")
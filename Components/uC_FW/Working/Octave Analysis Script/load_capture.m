@@ -0,0 +1,57 @@
+%Load one column of a capture file made by host/capture (see host/capfile.h for the layout)
+%
+%[val, raw, column] = load_capture(path, name)
+%
+%val is the column in real units (column.unit - g for the accelerometer columns), raw is the values
+%exactly as they were recorded, and column has its name, unit, type, rate_hz, scale and offset.
+%
+%The file says what type every column is, so there's no guessing "uint16" for data that was really
+%one byte per sample (Wiki_Resources/wrong_endian_data.png).  Everything in the file is little-endian.
+function [val, raw, column] = load_capture(path, name)
+	file = fopen(path, "rb", "ieee-le");
+	if(file < 0)
+		error("load_capture: can't open %s", path);
+	end
+
+	magic = fread(file, 8, "uint8=>char")';
+	version = fread(file, 1, "uint32");
+	header_size = fread(file, 1, "uint32");
+	byte_order = fread(file, 1, "uint32");
+	column_count = fread(file, 1, "uint32");
+	if(!strcmp(magic, "ACCELCAP") || version != 1 || byte_order != hex2dec("01020304"))
+		fclose(file);
+		error("load_capture: %s isn't a version 1 capture", path);
+	end
+
+	%Column descriptions are 128 bytes each, starting at byte 184
+	types = {"uint8", "uint16", "uint32"};
+	for i = 0:(column_count - 1)
+		base = 184 + i*128;
+		fseek(file, base, SEEK_SET);
+		column_name = deblank(strtok(fread(file, 32, "uint8=>char")', char(0)));
+		if(!strcmp(column_name, name))
+			continue;
+		end
+
+		column.name = column_name;
+		column.unit = deblank(strtok(fread(file, 16, "uint8=>char")', char(0)));
+		column.type = types{fread(file, 1, "uint32")};
+		column.channel = fread(file, 1, "uint32");
+		column.rate_hz = fread(file, 1, "double");
+		column.scale = fread(file, 1, "double");
+		column.offset = fread(file, 1, "double");
+		data_offset = fread(file, 1, "uint64");
+		capacity = fread(file, 1, "uint64");
+		rows = fread(file, 1, "uint64");
+
+		fseek(file, data_offset, SEEK_SET);
+		raw = fread(file, rows, [column.type "=>double"]);
+		fclose(file);
+
+		val = raw*column.scale + column.offset;
+		return;
+	end
+
+	fclose(file);
+	error("load_capture: %s has no column called %s", path, name);
+end
@@ -0,0 +1,258 @@
+/*
+ * capfile.c
+ *
+ * Capture file creation, appending and zero-copy opening - see capfile.h for the format.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capfile.h"
+
+/*The header has to fit in its page, and every column description has to be the size the format says*/
+typedef char capfile_header_fits[(sizeof(capfile_header_t) <= CAPFILE_HEADER_SIZE) ? 1 : -1];
+typedef char capfile_column_size[(sizeof(capfile_column_t) == 128) ? 1 : -1];
+
+size_t capfile_type_size(uint32_t type)
+{
+	switch(type)
+	{
+		case CAPFILE_U8:
+			return 1;
+		case CAPFILE_U16:
+			return 2;
+		case CAPFILE_U32:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+static uint64_t capfile_round_up(uint64_t value)
+{
+	return (value + CAPFILE_ALIGN - 1) / CAPFILE_ALIGN * CAPFILE_ALIGN;
+}
+
+static int capfile_map(capfile_t *file, const char *path, int writable)
+{
+	file->base = mmap(NULL, file->size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, file->fd, 0);
+	if(MAP_FAILED == file->base)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		close(file->fd);
+		return -1;
+	}
+	file->header = (capfile_header_t *)file->base;
+	file->writable = writable;
+	return 0;
+}
+
+/*Make a new capture with room for each column's capacity.  Returns 0 on success.*/
+int capfile_create(capfile_t *file, const char *path, const capfile_column_t *columns, uint32_t count,
+				   const char *description)
+{
+	capfile_header_t *header;
+	struct timespec now;
+	uint64_t offset = CAPFILE_HEADER_SIZE;
+	uint32_t i;
+
+	if(count > CAPFILE_MAX_COLUMNS)
+	{
+		fprintf(stderr, "%s: %u columns is more than %d\n", path, count, CAPFILE_MAX_COLUMNS);
+		return -1;
+	}
+	for(i = 0; i < count; i++)
+	{
+		offset += capfile_round_up(columns[i].capacity * capfile_type_size(columns[i].type));
+	}
+
+	file->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(file->fd < 0)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	/*Extending with ftruncate leaves a hole - no disk space is used until something's written there*/
+	if(0 != ftruncate(file->fd, (off_t)offset))
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		close(file->fd);
+		return -1;
+	}
+	file->size = (size_t)offset;
+	if(0 != capfile_map(file, path, 1))
+	{
+		return -1;
+	}
+
+	header = file->header;
+	memcpy(header->magic, CAPFILE_MAGIC, sizeof(header->magic));
+	header->version = CAPFILE_VERSION;
+	header->header_size = CAPFILE_HEADER_SIZE;
+	header->byte_order = CAPFILE_BYTE_ORDER;
+	header->column_count = count;
+	clock_gettime(CLOCK_REALTIME, &now);
+	header->started_unix_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	snprintf(header->description, sizeof(header->description), "%s", (NULL == description) ? "" : description);
+
+	offset = CAPFILE_HEADER_SIZE;
+	for(i = 0; i < count; i++)
+	{
+		header->columns[i] = columns[i];
+		header->columns[i].name[sizeof(header->columns[i].name) - 1] = '\0';
+		header->columns[i].unit[sizeof(header->columns[i].unit) - 1] = '\0';
+		header->columns[i].data_offset = offset;
+		header->columns[i].rows = 0;
+		offset += capfile_round_up(columns[i].capacity * capfile_type_size(columns[i].type));
+	}
+
+	return 0;
+}
+
+/*Map an existing capture read-only and check it's one we understand.  Returns 0 on success.*/
+int capfile_open(capfile_t *file, const char *path)
+{
+	const capfile_header_t *header;
+	struct stat status;
+	uint32_t i;
+
+	file->fd = open(path, O_RDONLY);
+	if(file->fd < 0)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if(0 != fstat(file->fd, &status) || (uint64_t)status.st_size < CAPFILE_HEADER_SIZE)
+	{
+		fprintf(stderr, "%s: too short to be a capture\n", path);
+		close(file->fd);
+		return -1;
+	}
+	file->size = (size_t)status.st_size;
+	if(0 != capfile_map(file, path, 0))
+	{
+		return -1;
+	}
+
+	header = file->header;
+	if(0 != memcmp(header->magic, CAPFILE_MAGIC, sizeof(header->magic)) || CAPFILE_VERSION != header->version
+	   || CAPFILE_HEADER_SIZE != header->header_size || CAPFILE_BYTE_ORDER != header->byte_order
+	   || header->column_count > CAPFILE_MAX_COLUMNS)
+	{
+		fprintf(stderr, "%s: not a version %d capture in this machine's byte order\n", path, CAPFILE_VERSION);
+		capfile_close(file);
+		return -1;
+	}
+
+	/*Never trust a length from a file - every column has to be inside it*/
+	for(i = 0; i < header->column_count; i++)
+	{
+		const capfile_column_t *column = &header->columns[i];
+		size_t element = capfile_type_size(column->type);
+
+		if(0 == element || column->rows > column->capacity || column->data_offset > file->size
+		   || column->capacity > (file->size - column->data_offset) / element)
+		{
+			fprintf(stderr, "%s: column %u doesn't fit in the file\n", path, i);
+			capfile_close(file);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*1 if the file starts with the capture magic*/
+int capfile_is_capture(const char *path)
+{
+	char magic[sizeof(CAPFILE_MAGIC) - 1];
+	FILE *file = fopen(path, "rb");
+	int matches;
+
+	if(NULL == file)
+	{
+		return 0;
+	}
+	matches = (sizeof(magic) == fread(magic, 1, sizeof(magic), file)) && 0 == memcmp(magic, CAPFILE_MAGIC, sizeof(magic));
+	fclose(file);
+	return matches;
+}
+
+/*Index of the named column, or -1*/
+int capfile_find(const capfile_t *file, const char *name)
+{
+	uint32_t i;
+
+	for(i = 0; i < file->header->column_count; i++)
+	{
+		if(0 == strncmp(file->header->columns[i].name, name, sizeof(file->header->columns[i].name)))
+		{
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+/*The column's values, in place, or NULL if it isn't the type asked for.  *rows is how many there are
+ right now.*/
+const void *capfile_data(const capfile_t *file, int column, uint32_t type, uint64_t *rows)
+{
+	const capfile_column_t *description;
+
+	if(column < 0 || (uint32_t)column >= file->header->column_count)
+	{
+		return NULL;
+	}
+	description = &file->header->columns[column];
+	if(type != description->type)
+	{
+		return NULL;
+	}
+
+	*rows = __atomic_load_n(&description->rows, __ATOMIC_ACQUIRE);
+	return file->base + description->data_offset;
+}
+
+/*Add values to the end of a column.  Returns -1 without adding anything if they don't fit.*/
+int capfile_append(capfile_t *file, int column, const void *values, uint64_t count)
+{
+	capfile_column_t *description = &file->header->columns[column];
+	size_t element = capfile_type_size(description->type);
+
+	if(count > description->capacity - description->rows)
+	{
+		return -1;
+	}
+
+	memcpy(file->base + description->data_offset + description->rows * element, values, count * element);
+	/*Publish the rows only once the data is there*/
+	__atomic_store_n(&description->rows, description->rows + count, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/*Push everything written so far out to the disk*/
+void capfile_sync(capfile_t *file)
+{
+	if(file->writable)
+	{
+		msync(file->base, file->size, MS_ASYNC);
+	}
+}
+
+void capfile_close(capfile_t *file)
+{
+	if(file->writable)
+	{
+		msync(file->base, file->size, MS_SYNC);
+	}
+	munmap(file->base, file->size);
+	close(file->fd);
+}
@@ -0,0 +1,105 @@
+/*
+ * capfile.h
+ *
+ * The capture file format: typed, self-describing columns that can be memory-mapped and used in place.
+ *
+ * RealTerm captures are just bytes, and nothing in them says what the bytes are - accel_script.m read
+ * one-byte samples as uint16 and got garbage (Wiki_Resources/wrong_endian_data.png).  A capture file
+ * carries its own description: every column has a name, an element type, the UART channel it came
+ * from, its sample rate and the scale and offset that turn it into real units.  Readers ask for a
+ * column by name and type, and get nothing at all if the type is wrong.
+ *
+ * Layout (all little-endian, which is what both the AVR and every host this runs on are):
+ *
+ *	Offset	Contents
+ *	-------------------------------------------------------------
+ *	0		capfile_header_t, CAPFILE_HEADER_SIZE bytes, including up to CAPFILE_MAX_COLUMNS column
+ *			descriptions
+ *	...		Each column's data, one after the other, each starting on a CAPFILE_ALIGN boundary
+ *
+ * Each column has room reserved for 'capacity' values when the file is created, and 'rows' says how
+ * many are filled in.  The reserved space is never written until it's used, so on any filesystem with
+ * sparse files a 24-hour reservation takes no disk space until it fills up.  The writer stores the
+ * data first and the new row count after it, so a reader can open a capture that's still being
+ * recorded and never see a row that isn't there yet.
+ *
+ * Opening a capture maps it and checks the header - there's nothing to parse or copy, so a capture of
+ * any length opens instantly.
+ */
+
+#ifndef CAPFILE_H_
+#define CAPFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CAPFILE_MAGIC "ACCELCAP"
+#define CAPFILE_VERSION 1
+
+/*Written as a native uint32_t - a reader that sees anything else has the wrong byte order*/
+#define CAPFILE_BYTE_ORDER 0x01020304u
+
+#define CAPFILE_HEADER_SIZE 4096
+#define CAPFILE_ALIGN 4096
+#define CAPFILE_MAX_COLUMNS 16
+
+/*Element types*/
+enum Capfile_Types
+{
+	CAPFILE_U8 = 1,
+	CAPFILE_U16 = 2,
+	CAPFILE_U32 = 3
+};
+
+/*128 bytes*/
+typedef struct
+{
+	char name[32];			/*NUL-terminated*/
+	char unit[16];			/*What scale and offset convert to, NUL-terminated*/
+	uint32_t type;			/*enum Capfile_Types*/
+	uint32_t channel;		/*UART frame channel (enum Frame_Channels) the values came from*/
+	double rate_hz;			/*Samples per second, or 0 for a column of events*/
+	double scale;			/*Value in 'unit' = raw * scale + offset*/
+	double offset;
+	uint64_t data_offset;	/*Where the data starts, from the start of the file*/
+	uint64_t capacity;		/*Values there's room for*/
+	uint64_t rows;			/*Values written so far*/
+	uint8_t reserved[24];
+} capfile_column_t;
+
+typedef struct
+{
+	char magic[8];			/*CAPFILE_MAGIC, not NUL-terminated*/
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t byte_order;	/*CAPFILE_BYTE_ORDER*/
+	uint32_t column_count;
+	int64_t started_unix_ns;
+	uint64_t frames;		/*UART frames with good checksums*/
+	uint64_t missed_frames;	/*Gaps in the sequence numbers*/
+	uint64_t bad_checksums;
+	char description[128];	/*NUL-terminated*/
+	capfile_column_t columns[CAPFILE_MAX_COLUMNS];
+} capfile_header_t;
+
+typedef struct
+{
+	int fd;
+	uint8_t *base;
+	size_t size;
+	capfile_header_t *header;
+	int writable;
+} capfile_t;
+
+int capfile_create(capfile_t *file, const char *path, const capfile_column_t *columns, uint32_t count,
+				   const char *description);
+int capfile_open(capfile_t *file, const char *path);
+int capfile_is_capture(const char *path);
+int capfile_find(const capfile_t *file, const char *name);
+const void *capfile_data(const capfile_t *file, int column, uint32_t type, uint64_t *rows);
+int capfile_append(capfile_t *file, int column, const void *values, uint64_t count);
+void capfile_sync(capfile_t *file);
+void capfile_close(capfile_t *file);
+size_t capfile_type_size(uint32_t type);
+
+#endif /* CAPFILE_H_ */
@@ -0,0 +1,329 @@
+/*
+ * capture.c
+ *
+ * Records the firmware's UART stream into a capture file (capfile.h) - a replacement for capturing with
+ * RealTerm and guessing at the bytes afterwards.
+ *
+ *	capture [-b baud] [-H hours] [-d description] [-s commands] device output.cap
+ *
+ *	-b baud			Serial speed (default 250000 - see uart_init()).  Any rate the driver can do.
+ *	-H hours		How long to leave room for (default 24).  It's reserved as a sparse file, so this
+ *					costs no disk space until it's used.
+ *	-d description	Stored in the capture's header
+ *	-s commands		Sent to the firmware once the port is open - "10" turns on the compressed stream
+ *					(see uart.h for the commands)
+ *
+ * The device can be a real serial port, a pty or a plain file of bytes that were captured some other
+ * way.  It records until the device runs out (end of file, or the other end of a pty hangs up), a
+ * column runs out of room, or Ctrl-C.
+ *
+ * Every frame is checked (frames.c).  Samples from CHANNEL_ACCEL_XYZ go into accel_x, accel_y and
+ * accel_z as 10-bit counts, and samples from CHANNEL_ACCEL_Y into accel_y8.  Whenever the sequence
+ * numbers show frames went missing, the row the next samples land on goes into xyz_gaps or y8_gaps, so
+ * an analysis can tell where time jumps.  Every column's scale and offset convert counts to g.
+ *
+ * The file is mapped and written in place, and the header is updated as it goes, so it can be opened
+ * while it's still being recorded.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>	/*termios2 - the only way to ask Linux for 250000 baud*/
+
+#include "capfile.h"
+#include "frames.h"
+
+/*ADC reference - AVCC, 5V (see main())*/
+#define ADC_REFERENCE_VOLTS 5.0
+
+/*ExtRef/Accelerometer - MMA7361L.pdf: 800mV/g in the 1.5g range, 0g at half its 3.3V supply*/
+#define ACCEL_VOLTS_PER_G 0.8
+#define ACCEL_ZERO_G_VOLTS 1.65
+
+enum Columns
+{
+	COLUMN_X,
+	COLUMN_Y,
+	COLUMN_Z,
+	COLUMN_Y8,
+	COLUMN_XYZ_GAPS,
+	COLUMN_Y8_GAPS,
+	COLUMN_COUNT
+};
+
+typedef struct
+{
+	capfile_t file;
+	int xyz_gap;		/*Frames went missing since the last XYZ frame*/
+	int y8_gap;			/*...or the last Y frame*/
+	int full;
+	unsigned long other_frames;
+} recorder_t;
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int signal)
+{
+	(void)signal;
+	stop = 1;
+}
+
+/*Raw, 8N1, no flow control, any baud rate.  Returns 0 if it's not a terminal at all.*/
+static int configure_port(int fd, const char *path, unsigned int baud)
+{
+	struct termios2 settings;
+
+	if(0 != ioctl(fd, TCGETS2, &settings))
+	{
+		if(ENOTTY == errno)
+		{
+			return 0;
+		}
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	settings.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF | IXANY);
+	settings.c_oflag &= ~OPOST;
+	settings.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+	settings.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD | (CBAUD << IBSHIFT));
+	settings.c_cflag |= CS8 | CREAD | CLOCAL | BOTHER | (BOTHER << IBSHIFT);
+	settings.c_ispeed = baud;
+	settings.c_ospeed = baud;
+	settings.c_cc[VMIN] = 1;
+	settings.c_cc[VTIME] = 0;
+
+	if(0 != ioctl(fd, TCSETS2, &settings))
+	{
+		fprintf(stderr, "%s: can't set %u baud: %s\n", path, baud, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void append(recorder_t *recorder, int column, const void *values, uint64_t count)
+{
+	if(0 != capfile_append(&recorder->file, column, values, count) && !recorder->full)
+	{
+		fprintf(stderr, "%s is full - stopping\n", recorder->file.header->columns[column].name);
+		recorder->full = 1;
+	}
+}
+
+static void append_gap(recorder_t *recorder, int column, int sample_column)
+{
+	uint32_t row = (uint32_t)recorder->file.header->columns[sample_column].rows;
+
+	append(recorder, column, &row, 1);
+}
+
+static void on_frame(void *context, uint8_t channel, const uint8_t *payload, uint8_t length, unsigned int missed)
+{
+	recorder_t *recorder = context;
+	uint16_t samples[STREAM_FRAME_SAMPLES][ADC_SCAN_AXES];
+	uint16_t axis[STREAM_FRAME_SAMPLES];
+	int count, i, a;
+
+	if(0 != missed)
+	{
+		recorder->xyz_gap = 1;
+		recorder->y8_gap = 1;
+	}
+
+	switch(channel)
+	{
+		case CHANNEL_ACCEL_XYZ:
+			count = frames_decode_xyz(payload, length, samples);
+			if(count < 0)
+			{
+				recorder->xyz_gap = 1;
+				break;
+			}
+			if(recorder->xyz_gap)
+			{
+				append_gap(recorder, COLUMN_XYZ_GAPS, COLUMN_X);
+				recorder->xyz_gap = 0;
+			}
+			/*Columns, not rows - each axis goes in its own*/
+			for(a = 0; a < ADC_SCAN_AXES; a++)
+			{
+				for(i = 0; i < count; i++)
+				{
+					axis[i] = samples[i][a];
+				}
+				append(recorder, COLUMN_X + a, axis, (uint64_t)count);
+			}
+			break;
+		case CHANNEL_ACCEL_Y:
+			if(recorder->y8_gap)
+			{
+				append_gap(recorder, COLUMN_Y8_GAPS, COLUMN_Y8);
+				recorder->y8_gap = 0;
+			}
+			append(recorder, COLUMN_Y8, payload, length);
+			break;
+		default:
+			recorder->other_frames++;
+			break;
+	}
+}
+
+static capfile_column_t column(const char *name, uint32_t type, uint32_t channel, double rate_hz, double counts,
+							   uint64_t capacity)
+{
+	capfile_column_t description;
+
+	memset(&description, 0, sizeof(description));
+	snprintf(description.name, sizeof(description.name), "%s", name);
+	description.type = type;
+	description.channel = channel;
+	description.rate_hz = rate_hz;
+	description.capacity = capacity;
+	if(0.0 != counts)
+	{
+		snprintf(description.unit, sizeof(description.unit), "g");
+		description.scale = ADC_REFERENCE_VOLTS / counts / ACCEL_VOLTS_PER_G;
+		description.offset = -ACCEL_ZERO_G_VOLTS / ACCEL_VOLTS_PER_G;
+	}
+	else
+	{
+		snprintf(description.unit, sizeof(description.unit), "row");
+		description.scale = 1.0;
+	}
+	return description;
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [-b baud] [-H hours] [-d description] [-s commands] device output.cap\n", program);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int baud = 250000;
+	double hours = 24.0;
+	const char *description = "";
+	const char *commands = NULL;
+	capfile_column_t columns[COLUMN_COUNT];
+	frames_parser_t parser;
+	recorder_t recorder;
+	struct sigaction action;
+	uint8_t bytes[4096];
+	uint64_t rows;
+	time_t last_sync;
+	int option, fd, i;
+
+	while(-1 != (option = getopt(argc, argv, "b:H:d:s:")))
+	{
+		switch(option)
+		{
+			case 'b':
+				baud = (unsigned int)strtoul(optarg, NULL, 0);
+				break;
+			case 'H':
+				hours = atof(optarg);
+				break;
+			case 'd':
+				description = optarg;
+				break;
+			case 's':
+				commands = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(optind + 2 != argc || hours <= 0.0)
+	{
+		usage(argv[0]);
+	}
+
+	fd = open(argv[optind], O_RDWR | O_NOCTTY);
+	if(fd < 0 && NULL == commands)
+	{
+		fd = open(argv[optind], O_RDONLY | O_NOCTTY);	/*A file of bytes might be read-only*/
+	}
+	if(fd < 0)
+	{
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	if(0 != configure_port(fd, argv[optind], baud))
+	{
+		return 1;
+	}
+
+	rows = (uint64_t)(hours * 3600.0 * TICK_HZ);
+	columns[COLUMN_X] = column("accel_x", CAPFILE_U16, CHANNEL_ACCEL_XYZ, TICK_HZ, 1024.0, rows);
+	columns[COLUMN_Y] = column("accel_y", CAPFILE_U16, CHANNEL_ACCEL_XYZ, TICK_HZ, 1024.0, rows);
+	columns[COLUMN_Z] = column("accel_z", CAPFILE_U16, CHANNEL_ACCEL_XYZ, TICK_HZ, 1024.0, rows);
+	columns[COLUMN_Y8] = column("accel_y8", CAPFILE_U8, CHANNEL_ACCEL_Y, TICK_HZ, 256.0, rows);
+	columns[COLUMN_XYZ_GAPS] = column("xyz_gaps", CAPFILE_U32, CHANNEL_ACCEL_XYZ, 0.0, 0.0, rows);
+	columns[COLUMN_Y8_GAPS] = column("y8_gaps", CAPFILE_U32, CHANNEL_ACCEL_Y, 0.0, 0.0, rows);
+
+	memset(&recorder, 0, sizeof(recorder));
+	if(0 != capfile_create(&recorder.file, argv[optind + 1], columns, COLUMN_COUNT, description))
+	{
+		return 1;
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;	/*No SA_RESTART, so a blocked read() gives up on Ctrl-C*/
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	if(NULL != commands && (ssize_t)strlen(commands) != write(fd, commands, strlen(commands)))
+	{
+		fprintf(stderr, "%s: couldn't send the commands\n", argv[optind]);
+	}
+
+	frames_init(&parser, on_frame, &recorder);
+	last_sync = time(NULL);
+	while(!stop && !recorder.full)
+	{
+		ssize_t got = read(fd, bytes, sizeof(bytes));
+
+		if(got < 0 && EINTR == errno)
+		{
+			continue;
+		}
+		if(got <= 0)
+		{
+			/*End of a file, or the far end of a pty hung up (EIO)*/
+			break;
+		}
+
+		frames_feed(&parser, bytes, (size_t)got);
+		recorder.file.header->frames = parser.stats.frames;
+		recorder.file.header->missed_frames = parser.stats.missed_frames;
+		recorder.file.header->bad_checksums = parser.stats.bad_checksums;
+
+		if(time(NULL) != last_sync)
+		{
+			last_sync = time(NULL);
+			capfile_sync(&recorder.file);
+		}
+	}
+
+	fprintf(stderr, "%s: %lu frames (%lu missed, %lu bad checksums, %lu on other channels)", argv[optind + 1],
+			parser.stats.frames, parser.stats.missed_frames, parser.stats.bad_checksums, recorder.other_frames);
+	for(i = 0; i < COLUMN_COUNT; i++)
+	{
+		fprintf(stderr, ", %s %llu", columns[i].name, (unsigned long long)recorder.file.header->columns[i].rows);
+	}
+	fprintf(stderr, "\n");
+
+	capfile_close(&recorder.file);
+	close(fd);
+	return 0;
+}
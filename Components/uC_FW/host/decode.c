@@ -0,0 +1,381 @@
+/*
+ * decode.c
+ *
+ * Host-side decoder for the firmware's UART stream (see proj/uart.h for the framing and proj/stream.h
+ * for the compressed sample format).
+ *
+ * Give it the raw bytes exactly as they came off the serial port - a RealTerm capture, or
+ * 'cat /dev/ttyUSB0 > file' at 250000 baud.  It hunts for the sync word, throws away anything with a
+ * bad checksum, and prints one line per sample:
+ *
+ *	xyz <x> <y> <z>		10-bit samples from CHANNEL_ACCEL_XYZ frames
+ *	y <y>				8-bit samples from CHANNEL_ACCEL_Y frames
+ *	blackbox <reason> <lights> <entries> <before> <sample> <missed>
+ *						A black box window's header (proj/blackbox.h), one per 'B'
+ *	bb <index> <ax> <ay> <az> <mx> <my> <mz> <step> <flags>
+ *						Its entries, oldest first, flags in hex
+ *
+ * Frame counts, bad checksums and sequence gaps go to stderr at the end.  Other channels are counted
+ * and skipped.
+ *
+ * It also reads capture files (capfile.h) and prints them the same way - all of the xyz lines, then
+ * all of the y lines, since the file keeps each column on its own.
+ *
+ *	decode capture...
+ *	decode -t [-o stream] capture...
+ *
+ *	-t			Round-trip test instead: build a three-axis 10-bit signal from each 8-bit capture (the
+ *				format replay takes), run it through the firmware's encoder and framing, decode it again
+ *				and check every sample comes back exactly.  Also reports how many bytes it took.
+ *	-o stream	Save the framed bytes the round-trip test made, as if they'd come off the serial port
+ *
+ * Exit status is non-zero if any capture can't be read or doesn't round-trip.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capfile.h"
+#include "frames.h"
+#include "blackbox.h"
+
+typedef struct
+{
+	uint8_t *bytes;
+	size_t count;
+} buffer_t;
+
+typedef struct
+{
+	FILE *out;
+	uint16_t (*decoded)[ADC_SCAN_AXES];		/*XYZ samples are also kept here if it's not NULL*/
+	size_t decoded_count;
+	unsigned long bad_payloads;
+	unsigned long other_frames;
+	unsigned long samples;
+} decoder_t;
+
+static int load_file(const char *path, buffer_t *buffer)
+{
+	FILE *file = fopen(path, "rb");
+	size_t allocated = 4096;
+
+	if(NULL == file)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	buffer->count = 0;
+	buffer->bytes = malloc(allocated);
+	while(NULL != buffer->bytes)
+	{
+		size_t got = fread(buffer->bytes + buffer->count, 1, allocated - buffer->count, file);
+
+		buffer->count += got;
+		if(buffer->count < allocated)
+		{
+			break;
+		}
+		allocated *= 2;
+		buffer->bytes = realloc(buffer->bytes, allocated);
+	}
+	fclose(file);
+
+	if(NULL == buffer->bytes)
+	{
+		fprintf(stderr, "%s: out of memory\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static void on_frame(void *context, uint8_t channel, const uint8_t *payload, uint8_t length, unsigned int missed)
+{
+	decoder_t *decoder = context;
+	uint16_t samples[STREAM_FRAME_SAMPLES][ADC_SCAN_AXES];
+	int count, j;
+
+	(void)missed;
+
+	switch(channel)
+	{
+		case CHANNEL_ACCEL_XYZ:
+			count = frames_decode_xyz(payload, length, samples);
+			if(count < 0)
+			{
+				decoder->bad_payloads++;
+				break;
+			}
+			for(j = 0; j < count; j++)
+			{
+				if(NULL != decoder->out)
+				{
+					fprintf(decoder->out, "xyz %u %u %u\n", samples[j][0], samples[j][1], samples[j][2]);
+				}
+				if(NULL != decoder->decoded)
+				{
+					memcpy(decoder->decoded[decoder->decoded_count], samples[j], sizeof(samples[j]));
+					decoder->decoded_count++;
+				}
+			}
+			decoder->samples += (unsigned long)count;
+			break;
+		case CHANNEL_BLACKBOX:
+			if(NULL == decoder->out || 0 == length)
+			{
+				break;
+			}
+			if(BLACKBOX_HEADER_INDEX == payload[0] && BLACKBOX_HEADER_SIZE == length)
+			{
+				fprintf(decoder->out, "blackbox %u %u %u %u %lu %u\n", payload[1], payload[2], payload[3], payload[4],
+						(unsigned long)payload[5] | ((unsigned long)payload[6] << 8) | ((unsigned long)payload[7] << 16)
+						| ((unsigned long)payload[8] << 24), payload[9] | (payload[10] << 8));
+				break;
+			}
+			for(j = 1; j + BLACKBOX_ENTRY_SIZE <= length; j += BLACKBOX_ENTRY_SIZE)
+			{
+				fprintf(decoder->out, "bb %u %u %u %u %d %d %d %u %02x\n", payload[0] + (j - 1) / BLACKBOX_ENTRY_SIZE,
+						payload[j], payload[j + 1], payload[j + 2], (int8_t)payload[j + 3], (int8_t)payload[j + 4],
+						(int8_t)payload[j + 5], payload[j + 6], payload[j + 7]);
+			}
+			break;
+		case CHANNEL_ACCEL_Y:
+			for(j = 0; j < length; j++)
+			{
+				if(NULL != decoder->out)
+				{
+					fprintf(decoder->out, "y %u\n", payload[j]);
+				}
+			}
+			decoder->samples += length;
+			break;
+		default:
+			decoder->other_frames++;
+			break;
+	}
+}
+
+/*Print a capture file's sample columns.  Returns 0 on success.*/
+static int print_capture(const char *path)
+{
+	const uint16_t *axes[ADC_SCAN_AXES] = {NULL, NULL, NULL};
+	const char *names[ADC_SCAN_AXES] = {"accel_x", "accel_y", "accel_z"};
+	const uint8_t *y8;
+	uint64_t rows, axis_rows, i;
+	capfile_t file;
+	int axis;
+
+	if(0 != capfile_open(&file, path))
+	{
+		return 1;
+	}
+
+	rows = UINT64_MAX;
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		axes[axis] = capfile_data(&file, capfile_find(&file, names[axis]), CAPFILE_U16, &axis_rows);
+		if(NULL == axes[axis])
+		{
+			fprintf(stderr, "%s: no 16-bit %s column\n", path, names[axis]);
+			capfile_close(&file);
+			return 1;
+		}
+		/*If it's still being recorded the axes can be a sample apart*/
+		if(axis_rows < rows)
+		{
+			rows = axis_rows;
+		}
+	}
+	for(i = 0; i < rows; i++)
+	{
+		printf("xyz %u %u %u\n", axes[0][i], axes[1][i], axes[2][i]);
+	}
+
+	y8 = capfile_data(&file, capfile_find(&file, "accel_y8"), CAPFILE_U8, &axis_rows);
+	for(i = 0; NULL != y8 && i < axis_rows; i++)
+	{
+		printf("y %u\n", y8[i]);
+	}
+
+	fprintf(stderr, "%s: %llu frames, %llu missed frames, %llu bad checksums\n", path,
+			(unsigned long long)file.header->frames, (unsigned long long)file.header->missed_frames,
+			(unsigned long long)file.header->bad_checksums);
+	capfile_close(&file);
+	return 0;
+}
+
+/*Encode a test signal with the firmware's encoder, decode it again and compare.  If save isn't NULL the
+ framed bytes are written there too.  Returns 0 on a match.*/
+static int round_trip(const char *name, const buffer_t *capture, const char *save)
+{
+	uint16_t (*signal)[ADC_SCAN_AXES];
+	stream_encoder_t encoder;
+	frames_parser_t parser;
+	decoder_t decoder;
+	buffer_t stream;
+	uint8_t sequence = 0;
+	size_t i;
+	int failed = 0;
+
+	memset(&decoder, 0, sizeof(decoder));
+	signal = malloc((capture->count + 1) * sizeof(*signal));
+	decoder.decoded = malloc((capture->count + 1) * sizeof(*decoder.decoded));
+	/*Every sample could need a whole frame in the very worst case*/
+	stream.bytes = malloc((capture->count + 1) * (STREAM_PAYLOAD_SIZE + UART_FRAME_OVERHEAD));
+	stream.count = 0;
+	if(NULL == signal || NULL == decoder.decoded || NULL == stream.bytes)
+	{
+		fprintf(stderr, "%s: out of memory\n", name);
+		free(signal);
+		free(decoder.decoded);
+		free(stream.bytes);
+		return 1;
+	}
+
+	/*X is the capture with some made-up low bits, Y is the capture as it is and Z is a sawtooth with
+	 a jump bigger than a nibble every time it wraps, so every path through the encoder gets used*/
+	for(i = 0; i < capture->count; i++)
+	{
+		signal[i][0] = (uint16_t)((capture->bytes[i] << 2) | (i & 0x03));
+		signal[i][1] = (uint16_t)(capture->bytes[i] << 2);
+		signal[i][2] = (uint16_t)((i * 3) & 0x3FF);
+	}
+
+	stream_reset(&encoder);
+	for(i = 0; i < capture->count; i++)
+	{
+		if(TRUE == stream_encode(&encoder, signal[i]) || i + 1 == capture->count)
+		{
+			stream.count += frames_build(stream.bytes + stream.count, sequence++, CHANNEL_ACCEL_XYZ,
+										 encoder.payload, stream_length(&encoder));
+			stream_reset(&encoder);
+		}
+	}
+
+	frames_init(&parser, on_frame, &decoder);
+	frames_feed(&parser, stream.bytes, stream.count);
+
+	if(decoder.decoded_count != capture->count || 0 != parser.stats.bad_checksums || 0 != decoder.bad_payloads
+	   || 0 != parser.stats.missed_frames)
+	{
+		fprintf(stderr, "%s: decoded %zu of %zu samples (%lu bad checksums, %lu bad payloads, %lu missed "
+				"frames)\n", name, decoder.decoded_count, capture->count, parser.stats.bad_checksums,
+				decoder.bad_payloads, parser.stats.missed_frames);
+		failed = 1;
+	}
+	for(i = 0; 0 == failed && i < capture->count; i++)
+	{
+		if(0 != memcmp(signal[i], decoder.decoded[i], sizeof(signal[i])))
+		{
+			fprintf(stderr, "%s: sample %zu: got %u %u %u, expected %u %u %u\n", name, i, decoder.decoded[i][0],
+					decoder.decoded[i][1], decoder.decoded[i][2], signal[i][0], signal[i][1], signal[i][2]);
+			failed = 1;
+		}
+	}
+
+	if(NULL != save)
+	{
+		FILE *file = fopen(save, "wb");
+
+		if(NULL == file || stream.count != fwrite(stream.bytes, 1, stream.count, file))
+		{
+			fprintf(stderr, "%s: %s\n", save, strerror(errno));
+			failed = 1;
+		}
+		if(NULL != file)
+		{
+			fclose(file);
+		}
+	}
+
+	if(0 == failed)
+	{
+		printf("%s: %zu three-axis samples round-trip in %zu bytes (%.2f bytes/sample, %lu frames)\n", name,
+			   capture->count, stream.count, (double)stream.count / (double)capture->count, parser.stats.frames);
+	}
+
+	free(stream.bytes);
+	free(signal);
+	free(decoder.decoded);
+	return failed;
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [-t [-o stream]] capture...\n", program);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *save = NULL;
+	int test = 0;
+	int option, failures = 0;
+
+	while(-1 != (option = getopt(argc, argv, "to:")))
+	{
+		switch(option)
+		{
+			case 't':
+				test = 1;
+				break;
+			case 'o':
+				save = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(optind == argc)
+	{
+		usage(argv[0]);
+	}
+
+	for(; optind < argc; optind++)
+	{
+		frames_parser_t parser;
+		decoder_t decoder;
+		buffer_t buffer;
+
+		if(!test && capfile_is_capture(argv[optind]))
+		{
+			failures += print_capture(argv[optind]);
+			continue;
+		}
+
+		if(0 != load_file(argv[optind], &buffer))
+		{
+			failures++;
+			continue;
+		}
+
+		if(test)
+		{
+			const char *slash = strrchr(argv[optind], '/');
+
+			failures += round_trip((NULL == slash) ? argv[optind] : slash + 1, &buffer, save);
+		}
+		else
+		{
+			memset(&decoder, 0, sizeof(decoder));
+			decoder.out = stdout;
+			frames_init(&parser, on_frame, &decoder);
+			frames_feed(&parser, buffer.bytes, buffer.count);
+			fprintf(stderr, "%s: %lu frames, %lu samples, %lu bad checksums, %lu bad payloads, %lu missed frames, "
+					"%lu on other channels\n", argv[optind], parser.stats.frames, decoder.samples,
+					parser.stats.bad_checksums, decoder.bad_payloads, parser.stats.missed_frames,
+					decoder.other_frames);
+		}
+
+		free(buffer.bytes);
+	}
+
+	return (0 == failures) ? 0 : 1;
+}
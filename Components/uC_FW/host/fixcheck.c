@@ -0,0 +1,396 @@
+/*
+ * fixcheck.c
+ *
+ * Bit-exact check of the fixed-point multiplies (proj/fixed_point.h) against plain int64_t arithmetic.
+ *
+ * On the AVR the kernels are inline assembly; everywhere else they're the C versions at the bottom of
+ * fixed_point.h, which is what this checks.  fix_mul_q16, fix_mac_s16 and fix_acc_shift are the same
+ * C on both, built on top of the kernels, and they're where the cleverness is - each one has to give
+ * exactly the bits the int64_t version it replaced did, including the wrap when an answer doesn't
+ * fit in 32 bits.  filter_bench.c checks the same thing on the target, but only when someone builds
+ * it with FILTER_BENCHMARK and reads the frame it sends; this runs with make test.
+ *
+ *	fixcheck [-n count]
+ *
+ *	-n count	Random operands per check (default 2000000), on top of every pairing of the edge cases
+ *
+ * It checks:
+ *
+ *	kernels		mul_u8_u16 for every operand, the 16x16 ones for the edge cases and random pairs
+ *	fix_mul_q16	(int32_t)(((int64_t)x * c) >> 16) for any x and any coefficient c
+ *	fix_mac		fix_acc_shift of 1 to 5 fix_mac_s16's against the int64_t sum shifted down, for every shift
+ *				from 0 to 47 - shifts past 16 only where the sum fits in 48 bits (see fix_acc_shift)
+ *	filters		adc_lp_filter and adc_hp_filter against the int64_t originals (the same code as
+ *				filter_bench.c's) over random samples and long runs of full scale and 0
+ *
+ * Exit status is non-zero if anything differs.  The operands come from a fixed seed, so a failure
+ * always happens again.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fixed_point.h"
+#include "filters.h"
+
+/*Random operands per check unless -n says otherwise*/
+#define DEFAULT_COUNT 2000000UL
+
+/*Mismatches printed before it stops listing them*/
+#define MAX_REPORTS 10
+
+/*Samples run through the filters*/
+#define FILTER_SAMPLES 1000000UL
+
+/*Operands where carries and sign bits change - every pairing of these gets checked*/
+static const uint32_t edges[] =
+{
+	0x00000000, 0x00000001, 0x00000002, 0x0000007F, 0x00000080, 0x000000FF, 0x00000100, 0x00007FFF,
+	0x00008000, 0x00008001, 0x0000FFFF, 0x00010000, 0x00010001, 0x0001FFFF, 0x7FFF0000, 0x7FFFFFFF,
+	0x80000000, 0x80000001, 0x8000FFFF, 0xFFFF0000, 0xFFFF0001, 0xFFFF8000, 0xFFFFFFFE, 0xFFFFFFFF,
+	0x00580000, 0x0000ECA7, 0x000322A9, 0x0000FEFF, 0x000009AC
+};
+#define EDGES (sizeof(edges) / sizeof(edges[0]))
+
+/*Everything that differed, whether it was printed or not*/
+static unsigned long mismatches = 0;
+
+/*xorshift32 - the same sequence every run*/
+static uint32_t random_state = 0x2545F491;
+
+static uint32_t random32(void)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+/*Random operands are edge cases a quarter of the time - sign and carry boundaries are where it breaks*/
+static uint32_t operand(void)
+{
+	uint32_t r = random32();
+
+	if(0 == (r & 0x03))
+	{
+		return edges[(r >> 2) % EDGES] + ((r >> 8) & 0x01) - ((r >> 9) & 0x01);
+	}
+	return random32();
+}
+
+static void mismatch(const char *check, const char *format, ...)
+{
+	va_list args;
+
+	if(mismatches++ < MAX_REPORTS)
+	{
+		va_start(args, format);
+		fprintf(stderr, "%s: ", check);
+		vfprintf(stderr, format, args);
+		fputc('\n', stderr);
+		va_end(args);
+	}
+}
+
+/*Right shift of a negative int64_t is arithmetic with gcc - the same as the AVR code this replaced relied on*/
+static int32_t ref_shift(int64_t value, unsigned shift)
+{
+	return (int32_t)(uint32_t)(uint64_t)(value >> shift);
+}
+
+static unsigned long check_kernel_pair(uint32_t a, uint32_t b)
+{
+	uint32_t u = mul_u16_u16((uint16_t)a, (uint16_t)b);
+	int32_t su = mul_s16_u16((int16_t)a, (uint16_t)b);
+	int32_t ss = mul_s16_s16((int16_t)a, (int16_t)b);
+
+	if(u != (uint32_t)((int64_t)(uint16_t)a * (uint16_t)b))
+	{
+		mismatch("mul_u16_u16", "%04x * %04x = %08lx", (unsigned)(uint16_t)a, (unsigned)(uint16_t)b,
+				 (unsigned long)u);
+	}
+	if(su != (int32_t)((int64_t)(int16_t)a * (uint16_t)b))
+	{
+		mismatch("mul_s16_u16", "%d * %u = %ld", (int16_t)a, (unsigned)(uint16_t)b, (long)su);
+	}
+	if(ss != (int32_t)((int64_t)(int16_t)a * (int16_t)b))
+	{
+		mismatch("mul_s16_s16", "%d * %d = %ld", (int16_t)a, (int16_t)b, (long)ss);
+	}
+	return 3;
+}
+
+static unsigned long check_kernels(unsigned long count)
+{
+	unsigned long checked = 0, i, j;
+	unsigned a, b;
+
+	for(a = 0; a < 0x100; a++)
+	{
+		for(b = 0; b < 0x10000; b++)
+		{
+			if(mul_u8_u16((uint8_t)a, (uint16_t)b) != (uint32_t)((int64_t)a * b))
+			{
+				mismatch("mul_u8_u16", "%02x * %04x", a, b);
+			}
+		}
+	}
+	checked += 0x100 * 0x10000;
+
+	for(i = 0; i < EDGES; i++)
+	{
+		for(j = 0; j < EDGES; j++)
+		{
+			checked += check_kernel_pair(edges[i], edges[j]);
+			checked += check_kernel_pair(edges[i] >> 16, edges[j] >> 16);
+		}
+	}
+	for(i = 0; i < count; i++)
+	{
+		checked += check_kernel_pair(operand(), operand());
+	}
+
+	return checked;
+}
+
+static unsigned long check_mul_q16_pair(uint32_t x, uint32_t c)
+{
+	int32_t got = fix_mul_q16((int32_t)x, c);
+	int32_t want = ref_shift((int64_t)(int32_t)x * (int64_t)c, 16);
+
+	if(got != want)
+	{
+		mismatch("fix_mul_q16", "%08lx * %08lx = %08lx, int64_t says %08lx", (unsigned long)x,
+				 (unsigned long)c, (unsigned long)(uint32_t)got, (unsigned long)(uint32_t)want);
+	}
+	return 1;
+}
+
+static unsigned long check_mul_q16(unsigned long count)
+{
+	unsigned long checked = 0, i, j;
+	uint32_t c;
+
+	for(i = 0; i < EDGES; i++)
+	{
+		for(j = 0; j < EDGES; j++)
+		{
+			checked += check_mul_q16_pair(edges[i], edges[j]);
+		}
+	}
+	for(i = 0; i < count; i++)
+	{
+		//Coefficients are usually below 1.0, which is the case without the integer term
+		c = operand();
+		checked += check_mul_q16_pair(operand(), (0 != (i & 0x01)) ? (c & 0xFFFF) : c);
+	}
+
+	return checked;
+}
+
+/*One sum of 1 to 5 products, checked at every shift*/
+static unsigned long check_mac_sum(unsigned terms, const uint32_t *x, const uint32_t *c)
+{
+	fix_acc_t acc = {0, 0};
+	int64_t sum = 0;
+	unsigned long checked = 0;
+	unsigned i, shift;
+	int32_t got, want;
+
+	for(i = 0; i < terms; i++)
+	{
+		fix_mac_s16(&acc, (int32_t)x[i], (int16_t)c[i]);
+		sum += (int64_t)(int32_t)x[i] * (int16_t)c[i];
+	}
+
+	for(shift = 0; shift <= 47; shift++)
+	{
+		//Past 16 the top of the answer comes from the sum's bits 16-47 only
+		if((shift > 16) && ((sum >= ((int64_t)1 << 47)) || (sum < -((int64_t)1 << 47))))
+		{
+			continue;
+		}
+
+		got = fix_acc_shift(&acc, (uint8_t)shift);
+		want = ref_shift(sum, shift);
+		if(got != want)
+		{
+			mismatch("fix_acc_shift", "%u terms, first %08lx * %d, shift %u: %08lx, int64_t says %08lx",
+					 terms, (unsigned long)x[0], (int16_t)c[0], shift, (unsigned long)(uint32_t)got,
+					 (unsigned long)(uint32_t)want);
+		}
+		checked++;
+	}
+
+	return checked;
+}
+
+static unsigned long check_mac(unsigned long count)
+{
+	unsigned long checked = 0, i, j;
+	uint32_t x[5], c[5];
+	unsigned terms, k;
+
+	for(i = 0; i < EDGES; i++)
+	{
+		for(j = 0; j < EDGES; j++)
+		{
+			x[0] = edges[i];
+			c[0] = edges[j];
+			checked += check_mac_sum(1, x, c);
+			c[0] = edges[j] >> 16;
+			checked += check_mac_sum(1, x, c);
+		}
+	}
+	for(i = 0; i < count / 8; i++)
+	{
+		terms = 1 + (random32() % 5);
+		for(k = 0; k < terms; k++)
+		{
+			x[k] = operand();
+			c[k] = operand();
+		}
+		checked += check_mac_sum(terms, x, c);
+	}
+
+	return checked;
+}
+
+/*The filters exactly as they were before fixed_point.h - the same as filter_bench.c's, except that
+ ref_hp_filter's sum is done unsigned.  avr-gcc wraps a signed overflow there anyway, but the host
+ compiler is allowed not to.*/
+
+#define REF_LPF_B0 0x000009AC
+#define REF_LPF_B1 0x000009AC
+#define REF_LPF_A1 0x0000ECA7
+
+static int32_t ref_lp_filter(uint8_t adc_sample)
+{
+	static uint8_t last_sample=(NOMINAL_Y_ACCEL>>16);	//Idle
+	static int32_t last_result=NOMINAL_Y_ACCEL;
+	int32_t result;
+	uint32_t temp,temp2;
+	int64_t temp3;
+
+	temp = (int32_t)adc_sample*REF_LPF_B0;
+	temp2 = (int32_t)last_sample*REF_LPF_B1;
+	temp3 = ((int64_t)last_result*REF_LPF_A1)>>16;
+
+	result = (int32_t)(temp + temp2 + (uint32_t)(int32_t)temp3);
+
+	last_result = result;
+	last_sample = adc_sample;
+
+	return result;
+}
+
+#define REF_HPF_B0 0x000322A9	//3.1354
+#define REF_HPF_B1 0x000322A9	//3.1354
+#define REF_HPF_A1 0x0000FEFF	//.99608
+
+static int32_t ref_hp_filter(int32_t adc_sample)
+{
+	static int32_t last_sample=NOMINAL_Y_ACCEL;
+	static int32_t last_result = 0x00000000;
+	int32_t result;
+	int32_t temp, temp2, temp3;
+
+	temp = (int32_t)((((int64_t)last_result*REF_HPF_A1))>>16);
+	temp2 = (int32_t)((((int64_t)last_sample*REF_HPF_B1))>>16);
+	temp3 = (int32_t)((((int64_t)adc_sample*REF_HPF_B0))>>16);
+
+	result = (int32_t)((uint32_t)temp-(uint32_t)temp2+(uint32_t)temp3);
+	last_result = result;
+	last_sample = adc_sample;
+	return result;
+}
+
+/*Both pairs run in step, the high-pass fed from the low-pass, the way filter_bench.c runs them.  Mostly
+ random samples, with runs of 255 and 0 long enough to drive the states out to their limits.*/
+static unsigned long check_filters(void)
+{
+	unsigned long i, run = 0;
+	uint8_t sample = 0;
+	int32_t ref_lp, new_lp, ref_hp, new_hp;
+
+	for(i = 0; i < FILTER_SAMPLES; i++)
+	{
+		if(0 != run)
+		{
+			run--;
+		}
+		else if(0 == (random32() & 0x3FF))
+		{
+			run = random32() & 0x7FF;
+			sample = (0 != (random32() & 0x01)) ? 0xFF : 0x00;
+		}
+		else
+		{
+			sample = (uint8_t)random32();
+		}
+
+		ref_lp = ref_lp_filter(sample);
+		new_lp = adc_lp_filter(sample);
+		ref_hp = ref_hp_filter(ref_lp);
+		new_hp = adc_hp_filter(new_lp);
+
+		if((ref_lp != new_lp) || (ref_hp != new_hp))
+		{
+			mismatch("filters", "sample %lu (%02x): low-pass %08lx/%08lx, high-pass %08lx/%08lx", i,
+					 sample, (unsigned long)(uint32_t)new_lp, (unsigned long)(uint32_t)ref_lp,
+					 (unsigned long)(uint32_t)new_hp, (unsigned long)(uint32_t)ref_hp);
+		}
+	}
+
+	return FILTER_SAMPLES;
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [-n count]\n", program);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long count = DEFAULT_COUNT;
+	unsigned long kernels, mul_q16, mac, filters;
+	char *end;
+	int option;
+
+	while(-1 != (option = getopt(argc, argv, "n:")))
+	{
+		switch(option)
+		{
+			case 'n':
+				count = strtoul(optarg, &end, 0);
+				if('\0' != *end)
+				{
+					usage(argv[0]);
+				}
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(optind != argc)
+	{
+		usage(argv[0]);
+	}
+
+	kernels = check_kernels(count);
+	mul_q16 = check_mul_q16(count);
+	mac = check_mac(count);
+	filters = check_filters();
+
+	printf("fixed_point.h: %lu kernel products, %lu fix_mul_q16, %lu fix_acc_shift, %lu filter samples, "
+		   "%lu mismatches\n", kernels, mul_q16, mac, filters, mismatches);
+
+	return (0 == mismatches) ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+/*
+ * frames.c
+ *
+ * UART frame parser and compressed sample decoder - see frames.h.
+ */
+
+#include <string.h>
+
+#include "frames.h"
+
+void frames_init(frames_parser_t *parser, frames_callback_t callback, void *context)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->callback = callback;
+	parser->context = context;
+}
+
+/*Throw away the first n bytes of the buffer*/
+static void frames_drop(frames_parser_t *parser, size_t n)
+{
+	memmove(parser->buffer, parser->buffer + n, parser->count - n);
+	parser->count -= n;
+}
+
+/*Pull out every complete frame at the start of the buffer*/
+static void frames_scan(frames_parser_t *parser)
+{
+	for(;;)
+	{
+		uint8_t *frame = parser->buffer;
+		size_t size, i;
+		uint8_t sum = 0, sequence;
+		unsigned int missed = 0;
+
+		if(parser->count >= 1 && UART_SYNC_0 != frame[0])
+		{
+			frames_drop(parser, 1);
+			continue;
+		}
+		if(parser->count >= 2 && UART_SYNC_1 != frame[1])
+		{
+			frames_drop(parser, 1);
+			continue;
+		}
+		if(parser->count < 5)
+		{
+			return;
+		}
+		size = (size_t)frame[4] + UART_FRAME_OVERHEAD;
+		if(parser->count < size)
+		{
+			return;
+		}
+
+		for(i = 2; i < size; i++)
+		{
+			sum += frame[i];
+		}
+		if(0 != sum)
+		{
+			/*Probably not a real sync word - keep hunting from the next byte*/
+			parser->stats.bad_checksums++;
+			frames_drop(parser, 1);
+			continue;
+		}
+
+		sequence = frame[2];
+		if(parser->have_sequence)
+		{
+			missed = (uint8_t)(sequence - parser->next_sequence);
+		}
+		parser->have_sequence = 1;
+		parser->next_sequence = (uint8_t)(sequence + 1);
+		parser->stats.frames++;
+		parser->stats.missed_frames += missed;
+
+		parser->callback(parser->context, frame[3], frame + 5, frame[4], missed);
+		frames_drop(parser, size);
+	}
+}
+
+void frames_feed(frames_parser_t *parser, const uint8_t *bytes, size_t count)
+{
+	while(count > 0)
+	{
+		size_t take = sizeof(parser->buffer) - parser->count;
+
+		if(take > count)
+		{
+			take = count;
+		}
+		memcpy(parser->buffer + parser->count, bytes, take);
+		parser->count += take;
+		bytes += take;
+		count -= take;
+
+		frames_scan(parser);
+	}
+}
+
+int frames_decode_xyz(const uint8_t *payload, size_t length, uint16_t samples[][ADC_SCAN_AXES])
+{
+	size_t nibble = 0, nibbles;
+	int count, i, axis;
+
+	if(length < STREAM_HEADER_SIZE)
+	{
+		return -1;
+	}
+	count = payload[0];
+	if(count < 1 || count > STREAM_FRAME_SAMPLES)
+	{
+		return -1;
+	}
+	nibbles = (length - STREAM_HEADER_SIZE) * 2;
+
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		samples[0][axis] = (uint16_t)(payload[1 + axis * 2] | (payload[2 + axis * 2] << 8));
+	}
+
+#define NEXT_NIBBLE() ((payload[STREAM_HEADER_SIZE + (nibble >> 1)] >> ((nibble & 1) ? 0 : 4)) & 0x0F)
+	for(i = 1; i < count; i++)
+	{
+		for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+		{
+			unsigned int zigzag, k;
+			int delta;
+
+			if(nibble >= nibbles)
+			{
+				return -1;
+			}
+			zigzag = NEXT_NIBBLE();
+			nibble++;
+			if(STREAM_ESCAPE == zigzag)
+			{
+				if(nibble + 3 > nibbles)
+				{
+					return -1;
+				}
+				zigzag = 0;
+				for(k = 0; k < 3; k++)
+				{
+					zigzag = (zigzag << 4) | NEXT_NIBBLE();
+					nibble++;
+				}
+			}
+
+			delta = (zigzag & 1) ? -(int)((zigzag + 1) >> 1) : (int)(zigzag >> 1);
+			samples[i][axis] = (uint16_t)(samples[i - 1][axis] + delta);
+		}
+	}
+#undef NEXT_NIBBLE
+
+	/*Anything left over can only be the padding nibble*/
+	if(nibbles - nibble > 1)
+	{
+		return -1;
+	}
+	return count;
+}
+
+size_t frames_build(uint8_t *frame, uint8_t sequence, uint8_t channel, const uint8_t *payload, uint8_t length)
+{
+	uint8_t checksum = (uint8_t)(sequence + channel + length);
+	uint8_t i;
+
+	frame[0] = UART_SYNC_0;
+	frame[1] = UART_SYNC_1;
+	frame[2] = sequence;
+	frame[3] = channel;
+	frame[4] = length;
+	for(i = 0; i < length; i++)
+	{
+		frame[5 + i] = payload[i];
+		checksum += payload[i];
+	}
+	frame[5 + length] = (uint8_t)(0 - checksum);
+	return (size_t)length + UART_FRAME_OVERHEAD;
+}
@@ -0,0 +1,57 @@
+/*
+ * frames.h
+ *
+ * Host-side parser for the firmware's UART frames (proj/uart.h) and the compressed sample payload
+ * (proj/stream.h).  Shared by decode and capture.
+ *
+ * Bytes go in one at a time, in whatever pieces they arrive, and every frame with a good checksum comes
+ * out through the callback.  Anything else is skipped a byte at a time until the next sync word, so a
+ * capture that starts mid-frame or loses bytes picks up again at the next good frame.
+ */
+
+#ifndef FRAMES_H_
+#define FRAMES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stream.h"
+
+/*Biggest possible frame - the length byte can say up to 255*/
+#define FRAMES_MAX_SIZE (UART_FRAME_OVERHEAD + 255)
+
+typedef struct
+{
+	unsigned long frames;			/*Frames with a good checksum*/
+	unsigned long bad_checksums;	/*Sync words that didn't turn out to be frames*/
+	unsigned long missed_frames;	/*Gaps in the sequence numbers*/
+} frames_stats_t;
+
+/*Called for every good frame.  missed is how many frames the sequence number says went missing just
+ before this one.*/
+typedef void (*frames_callback_t)(void *context, uint8_t channel, const uint8_t *payload, uint8_t length,
+								  unsigned int missed);
+
+typedef struct
+{
+	uint8_t buffer[FRAMES_MAX_SIZE];
+	size_t count;
+	int have_sequence;
+	uint8_t next_sequence;
+	frames_stats_t stats;
+	frames_callback_t callback;
+	void *context;
+} frames_parser_t;
+
+void frames_init(frames_parser_t *parser, frames_callback_t callback, void *context);
+void frames_feed(frames_parser_t *parser, const uint8_t *bytes, size_t count);
+
+/*Unpack a CHANNEL_ACCEL_XYZ payload into samples.  Returns the number of samples, or -1 if the payload
+ doesn't make sense.*/
+int frames_decode_xyz(const uint8_t *payload, size_t length, uint16_t samples[][ADC_SCAN_AXES]);
+
+/*Build the same bytes uart_send_frame() queues.  frame has to hold length + UART_FRAME_OVERHEAD bytes.
+ Returns the frame's size.*/
+size_t frames_build(uint8_t *frame, uint8_t sequence, uint8_t channel, const uint8_t *payload, uint8_t length);
+
+#endif /* FRAMES_H_ */
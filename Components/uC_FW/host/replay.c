@@ -0,0 +1,398 @@
+/*
+ * replay.c
+ *
+ * Host-side replay and benchmark harness for the firmware's signal chain (proj/dsp_chain.c).
+ *
+ * Captures are raw streams of 8-bit ADC samples, one byte per sample - exactly what the firmware
+ * used to send over the UART, and what RealTerm saved as accel_data.txt.  They can also be capture
+ * files made by ./capture (capfile.h), which are used in place: the accel_y8 column by default, or
+ * any other with -c.  A 10-bit column is cut down to the top 8 bits the chain takes.  Each one is fed through a
+ * fresh chain and every decimated output is either compared against a golden vector file or written
+ * out as a new one.  The golden files are plain text, one line per 20Hz output:
+ *
+ *	<index of the sample that completed it> <accel> <motion> <velocity> <step filter> <steps>
+ *
+ * with the Q16.16 values in hex as 32-bit two's complement, and the step detector's Q8.8 filter output
+ * and step count in hex.  Any difference at all is a failure -
+ * the firmware arithmetic is integer-only, so the host and the AVR have to agree bit for bit.
+ *
+ *	replay [-g dir | -w dir] [-t seconds] [-c column] capture...
+ *
+ *	-g dir		Compare against dir/<capture name>.golden
+ *	-w dir		Write dir/<capture name>.golden instead
+ *	-t seconds	Then run the chain over the capture for about this long and report samples per second
+ *				and per-sample latency
+ *	-c column	Which column of a capture file to replay (default accel_y8)
+ *
+ * Exit status is non-zero if any capture doesn't match its golden vectors.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dsp_chain.h"
+#include "capfile.h"
+
+/*Where every chain starts - the same rest value the firmware uses*/
+#define REST_SAMPLE 0x58
+
+/*How many individually timed samples go into the latency figures*/
+#define LATENCY_SAMPLES 100000
+
+typedef struct
+{
+	const uint8_t *samples;
+	size_t count;
+	uint8_t *allocated;		/*What to free, if samples isn't in a mapped capture file*/
+	capfile_t file;
+	int mapped;
+} capture_t;
+
+/*Use a capture file's column where it is if it's 8-bit, or make an 8-bit copy of a 10-bit one*/
+static int map_capture(const char *path, const char *name, capture_t *capture)
+{
+	const uint16_t *wide;
+	uint64_t rows, i;
+	int column;
+
+	if(0 != capfile_open(&capture->file, path))
+	{
+		return -1;
+	}
+	capture->mapped = 1;
+
+	column = capfile_find(&capture->file, name);
+	capture->samples = capfile_data(&capture->file, column, CAPFILE_U8, &rows);
+	if(NULL == capture->samples)
+	{
+		wide = capfile_data(&capture->file, column, CAPFILE_U16, &rows);
+		if(NULL == wide)
+		{
+			fprintf(stderr, "%s: no 8 or 16-bit column called %s\n", path, name);
+			return -1;
+		}
+		capture->allocated = malloc(rows + 1);
+		if(NULL == capture->allocated)
+		{
+			fprintf(stderr, "%s: out of memory\n", path);
+			return -1;
+		}
+		for(i = 0; i < rows; i++)
+		{
+			capture->allocated[i] = (uint8_t)(wide[i] >> 2);
+		}
+		capture->samples = capture->allocated;
+	}
+	capture->count = (size_t)rows;
+	return 0;
+}
+
+static void free_capture(capture_t *capture)
+{
+	free(capture->allocated);
+	if(capture->mapped)
+	{
+		capfile_close(&capture->file);
+	}
+}
+
+static int load_capture(const char *path, const char *column, capture_t *capture)
+{
+	FILE *file;
+	size_t allocated = 4096;
+	uint8_t *samples;
+
+	memset(capture, 0, sizeof(*capture));
+	if(capfile_is_capture(path))
+	{
+		return map_capture(path, column, capture);
+	}
+
+	file = fopen(path, "rb");
+
+	if(NULL == file)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	samples = malloc(allocated);
+	while(NULL != samples)
+	{
+		size_t got = fread(samples + capture->count, 1, allocated - capture->count, file);
+
+		capture->count += got;
+		if(capture->count < allocated)
+		{
+			break;
+		}
+		allocated *= 2;
+		samples = realloc(samples, allocated);
+	}
+	fclose(file);
+	capture->samples = samples;
+	capture->allocated = samples;
+
+	if(NULL == samples)
+	{
+		fprintf(stderr, "%s: out of memory\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static const char *base_name(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+
+	return (NULL == slash) ? path : slash + 1;
+}
+
+static double now_seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+static long now_nanoseconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/*Run the capture through a fresh chain and either write or check the golden vectors.
+ Returns 0 on a match (or a successful write).*/
+static int replay_golden(const char *name, const capture_t *capture, const char *dir, int write)
+{
+	char path[4096];
+	FILE *golden;
+	dsp_chain_t chain;
+	size_t i;
+	int failed = 0;
+
+	snprintf(path, sizeof(path), "%s/%s.golden", dir, name);
+	golden = fopen(path, write ? "w" : "r");
+	if(NULL == golden)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	dsp_chain_init(&chain, DSP_SAMPLE_8BIT(REST_SAMPLE));
+
+	for(i = 0; i < capture->count && 0 == failed; i++)
+	{
+		size_t expected_index;
+		unsigned long expected_accel, expected_motion, expected_velocity, expected_output;
+		unsigned int expected_steps;
+
+		if(FALSE == dsp_chain_process(&chain, DSP_SAMPLE_8BIT(capture->samples[i])))
+		{
+			continue;
+		}
+		dsp_chain_decimate(&chain);
+
+		if(write)
+		{
+			fprintf(golden, "%zu %08lx %08lx %08lx %08lx %04x\n", i, (unsigned long)(uint32_t)chain.accel,
+					(unsigned long)(uint32_t)chain.motion, (unsigned long)(uint32_t)chain.velocity,
+					(unsigned long)chain.steps.output, chain.steps.steps);
+			continue;
+		}
+
+		if(6 != fscanf(golden, "%zu %lx %lx %lx %lx %x", &expected_index, &expected_accel, &expected_motion,
+					   &expected_velocity, &expected_output, &expected_steps))
+		{
+			fprintf(stderr, "%s: ends before sample %zu of %zu\n", path, i, capture->count);
+			failed = 1;
+		}
+		else if(expected_index != i)
+		{
+			fprintf(stderr, "%s: decimated at sample %zu but the golden file says %zu\n", name, i,
+					expected_index);
+			failed = 1;
+		}
+		else if(expected_accel != (uint32_t)chain.accel || expected_motion != (uint32_t)chain.motion
+				|| expected_velocity != (uint32_t)chain.velocity)
+		{
+			fprintf(stderr, "%s: sample %zu: got accel %08lx motion %08lx velocity %08lx, "
+					"expected %08lx %08lx %08lx\n", name, i, (unsigned long)(uint32_t)chain.accel,
+					(unsigned long)(uint32_t)chain.motion, (unsigned long)(uint32_t)chain.velocity,
+					expected_accel, expected_motion, expected_velocity);
+			failed = 1;
+		}
+		else if(expected_output != chain.steps.output || expected_steps != chain.steps.steps)
+		{
+			fprintf(stderr, "%s: sample %zu: got step filter %08lx steps %04x, expected %08lx %04x\n",
+					name, i, (unsigned long)chain.steps.output, chain.steps.steps, expected_output,
+					expected_steps);
+			failed = 1;
+		}
+	}
+
+	fclose(golden);
+
+	if(write)
+	{
+		printf("%s: wrote %zu samples' worth to %s\n", name, capture->count, path);
+	}
+	else if(0 == failed)
+	{
+		printf("%s: %zu samples match %s\n", name, capture->count, path);
+	}
+	return failed;
+}
+
+static int compare_long(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void benchmark(const char *name, const capture_t *capture, double seconds)
+{
+	static long latency[LATENCY_SAMPLES];
+	volatile int32_t sink;
+	dsp_chain_t chain;
+	double start, elapsed;
+	unsigned long long processed = 0;
+	long overhead, before;
+	size_t i;
+
+	if(0 == capture->count)
+	{
+		return;
+	}
+
+	/*Throughput: whole passes over the capture, timed as a block so the clock isn't in the loop*/
+	dsp_chain_init(&chain, DSP_SAMPLE_8BIT(REST_SAMPLE));
+	start = now_seconds();
+	do
+	{
+		for(i = 0; i < capture->count; i++)
+		{
+			if(TRUE == dsp_chain_process(&chain, DSP_SAMPLE_8BIT(capture->samples[i])))
+			{
+				dsp_chain_decimate(&chain);
+			}
+		}
+		sink = chain.motion;
+		processed += capture->count;
+		elapsed = now_seconds() - start;
+	} while(elapsed < seconds);
+
+	/*Latency: time samples one at a time, minus what reading the clock costs on its own*/
+	before = now_nanoseconds();
+	overhead = now_nanoseconds() - before;
+	for(i = 0; i < 1000; i++)
+	{
+		long empty;
+
+		before = now_nanoseconds();
+		empty = now_nanoseconds() - before;
+		if(empty < overhead)
+		{
+			overhead = empty;
+		}
+	}
+
+	dsp_chain_init(&chain, DSP_SAMPLE_8BIT(REST_SAMPLE));
+	for(i = 0; i < LATENCY_SAMPLES; i++)
+	{
+		before = now_nanoseconds();
+		if(TRUE == dsp_chain_process(&chain, DSP_SAMPLE_8BIT(capture->samples[i % capture->count])))
+		{
+			dsp_chain_decimate(&chain);
+		}
+		latency[i] = now_nanoseconds() - before - overhead;
+	}
+	sink = chain.motion;
+	(void)sink;
+	qsort(latency, LATENCY_SAMPLES, sizeof(latency[0]), compare_long);
+
+	printf("%s: %llu samples in %.3f s = %.0f samples/s (%.1f ns/sample)\n", name, processed, elapsed,
+		   (double)processed / elapsed, elapsed * 1e9 / (double)processed);
+	printf("%s: per-sample latency p50 %ld ns, p99 %ld ns, max %ld ns (clock overhead %ld ns removed)\n",
+		   name, latency[LATENCY_SAMPLES / 2], latency[LATENCY_SAMPLES * 99 / 100],
+		   latency[LATENCY_SAMPLES - 1], overhead);
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [-g dir | -w dir] [-t seconds] [-c column] capture...\n", program);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *golden_dir = NULL;
+	const char *column = "accel_y8";
+	int write = 0;
+	double seconds = 0.0;
+	int option, failures = 0;
+
+	while(-1 != (option = getopt(argc, argv, "g:w:t:c:")))
+	{
+		switch(option)
+		{
+			case 'g':
+				golden_dir = optarg;
+				write = 0;
+				break;
+			case 'w':
+				golden_dir = optarg;
+				write = 1;
+				break;
+			case 't':
+				seconds = atof(optarg);
+				break;
+			case 'c':
+				column = optarg;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(optind == argc)
+	{
+		usage(argv[0]);
+	}
+
+	for(; optind < argc; optind++)
+	{
+		const char *name = base_name(argv[optind]);
+		capture_t capture;
+
+		if(0 != load_capture(argv[optind], column, &capture))
+		{
+			free_capture(&capture);
+			failures++;
+			continue;
+		}
+
+		if(NULL != golden_dir && 0 != replay_golden(name, &capture, golden_dir, write))
+		{
+			failures++;
+		}
+		if(seconds > 0.0)
+		{
+			benchmark(name, &capture, seconds);
+		}
+
+		free_capture(&capture);
+	}
+
+	return (0 == failures) ? 0 : 1;
+}
@@ -0,0 +1,807 @@
+/*
+ * streetsim.c
+ *
+ * Runs the firmware's streetlight state machine (proj/streetlight.c) against a virtual clock and checks
+ * every step of it against the timing rules at the top of costume_2012.c.  A step is one decimated
+ * sample, 50ms, and here it takes a few nanoseconds - an hour of walking around is 72000 steps and
+ * simulates in well under a millisecond.
+ *
+ *	streetsim [-x depth] [-s hours] [-r seed] [-h hours] [-b] [-v] [capture...]
+ *
+ *	-x depth	Every sequence of 'depth' walks and stops whose lengths are the corner cases of the rules
+ *				- one step either side of every time limit and every sum of them - at a few different
+ *				walking cadences, each from power-up
+ *	-s hours	This many hours of random walking, standing, dawdling and stopping
+ *	-r seed		Seed for -s (default 1)
+ *	-h hours	Run each capture round and round until it's been this many hours (default once through)
+ *	-b			Run each capture through the black box recorder (proj/blackbox.c) as well, with a made-up
+ *				fall every so often, ask it for a dump every BLACKBOX_DUMP_STEPS and check every window
+ *				that comes back over the framing against what went in
+ *	-v			Print every light change in the captures, with its time
+ *
+ * Captures are raw 8-bit Y-axis samples or capture files, the same as replay takes.  They go through
+ * the firmware's own signal chain, Y axis only, and its step detector says when the wearer is walking.
+ * The synthetic motion skips the chain and says which steps have a footstep in them directly.
+ *
+ * The checker doesn't look at the state machine's state, only at the lights, and keeps its own idea of
+ * walking from the footsteps:
+ *
+ *	- Exactly one light is on, and red is on at power-up
+ *	- The lights only go green -> yellow -> red -> green
+ *	- Green is on for at least 1s, and goes to yellow as soon as the wearer stops after that - and not
+ *	  while they're walking
+ *	- Yellow is on for exactly 3s
+ *	- Red is on for at least 1s, and goes green only when a walk starts after that, and straight away
+ *
+ * Exit status is non-zero if anything breaks a rule.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "streetlight.h"
+#include "dsp_chain.h"
+#include "blackbox.h"
+#include "capfile.h"
+#include "frames.h"
+
+/*Where the chain starts - the same rest value replay uses*/
+#define REST_SAMPLE 0x58
+
+/*Violations printed per run - the rest are just counted*/
+#define PRINT_VIOLATIONS 10
+
+/*Stopped long enough at the end of every exhaustive sequence for the lights to go all the way to red
+ Held, and then some*/
+#define SETTLE_STEPS (STREET_WALK_STEPS + STREET_YELLOW_STEPS + STREET_RED_ON_STEPS + STREET_STEP_HZ)
+
+#define MAX_DEPTH 8
+#define MAX_LENGTHS 64
+
+/*The black box check: a dump is asked for every 10s and a fall made up every 37.15s, so they drift
+ past each other and past the lights.  The last SHADOW_ENTRIES entries that went in are kept to check
+ against - plenty, since a window is sent within a second of its dump being asked for.*/
+#define BLACKBOX_DUMP_STEPS (STREET_STEP_HZ * 10)
+#define BLACKBOX_FALL_STEPS 743
+#define SHADOW_ENTRIES 1024
+#define SHADOW_MASK (SHADOW_ENTRIES - 1)
+
+/*What the black box check knows about the dump it's reading*/
+typedef struct
+{
+	const char *name;
+	blackbox_entry_t shadow[SHADOW_ENTRIES];	/*Entry n went in at decimated sample n + 1*/
+	unsigned long long recorded;				/*Entries that have gone in*/
+	int have_header;
+	uint8_t count, before, reason, lights;
+	unsigned long long first;					/*Sample number of the window's first entry*/
+	unsigned int next;							/*Index of the next entry expected*/
+	unsigned long windows[BLACKBOX_LIGHTS + 1];
+	unsigned long entries;
+	unsigned long missed;
+	unsigned long violations;
+} blackbox_check_t;
+
+typedef struct
+{
+	const char *name;
+	streetlight_t light;
+	long long step;			/*The virtual clock*/
+	uint8_t lights;			/*What was on after the last step*/
+	long long since;		/*When it came on*/
+	long long last_step;	/*When the last footstep was*/
+	unsigned long long steps;
+	unsigned long changes;
+	unsigned long violations;
+	int verbose;
+} sim_t;
+
+static const char *light_name(uint8_t lights)
+{
+	switch(lights)
+	{
+		case STREET_GREEN_LIGHT:
+			return "green";
+		case STREET_YELLOW_LIGHT:
+			return "yellow";
+		case STREET_RED_LIGHT:
+			return "red";
+		default:
+			return "?";
+	}
+}
+
+static double step_seconds(long long step)
+{
+	return (double)step / STREET_STEP_HZ;
+}
+
+static void sim_start(sim_t *sim, const char *name)
+{
+	memset(sim, 0, sizeof(*sim));
+	sim->name = name;
+	streetlight_init(&sim->light);
+	sim->lights = streetlight_lights(&sim->light);
+
+	/*Power-up red counts as Held - the first walk turns it green*/
+	sim->since = -(STREET_RED_ON_STEPS + 1);
+	sim->last_step = -(STREET_WALK_STEPS + 1);
+	if(STREET_RED_LIGHT != sim->lights)
+	{
+		printf("%s: starts %s, not red\n", name, light_name(sim->lights));
+		sim->violations++;
+	}
+}
+
+static void sim_violation(sim_t *sim, const char *what, long long held)
+{
+	if(sim->violations++ < PRINT_VIOLATIONS)
+	{
+		printf("%s: %.2fs: %s (%s for %.2fs)\n", sim->name, step_seconds(sim->step), what,
+			   light_name(sim->lights), step_seconds(held));
+	}
+}
+
+/*Restart the state machine and the checker for the next exhaustive sequence, keeping the totals*/
+static void sim_restart(sim_t *sim)
+{
+	sim_t totals = *sim;
+
+	sim_start(sim, totals.name);
+	sim->steps = totals.steps;
+	sim->changes = totals.changes;
+	sim->violations = totals.violations;
+	sim->verbose = totals.verbose;
+}
+
+/*One step of the virtual clock: run the firmware's state machine, then check what it did*/
+static void sim_step(sim_t *sim, int footstep)
+{
+	uint8_t lights;
+	long long held;
+	int walking, started;
+
+	sim->step++;
+	sim->steps++;
+
+	/*Walking is a footstep in the last STREET_WALK_STEPS, and a walk starts on a footstep after a gap
+	 that long*/
+	started = footstep && (sim->step - sim->last_step > STREET_WALK_STEPS);
+	if(footstep)
+	{
+		sim->last_step = sim->step;
+	}
+	walking = (sim->step - sim->last_step < STREET_WALK_STEPS);
+
+	streetlight_step(&sim->light, footstep ? TRUE : FALSE);
+	lights = streetlight_lights(&sim->light);
+	held = sim->step - sim->since;
+
+	if(STREET_GREEN_LIGHT != lights && STREET_YELLOW_LIGHT != lights && STREET_RED_LIGHT != lights)
+	{
+		sim_violation(sim, "not exactly one light on", held);
+	}
+
+	if(lights == sim->lights)
+	{
+		switch(lights)
+		{
+			case STREET_GREEN_LIGHT:
+				if(!walking && held >= STREET_GREEN_MIN_STEPS)
+				{
+					sim_violation(sim, "still green after stopping", held);
+				}
+				break;
+			case STREET_YELLOW_LIGHT:
+				if(held >= STREET_YELLOW_STEPS)
+				{
+					sim_violation(sim, "yellow too long", held);
+				}
+				break;
+			case STREET_RED_LIGHT:
+				if(started && held > STREET_RED_ON_STEPS)
+				{
+					sim_violation(sim, "walk started while red was Held, but no green", held);
+				}
+				break;
+			default:
+				break;
+		}
+		return;
+	}
+
+	switch(sim->lights)
+	{
+		case STREET_GREEN_LIGHT:
+			if(STREET_YELLOW_LIGHT != lights)
+			{
+				sim_violation(sim, "green not followed by yellow", held);
+			}
+			if(held < STREET_GREEN_MIN_STEPS)
+			{
+				sim_violation(sim, "green too short", held);
+			}
+			if(walking)
+			{
+				sim_violation(sim, "went yellow while walking", held);
+			}
+			break;
+		case STREET_YELLOW_LIGHT:
+			if(STREET_RED_LIGHT != lights)
+			{
+				sim_violation(sim, "yellow not followed by red", held);
+			}
+			if(held != STREET_YELLOW_STEPS)
+			{
+				sim_violation(sim, "yellow not 3s", held);
+			}
+			break;
+		case STREET_RED_LIGHT:
+			if(STREET_GREEN_LIGHT != lights)
+			{
+				sim_violation(sim, "red not followed by green", held);
+			}
+			if(held <= STREET_RED_ON_STEPS)
+			{
+				sim_violation(sim, "red not Held before going green", held);
+			}
+			if(!started)
+			{
+				sim_violation(sim, "went green without a walk starting", held);
+			}
+			break;
+		default:
+			break;
+	}
+
+	if(sim->verbose)
+	{
+		printf("%s: %10.2fs  %-6s -> %s\n", sim->name, step_seconds(sim->step), light_name(sim->lights),
+			   light_name(lights));
+	}
+	sim->lights = lights;
+	sim->since = sim->step;
+	sim->changes++;
+}
+
+static double now_seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+static void sim_report(const sim_t *sim, const char *what, double started)
+{
+	double elapsed = now_seconds() - started;
+
+	printf("%s: %s%llu steps, %.1f hours simulated in %.3f s, %lu light changes, %lu violations\n",
+		   sim->name, what, sim->steps, (double)sim->steps / (STREET_STEP_HZ * 3600.0), elapsed,
+		   sim->changes, sim->violations);
+}
+
+static int add_length(int *lengths, int count, int length)
+{
+	int i;
+
+	if(length < 1 || count >= MAX_LENGTHS)
+	{
+		return count;
+	}
+	for(i = 0; i < count; i++)
+	{
+		if(lengths[i] == length)
+		{
+			return count;
+		}
+	}
+	lengths[count] = length;
+	return count + 1;
+}
+
+/*Walk or stand for this many steps.  A walk has a footstep every 'cadence' steps.*/
+static void run_segment(sim_t *sim, int walking, int length, int cadence)
+{
+	int i;
+
+	for(i = 0; i < length; i++)
+	{
+		sim_step(sim, walking && 0 == i % cadence);
+	}
+}
+
+/*Every walk/stop sequence of the given depth, each from power-up*/
+static int run_exhaustive(int depth)
+{
+	static const int limits[] =
+	{
+		STREET_GREEN_MIN_STEPS, STREET_YELLOW_STEPS, STREET_RED_ON_STEPS, STREET_WALK_STEPS
+	};
+	/*A footstep every step, the slowest that's still walking, and too slow to be walking*/
+	const int cadences[] = {1, STREET_WALK_STEPS - 1, STREET_WALK_STEPS};
+	int lengths[MAX_LENGTHS];
+	int choice[MAX_DEPTH];
+	int count = 0;
+	int subset, i, cadence, offset, sum;
+	unsigned long sequences = 0;
+	char what[64];
+	double started = now_seconds();
+	sim_t sim;
+
+	if(depth < 1 || depth > MAX_DEPTH)
+	{
+		fprintf(stderr, "depth must be 1 to %d\n", MAX_DEPTH);
+		return 1;
+	}
+
+	/*One step either side of every time limit and every sum of them - that's where the rules change
+	 their minds*/
+	count = add_length(lengths, count, 1);
+	count = add_length(lengths, count, 2);
+	for(subset = 1; subset < (1 << 4); subset++)
+	{
+		sum = 0;
+		for(i = 0; i < 4; i++)
+		{
+			if(subset & (1 << i))
+			{
+				sum += limits[i];
+			}
+		}
+		for(offset = -1; offset <= 1; offset++)
+		{
+			count = add_length(lengths, count, sum + offset);
+		}
+	}
+
+	sim_start(&sim, "exhaustive");
+	for(cadence = 0; cadence < (int)(sizeof(cadences) / sizeof(cadences[0])); cadence++)
+	{
+		memset(choice, 0, sizeof(choice));
+		for(;;)
+		{
+			sim_restart(&sim);
+			for(i = 0; i < depth; i++)
+			{
+				run_segment(&sim, 0 == (i & 1), lengths[choice[i]], cadences[cadence]);
+			}
+			run_segment(&sim, 0, SETTLE_STEPS, 1);
+			sequences++;
+
+			/*Next combination, like an odometer*/
+			for(i = 0; i < depth && ++choice[i] == count; i++)
+			{
+				choice[i] = 0;
+			}
+			if(i == depth)
+			{
+				break;
+			}
+		}
+	}
+
+	snprintf(what, sizeof(what), "depth %d, %d lengths, %lu sequences, ", depth, count, sequences);
+	sim_report(&sim, what, started);
+	return (0 == sim.violations) ? 0 : 1;
+}
+
+/*xorshift32 - plenty for making up a walk*/
+static uint32_t random_next(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static int random_range(uint32_t *state, int low, int high)
+{
+	return low + (int)(random_next(state) % (uint32_t)(high - low + 1));
+}
+
+/*Hours of made-up motion: walks of any length at any cadence (some too slow to count), and stops from
+ a single step to half a minute*/
+static int run_synthetic(double hours, uint32_t seed)
+{
+	long long total = (long long)(hours * 3600.0 * STREET_STEP_HZ);
+	uint32_t state = (0 == seed) ? 1 : seed;
+	double started = now_seconds();
+	int length;
+	sim_t sim;
+
+	sim_start(&sim, "synthetic");
+	while(sim.step < total)
+	{
+		length = random_range(&state, 1, 60 * STREET_STEP_HZ);
+		run_segment(&sim, 1, length, random_range(&state, 1, STREET_WALK_STEPS + 2));
+		length = random_range(&state, 1, 30 * STREET_STEP_HZ);
+		run_segment(&sim, 0, length, 1);
+	}
+
+	sim_report(&sim, "", started);
+	return (0 == sim.violations) ? 0 : 1;
+}
+
+static const char *base_name(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+
+	return (NULL == slash) ? path : slash + 1;
+}
+
+/*A raw capture, or the accel_y8 column of a capture file*/
+static uint8_t *load_capture(const char *path, size_t *count)
+{
+	capfile_t file;
+	const uint8_t *column;
+	uint64_t rows;
+	uint8_t *samples = NULL;
+	size_t allocated = 4096;
+	FILE *raw;
+
+	*count = 0;
+	if(capfile_is_capture(path))
+	{
+		if(0 != capfile_open(&file, path))
+		{
+			return NULL;
+		}
+		column = capfile_data(&file, capfile_find(&file, "accel_y8"), CAPFILE_U8, &rows);
+		if(NULL != column && NULL != (samples = malloc(rows + 1)))
+		{
+			memcpy(samples, column, rows);
+			*count = (size_t)rows;
+		}
+		else
+		{
+			fprintf(stderr, "%s: no accel_y8 column\n", path);
+		}
+		capfile_close(&file);
+		return samples;
+	}
+
+	raw = fopen(path, "rb");
+	if(NULL == raw)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	samples = malloc(allocated);
+	while(NULL != samples)
+	{
+		*count += fread(samples + *count, 1, allocated - *count, raw);
+		if(*count < allocated)
+		{
+			break;
+		}
+		allocated *= 2;
+		samples = realloc(samples, allocated);
+	}
+	fclose(raw);
+	if(NULL == samples)
+	{
+		fprintf(stderr, "%s: out of memory\n", path);
+	}
+	return samples;
+}
+
+/*The capture through the signal chain, round and round for 'hours' if it's given*/
+static int run_capture(const char *path, double hours, int verbose)
+{
+	dsp_chain_t chain;
+	uint8_t *samples;
+	size_t count, i;
+	unsigned long long total, fed = 0;
+	double started;
+	sim_t sim;
+
+	samples = load_capture(path, &count);
+	if(NULL == samples || 0 == count)
+	{
+		free(samples);
+		return 1;
+	}
+
+	total = (hours > 0.0) ? (unsigned long long)(hours * 3600.0 * TICK_HZ) : count;
+	started = now_seconds();
+	sim_start(&sim, base_name(path));
+	sim.verbose = verbose;
+	dsp_chain_init(&chain, DSP_SAMPLE_8BIT(REST_SAMPLE));
+	for(i = 0; fed < total; fed++)
+	{
+		if(TRUE == dsp_chain_process(&chain, DSP_SAMPLE_8BIT(samples[i])))
+		{
+			sim_step(&sim, TRUE == dsp_chain_decimate(&chain));
+		}
+		if(++i == count)
+		{
+			i = 0;
+		}
+	}
+
+	sim_report(&sim, "", started);
+	free(samples);
+	return (0 == sim.violations) ? 0 : 1;
+}
+
+static void blackbox_violation(blackbox_check_t *check, const char *what, unsigned int index)
+{
+	if(check->violations++ < PRINT_VIOLATIONS)
+	{
+		printf("%s: black box window at %.2fs, entry %u: %s\n", check->name,
+			   step_seconds((long long)(check->first + check->before)), index, what);
+	}
+}
+
+/*The window's header, then its entries - checked against the shadow as they arrive*/
+static void blackbox_on_frame(void *context, uint8_t channel, const uint8_t *payload, uint8_t length,
+							  unsigned int missed)
+{
+	blackbox_check_t *check = context;
+	const blackbox_entry_t *want;
+	blackbox_entry_t got;
+	uint32_t sample;
+	unsigned int i, index;
+	uint8_t state_lights;
+
+	if(CHANNEL_BLACKBOX != channel || 0 != missed || 0 == length)
+	{
+		blackbox_violation(check, "bad frame", 0);
+		return;
+	}
+
+	if(BLACKBOX_HEADER_INDEX == payload[0])
+	{
+		if(BLACKBOX_HEADER_SIZE != length || check->have_header)
+		{
+			blackbox_violation(check, "bad header", 0);
+			return;
+		}
+		check->reason = payload[1];
+		check->lights = payload[2];
+		check->count = payload[3];
+		check->before = payload[4];
+		sample = (uint32_t)payload[5] | ((uint32_t)payload[6] << 8) | ((uint32_t)payload[7] << 16)
+				 | ((uint32_t)payload[8] << 24);
+		check->missed += (unsigned long)(payload[9] | (payload[10] << 8));
+		check->first = sample - check->before;
+		check->next = 0;
+		check->have_header = (0 != check->count);
+		if(check->reason > BLACKBOX_LIGHTS || BLACKBOX_NONE == check->reason)
+		{
+			blackbox_violation(check, "no reason", 0);
+			return;
+		}
+		check->windows[check->reason]++;
+
+		/*A trigger has BLACKBOX_POST after it - a manual dump stops on the spot - and the rest is what
+		 went before, as much as has been recorded since the last dump*/
+		if(check->count > BLACKBOX_ENTRIES || check->before >= check->count
+		   || check->count - 1 - check->before != ((BLACKBOX_MANUAL == check->reason) ? 0 : BLACKBOX_POST))
+		{
+			blackbox_violation(check, "window the wrong shape", 0);
+		}
+		if(sample > check->recorded || check->recorded - check->first >= SHADOW_ENTRIES || check->first < 1)
+		{
+			blackbox_violation(check, "trigger sample out of range", 0);
+			check->have_header = 0;
+		}
+		if(BLACKBOX_LIGHTS == check->reason && 0 == (check->lights & BLACKBOX_TRIGGER_LIGHTS))
+		{
+			blackbox_violation(check, "triggered on lights that don't trigger it", 0);
+		}
+		return;
+	}
+
+	if(!check->have_header || payload[0] != check->next || 0 != (length - 1) % BLACKBOX_ENTRY_SIZE)
+	{
+		blackbox_violation(check, "entries out of order", payload[0]);
+		check->have_header = 0;
+		return;
+	}
+
+	for(i = 1; i < length; i += BLACKBOX_ENTRY_SIZE)
+	{
+		index = check->next++;
+		memcpy(got.accel, &payload[i], ADC_SCAN_AXES);
+		memcpy(got.motion, &payload[i + ADC_SCAN_AXES], ADC_SCAN_AXES);
+		got.step = payload[i + 2 * ADC_SCAN_AXES];
+		got.flags = payload[i + 2 * ADC_SCAN_AXES + 1];
+		want = &check->shadow[(check->first + index - 1) & SHADOW_MASK];
+
+		if(0 != memcmp(got.accel, want->accel, sizeof(got.accel))
+		   || 0 != memcmp(got.motion, want->motion, sizeof(got.motion)) || got.step != want->step
+		   || (got.flags & ~BLACKBOX_TRIGGER_FLAG) != want->flags)
+		{
+			blackbox_violation(check, "doesn't match what went in", index);
+		}
+		if((index == check->before) != (0 != (got.flags & BLACKBOX_TRIGGER_FLAG)))
+		{
+			blackbox_violation(check, "trigger flag in the wrong place", index);
+		}
+
+		/*A lights trigger is the entry the state machine went into a triggering state on*/
+		state_lights = street_states[(got.flags & BLACKBOX_STATE_MASK) >> BLACKBOX_STATE_SHIFT].lights;
+		if(BLACKBOX_LIGHTS == check->reason && index == check->before && state_lights != check->lights)
+		{
+			blackbox_violation(check, "trigger entry isn't in the lights it triggered on", index);
+		}
+		if(BLACKBOX_LIGHTS == check->reason && index + 1 == check->before && state_lights == check->lights)
+		{
+			blackbox_violation(check, "lights were already on before the trigger", index);
+		}
+		check->entries++;
+	}
+
+	if(check->next == check->count)
+	{
+		check->have_header = 0;
+	}
+	else if(check->next > check->count)
+	{
+		blackbox_violation(check, "too many entries", check->next);
+		check->have_header = 0;
+	}
+}
+
+/*The capture through all three chains - X and Z at rest - the streetlight and the black box, the way
+ task_decimate() does it, with dumps sent a frame per sample the way task_commands() does*/
+static int run_blackbox(const char *path, double hours)
+{
+	dsp_chain_t chains[ADC_SCAN_AXES];
+	streetlight_t light;
+	blackbox_check_t *check;
+	frames_parser_t parser;
+	uint8_t payload[BLACKBOX_FRAME_SIZE], frame[BLACKBOX_FRAME_SIZE + UART_FRAME_OVERHEAD];
+	uint8_t *samples, sequence = 0, length, stepped;
+	size_t count, i;
+	unsigned long long total, fed = 0;
+	double started;
+	int axis, failed;
+
+	samples = load_capture(path, &count);
+	check = calloc(1, sizeof(*check));
+	if(NULL == samples || 0 == count || NULL == check)
+	{
+		free(samples);
+		free(check);
+		return 1;
+	}
+
+	total = (hours > 0.0) ? (unsigned long long)(hours * 3600.0 * TICK_HZ) : count;
+	started = now_seconds();
+	check->name = base_name(path);
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		dsp_chain_init(&chains[axis], DSP_SAMPLE_8BIT(REST_SAMPLE));
+	}
+	streetlight_init(&light);
+	blackbox_init();
+	frames_init(&parser, blackbox_on_frame, check);
+
+	for(i = 0; fed < total; fed++)
+	{
+		/*The three chains decimate together, the same as task_samples() feeding them*/
+		dsp_chain_process(&chains[0], DSP_SAMPLE_8BIT(REST_SAMPLE));
+		dsp_chain_process(&chains[2], DSP_SAMPLE_8BIT(REST_SAMPLE));
+		if(TRUE == dsp_chain_process(&chains[1], DSP_SAMPLE_8BIT(samples[i])))
+		{
+			stepped = 0;
+			for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+			{
+				if(TRUE == dsp_chain_decimate(&chains[axis]))
+				{
+					stepped |= (uint8_t)(0x01 << axis);
+				}
+			}
+			streetlight_step(&light, BOOL(stepped));
+
+			if(0 == (check->recorded + 1) % BLACKBOX_FALL_STEPS)
+			{
+				blackbox_freefall();
+			}
+			blackbox_pack(&check->shadow[check->recorded & SHADOW_MASK], chains, stepped, light.state);
+			blackbox_record(chains, stepped, &light);
+			check->recorded++;
+
+			if(0 == check->recorded % BLACKBOX_DUMP_STEPS)
+			{
+				blackbox_request_dump();
+			}
+			length = blackbox_frame(payload);
+			if(0 != length)
+			{
+				frames_feed(&parser, frame, frames_build(frame, sequence++, CHANNEL_BLACKBOX, payload, length));
+			}
+		}
+		if(++i == count)
+		{
+			i = 0;
+		}
+	}
+
+	failed = (0 != check->violations || 0 != parser.stats.bad_checksums || 0 != parser.stats.missed_frames);
+	printf("%s: black box %llu entries in %.3f s, %lu windows (%lu lights, %lu free fall, %lu manual), "
+		   "%lu entries checked, %lu triggers missed while frozen, %lu violations\n", check->name,
+		   check->recorded, now_seconds() - started,
+		   check->windows[BLACKBOX_LIGHTS] + check->windows[BLACKBOX_FREEFALL] + check->windows[BLACKBOX_MANUAL],
+		   check->windows[BLACKBOX_LIGHTS], check->windows[BLACKBOX_FREEFALL], check->windows[BLACKBOX_MANUAL],
+		   check->entries, check->missed, check->violations);
+	free(samples);
+	free(check);
+	return failed;
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [-x depth] [-s hours] [-r seed] [-h hours] [-b] [-v] [capture...]\n", program);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int depth = 0, verbose = 0, blackbox = 0, option, failures = 0;
+	double synthetic_hours = 0.0, capture_hours = 0.0;
+	uint32_t seed = 1;
+
+	while(-1 != (option = getopt(argc, argv, "x:s:r:h:bv")))
+	{
+		switch(option)
+		{
+			case 'x':
+				depth = atoi(optarg);
+				break;
+			case 's':
+				synthetic_hours = atof(optarg);
+				break;
+			case 'r':
+				seed = (uint32_t)strtoul(optarg, NULL, 0);
+				break;
+			case 'h':
+				capture_hours = atof(optarg);
+				break;
+			case 'b':
+				blackbox = 1;
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(0 == depth && synthetic_hours <= 0.0 && optind == argc)
+	{
+		usage(argv[0]);
+	}
+
+	if(0 != depth)
+	{
+		failures += run_exhaustive(depth);
+	}
+	if(synthetic_hours > 0.0)
+	{
+		failures += run_synthetic(synthetic_hours, seed);
+	}
+	for(; optind < argc; optind++)
+	{
+		failures += run_capture(argv[optind], capture_hours, verbose);
+		if(blackbox)
+		{
+			failures += run_blackbox(argv[optind], capture_hours);
+		}
+	}
+
+	return (0 == failures) ? 0 : 1;
+}
@@ -4,3 +4,41 @@
 
 costume_2012.c
 
+uart.c
+
+filters.c
+
+filter_bench.c
+
+biquad.c
+
+biquad_coeffs.c
+
+dsp_chain.c
+
+step_detect.c
+
+adc_scan.c
+
+power.c
+
+lights.c
+
+gamma_tables.c
+
+scheduler.c
+
+trace.c
+
+stream.c
+
+freefall.c
+
+calibrate.c
+
+bam.c
+
+streetlight.c
+
+blackbox.c
+
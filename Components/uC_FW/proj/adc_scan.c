@@ -0,0 +1,137 @@
+/*
+ * adc_scan.c
+ *
+ * Round-robin ADC scan and its frame queue - see adc_scan.h.
+ */
+
+#include "common.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "progmem.h"
+#include "power.h"
+#include "trace.h"
+#include "adc_scan.h"
+
+/*One step of the scan: 'conversions' conversions of one channel, summed.  0 means one conversion that
+ only exists to let the mux settle, and isn't kept.*/
+typedef struct
+{
+	uint8_t channel;
+	uint8_t conversions;
+} adc_scan_step_t;
+
+#define ADC_SCAN_STEPS 6
+
+static const adc_scan_step_t adc_scan_steps[ADC_SCAN_STEPS] PROGMEM =
+{
+	{ADC_ACCEL_X, 0},						//Settle - this is the conversion Timer1 triggers
+	{ADC_ACCEL_X, ADC_SCAN_OVERSAMPLES},
+	{ADC_ACCEL_Y, 0},						//Settle
+	{ADC_ACCEL_Y, ADC_SCAN_OVERSAMPLES},
+	{ADC_ACCEL_Z, 0},						//Settle
+	{ADC_ACCEL_Z, ADC_SCAN_OVERSAMPLES},
+};
+
+volatile uint16_t adc_overruns = 0;
+
+#define ADC_SCAN_FRAME_MASK (ADC_SCAN_FRAMES - 1)
+
+/*The ISR fills adc_frames[adc_head] and owns adc_head.  Everything from adc_tail up to it belongs to the
+ main loop, which owns adc_tail.  Both are a byte, so each side reads the other's in one instruction.*/
+static adc_frame_t adc_frames[ADC_SCAN_FRAMES];
+static volatile uint8_t adc_head = 0;
+static volatile uint8_t adc_tail = 0;
+
+/*The oldest finished frame, or NULL if there isn't one.  It stays put until adc_scan_release().*/
+const adc_frame_t *adc_scan_frame(void)
+{
+	uint8_t tail = adc_tail;
+	
+	if(adc_head == tail)
+	{
+		return NULL;
+	}
+	
+	return &adc_frames[tail];
+}
+
+/*Hand the oldest frame back to the ISR - only after everything needed from it has been read*/
+void adc_scan_release(void)
+{
+	adc_tail = (adc_tail + 1) & ADC_SCAN_FRAME_MASK;
+}
+
+//ATMega328 Datasheet Section 11.1 Table 11-1 - ADC Conversion Complete vector
+ISR(ADC_vect)
+{
+	static uint8_t step = 0;
+	static uint8_t remaining = 0;	//Conversions still to add up in this step
+	static uint16_t sum = 0;		//4^2 10-bit samples is 14 bits, so this can't overflow
+	uint16_t value = ADC;	//ADCL then ADCH - Section 24.9.3 says in that order, and the compiler does it that way
+	uint8_t conversions;
+	uint8_t next;
+	
+	power_woke();
+	TRACE_ISR_ENTER(TRACE_ID_ADC_ISR);
+	
+	//Clear OCF1B by writing a 1 to it (Section 16.11.9 pg 137) so the next compare match is a new rising edge
+	//for the auto-trigger.  Don't use SET() - a read-modify-write would clear the other flags too.
+	TIFR1 = (0x01 << 2);
+	
+	conversions = pgm_read_byte(&adc_scan_steps[step].conversions);
+	if(0 != conversions)
+	{
+		if(0 == remaining)
+		{
+			remaining = conversions;	//First conversion of this step
+		}
+		sum += value;
+		
+		if(0 != --remaining)
+		{
+			//Same channel again - the mux hasn't moved, so no settling needed
+			SET(ADCSRA,6);
+			TRACE_ISR_EXIT(TRACE_ID_ADC_ISR);
+			return;
+		}
+		
+		//Sum of 4^n, shifted right n for the extra n bits, then left-adjusted to match the frame.  Every step
+		//that's kept is an axis now, so it's always 4^n.
+		sum = (sum >> ADC_OVERSAMPLE_BITS) << (6 - ADC_OVERSAMPLE_BITS);
+		adc_frames[adc_head].channel[pgm_read_byte(&adc_scan_steps[step].channel)] = sum;
+		sum = 0;
+	}
+	
+	step++;
+	if(ADC_SCAN_STEPS == step)
+	{
+		//Scan complete.  Point the mux back at the first channel for Timer1's next trigger.
+		step = 0;
+		ADMUX = ADC_SCAN_ADMUX | pgm_read_byte(&adc_scan_steps[0].channel);
+		
+		//Publish only after the frame is in place.  The slot at the head is never the main loop's - one
+		//is always left empty - so if the queue's full this scan is dropped and the next one goes in
+		//the same slot.
+		next = (adc_head + 1) & ADC_SCAN_FRAME_MASK;
+		if(next != adc_tail)
+		{
+			adc_head = next;
+		}
+		else
+		{
+			adc_overruns++;
+		}
+	}
+	else
+	{
+		//Move the mux now the conversion is finished, then start the next one by hand.  Section 24.3 pg 242:
+		//with auto-triggering on, writing ADSC still starts a single conversion.  SET() is a
+		//read-modify-write, but ADIF was cleared on the way into this ISR so it doesn't matter.
+		ADMUX = ADC_SCAN_ADMUX | pgm_read_byte(&adc_scan_steps[step].channel);
+		SET(ADCSRA,6);
+	}
+	
+	TRACE_ISR_EXIT(TRACE_ID_ADC_ISR);
+}
@@ -0,0 +1,109 @@
+/*
+ * adc_scan.h
+ *
+ * Background round-robin scan of the accelerometer's three axes: X, Y and Z.
+ *
+ * Timer1 starts the first conversion of every tick (OCR1B, see main()).  From then on the ADC ISR
+ * does everything - stores the result, moves the mux to the next channel and starts the next
+ * conversion by hand - until all three axes are in.  The finished frame goes into a small queue of
+ * ADC_SCAN_FRAMES frames, the same single-producer/single-consumer arrangement as ring_buffer.h but a
+ * whole frame to a slot: the ISR only ever moves the head and only ever writes the slot at the head,
+ * the main loop only ever moves the tail.  So the main loop always sees three samples from the same
+ * tick, the ISR never writes to a frame the main loop is reading, and no interrupts are turned off.
+ *
+ * The queue is what lets the main loop run late.  A frame that overruns by a tick or two (a UART dump,
+ * a decimation landing on a slow tick) leaves scans waiting, and task_samples() drains all of them in
+ * one go next time round - nothing is lost, it's just handled late.  Only if the main loop is more than
+ * ADC_SCAN_FRAMES - 1 ticks behind does a scan get dropped, and that's counted in adc_overruns.
+ *
+ * Settling: the sample-and-hold capacitor still holds the last channel's voltage when the mux moves,
+ * and the accelerometer outputs are too high-impedance to fully recharge it in the 1.5 ADC clocks the
+ * sample takes (ATMega328 Datasheet Section 24.6.1 - it's designed for 10k or less).  So each
+ * analog channel is converted twice and the first result is thrown away.  The mux only ever changes
+ * after a conversion has finished, which Section 24.5 says is the simplest safe time.
+ *
+ * The fourth channel, 0G detect, used to be converted at the end of every scan too, and never looked
+ * at.  It's a logic output, so it has its own pin change interrupt now (see freefall.h) and the scan
+ * is a conversion shorter.
+ *
+ * Oversampling: each axis is converted ADC_SCAN_OVERSAMPLES = 4^ADC_OVERSAMPLE_BITS times in a row
+ * (after its settling conversion) and the ISR adds them up.  Summing 4^n samples and shifting right by n
+ * gives n extra bits, as long as there's at least an LSB of noise to dither between codes - Atmel app note
+ * AVR121 "Enhancing ADC resolution by oversampling".  The accelerometer has plenty: that noisy LSB is
+ * why the filters used to read only ADCH.  The chain still gets one sample per axis per tick, it's just
+ * a better one.  The extra bits are averaged noise, not extra linearity - the ADC clock is 1MHz, well
+ * past the 200kHz Section 24.4 wants for the full 10 bits, and oversampling can't fix that part.
+ *
+ * Timing, with the ADC clock at 1MHz: the triggered conversion is 13.5 ADC clocks and the rest are
+ * 13 (Table 24-1), plus ~60 CPU cycles of ISR between each one, so about 22us per conversion.  A
+ * scan is 3 * (1 + 4^n) conversions:
+ *
+ *	ADC_OVERSAMPLE_BITS	Bits	Conversions		Scan time	ISR cycles per tick
+ *	0					10		 6				~130us		~390
+ *	1					11		15				~330us		~950
+ *	2					12		51				~1120us		~3250
+ *
+ * An 800Hz tick is 1250us, so 2 only just fits and costs a third of the CPU in the ISR alone - 1 is the
+ * default.  3 would need 195 conversions and doesn't fit at all.
+ */
+
+#ifndef ADC_SCAN_H_
+#define ADC_SCAN_H_
+
+#include <stddef.h>
+
+#include "common.h"
+
+#if (ADC_OVERSAMPLE_BITS < 0) || (ADC_OVERSAMPLE_BITS > 2)
+#error "ADC_OVERSAMPLE_BITS has to be 0, 1 or 2 - any more doesn't fit in a tick (see adc_scan.h)"
+#endif
+
+/*An enumeration for the various ADC channels available*/
+enum ADC_Channels
+{
+	ADC_ACCEL_X = 0,	/*X-Axis*/
+	ADC_ACCEL_Y,		/*Y-Axis*/
+	ADC_ACCEL_Z,		/*Z-Axis*/
+	ADC_ACCEL_0GD		/*Zero G detect - OMG I'm falling!  Not scanned - see freefall.h*/
+};
+
+#define ADC_SCAN_CHANNELS 3
+
+/*Accelerometer axes - the first three channels*/
+#define ADC_SCAN_AXES 3
+
+/*Conversions summed per axis per tick, and the bits in each sample that comes out*/
+#define ADC_SCAN_OVERSAMPLES (0x01 << (2 * ADC_OVERSAMPLE_BITS))
+#define ADC_SCAN_BITS (10 + ADC_OVERSAMPLE_BITS)
+
+/*ADMUX with everything but the channel: AVCC reference, right-adjusted result (see main()) - the ISR
+ adds up the whole 10 bits*/
+#define ADC_SCAN_ADMUX (0x01 << 6)
+
+/*One tick's worth of samples, indexed by enum ADC_Channels.  Each one is ADC_SCAN_BITS bits, left-adjusted
+ in 16 - the same layout as the ADC's own left-adjusted result - so the top byte is the old 8-bit sample
+ and the 10-bit sample is a shift away whatever the oversampling is.*/
+typedef struct
+{
+	uint16_t channel[ADC_SCAN_CHANNELS];
+} adc_frame_t;
+
+#define ADC_SCAN_8BIT(sample) ((uint8_t)((sample) >> 8))
+#define ADC_SCAN_10BIT(sample) ((sample) >> 6)
+
+/*All ADC_SCAN_BITS bits - 8-bit ADC counts with ADC_OVERSAMPLE_BITS + 2 fraction bits, which is what
+ dsp_chain takes*/
+#define ADC_SCAN_FULL(sample) ((sample) >> (16 - ADC_SCAN_BITS))
+
+/*Frames in the queue - a power of two.  One slot is the one being filled, so it holds
+ ADC_SCAN_FRAMES - 1 finished scans: 3 ticks of slack, for 12 bytes more than a double buffer.*/
+#define ADC_SCAN_FRAMES 4
+
+/*Scans that found the queue full - the main loop was more than ADC_SCAN_FRAMES - 1 ticks behind.  The
+ scan is dropped.*/
+extern volatile uint16_t adc_overruns;
+
+const adc_frame_t *adc_scan_frame(void);
+void adc_scan_release(void);
+
+#endif /* ADC_SCAN_H_ */
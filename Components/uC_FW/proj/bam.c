@@ -0,0 +1,225 @@
+/*
+ * bam.c
+ *
+ * Bit angle modulation driver - see bam.h.
+ */
+
+#include "common.h"
+
+#ifdef LIGHTS_BAM
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "progmem.h"
+#include "power.h"
+#include "trace.h"
+#include "bam.h"
+
+/*The pins.  The lights are wired to the ULN2803 in pairs (uC_Board streetlight_LED_Driver) - red on inputs
+ 1 and 2, yellow on 3 and 4, green on 5 and 6 - and inputs 7 and 8 are tied to ground.  So on the rev 1.0
+ board only the first three do anything.  The spare pins are all no-connects on the micro's sheet; lift
+ 7B and 8B off ground and wire two of them there (or to another ULN2803) for more channels.*/
+static const bam_channel_t bam_channels[BAM_CHANNELS] PROGMEM =
+{
+	//Port			Pin
+	{BAM_PORT_B,	1},		//LIGHT_GREEN - PB1
+	{BAM_PORT_D,	6},		//LIGHT_YELLOW - PD6
+	{BAM_PORT_D,	5},		//LIGHT_RED - PD5
+	{BAM_PORT_B,	0},		//Spare - PB0
+	{BAM_PORT_B,	2},		//Spare - PB2
+	{BAM_PORT_D,	2},		//Spare - PD2
+	{BAM_PORT_D,	3},		//Spare - PD3
+	{BAM_PORT_D,	4}		//Spare - PD4
+};
+
+/*What the ISR writes to each port in each plane, and the copy bam_set() works on*/
+static uint8_t bam_planes[BAM_PLANES][BAM_PORTS];
+static uint8_t bam_next[BAM_PLANES][BAM_PORTS];
+static volatile boolean bam_changed = FALSE;
+
+/*Every bit in each port that isn't a BAM channel, for the ISR to leave alone*/
+static uint8_t bam_keep[BAM_PORTS];
+
+static uint8_t bam_levels[BAM_CHANNELS];
+
+/*The plane that's on the pins now and how many units it lasts*/
+static uint8_t bam_plane = BAM_PLANES - 1;
+static uint8_t bam_length = 0x01 << (BAM_PLANES - 1);
+
+/*The pins, all off, and Timer2.  PRTIM2 has to be 0 - see power_init().*/
+void bam_init(void)
+{
+	uint8_t i, port, mask;
+	
+	for(i = 0; i < BAM_PORTS; i++)
+	{
+		bam_keep[i] = 0xFF;
+	}
+	for(i = 0; i < BAM_PLANES; i++)
+	{
+		bam_planes[i][BAM_PORT_B] = 0x00;
+		bam_planes[i][BAM_PORT_D] = 0x00;
+		bam_next[i][BAM_PORT_B] = 0x00;
+		bam_next[i][BAM_PORT_D] = 0x00;
+	}
+	
+	//ATMega328 Datasheet Table 14-1 Pg 78 - every channel an output, low
+	for(i = 0; i < BAM_CHANNELS; i++)
+	{
+		bam_levels[i] = 0;
+		port = pgm_read_byte(&bam_channels[i].port);
+		mask = 0x01 << pgm_read_byte(&bam_channels[i].pin);
+		bam_keep[port] &= ~mask;
+		if(BAM_PORT_B == port)
+		{
+			PORTB &= ~mask;
+			DDRB |= mask;
+		}
+		else
+		{
+			PORTD &= ~mask;
+			DDRD |= mask;
+		}
+	}
+	
+	//ATMega328 Datasheet Section 18.11.1 - TCCR2A
+	//Both compare outputs disconnected, WGM21:20 = 00b - Normal mode.  The counter just runs round 0 to 255
+	//and the ISR moves OCR2A along after it.  CTC would reset the counter at every compare, and then a late
+	//ISR would push every plane after it late too.
+	TCCR2A = 0x00;
+	
+	TCNT2 = 0x00;
+	OCR2A = bam_length - 1;
+	
+	//Section 18.11.7 - TIFR2 - clear OCF2A (write a 1) so the first interrupt is the real one
+	TIFR2 = (0x01 << 1);
+	
+	//Section 18.11.6 - TIMSK2 - Bit 1 - OCIE2A
+	TIMSK2 = (0x01 << 1);
+	
+	//Section 18.11.2 - TCCR2B - WGM22 = 0, and the clock select starts it.  Timer2 is clocked from clkIO
+	//like the others because ASSR is left at 0 - it's only asynchronous with a 32kHz crystal on TOSC1/2.
+	TCCR2B = BAM_CLOCK_SELECT;
+}
+
+/*Set a channel's level, 0 (off) to 255 (on).  It goes out at the start of the next period.  Safe to call
+ from an ISR - lights_tick() does.  About 10 cycles a plane.*/
+void bam_set(uint8_t channel, uint8_t level)
+{
+	uint8_t plane, port, mask;
+	
+	if(channel >= BAM_CHANNELS)
+	{
+		return;
+	}
+	
+	port = pgm_read_byte(&bam_channels[channel].port);
+	mask = 0x01 << pgm_read_byte(&bam_channels[channel].pin);
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		bam_levels[channel] = level;
+		
+		//Shift the level down a bit per plane rather than build a mask for each one - a variable shift is a
+		//loop on the AVR
+		for(plane = 0; plane < BAM_PLANES; plane++, level >>= 1)
+		{
+			if(0 != (level & 0x01))
+			{
+				bam_next[plane][port] |= mask;
+			}
+			else
+			{
+				bam_next[plane][port] &= ~mask;
+			}
+		}
+		bam_changed = TRUE;
+	}
+}
+
+uint8_t bam_level(uint8_t channel)
+{
+	return (channel < BAM_CHANNELS) ? bam_levels[channel] : 0;
+}
+
+/*Copy the new planes over.  With interrupts off.*/
+static void bam_copy(void)
+{
+	uint8_t i;
+	
+	for(i = 0; i < BAM_PLANES; i++)
+	{
+		bam_planes[i][BAM_PORT_B] = bam_next[i][BAM_PORT_B];
+		bam_planes[i][BAM_PORT_D] = bam_next[i][BAM_PORT_D];
+	}
+	bam_changed = FALSE;
+}
+
+/*Put whatever bam_set() has done on the pins now, in the middle of the period, instead of waiting for
+ the end of it.  The period it happens in shows a bit of both - fine for a flash, not for a fade.*/
+void bam_apply(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		bam_copy();
+		PORTB = (PORTB & bam_keep[BAM_PORT_B]) | bam_planes[bam_plane][BAM_PORT_B];
+		PORTD = (PORTD & bam_keep[BAM_PORT_D]) | bam_planes[bam_plane][BAM_PORT_D];
+	}
+}
+
+//ATMega328 Datasheet Section 11.1 Table 11-1 - Timer/Counter2 Compare Match A
+//The plane that's on the pins has ended - on to the next one
+ISR(TIMER2_COMPA_vect)
+{
+	uint8_t start, elapsed, end;
+	uint8_t plane = bam_plane;
+	uint8_t length = bam_length;
+	
+	power_woke();
+	TRACE_ISR_ENTER(TRACE_ID_BAM_ISR);
+	
+	//OCR2A is when that plane was meant to end, and this plane starts from there however late this is.
+	//Counting in 8 bits the wrap at 255 takes care of itself.
+	start = OCR2A;
+	elapsed = TCNT2 - start;
+	end = 0;
+	
+	//If the plane after it should already be over, skip it - but never the last one.  That's 128 units, and
+	//being that late would take 16000 cycles with interrupts off.
+	do
+	{
+		if((BAM_PLANES - 1) == plane)
+		{
+			plane = 0;
+			length = 0x01;
+		}
+		else
+		{
+			plane++;
+			length <<= 1;
+		}
+		end += length;
+	}
+	while((elapsed >= end) && ((BAM_PLANES - 1) != plane));
+	
+	//These read-modify-writes are safe because nothing changes a BAM pin anywhere else, and everything else
+	//on these ports is changed with SET/CLEAR (one SBI or CBI instruction) or a write to PIN
+	PORTB = (PORTB & bam_keep[BAM_PORT_B]) | bam_planes[plane][BAM_PORT_B];
+	PORTD = (PORTD & bam_keep[BAM_PORT_D]) | bam_planes[plane][BAM_PORT_D];
+	OCR2A = start + end;
+	
+	bam_plane = plane;
+	bam_length = length;
+	
+	//The last plane is 128 units long, so it can afford the copy.  Everything new starts with plane 0.
+	if(((BAM_PLANES - 1) == plane) && (FALSE != bam_changed))
+	{
+		bam_copy();
+	}
+	
+	TRACE_ISR_EXIT(TRACE_ID_BAM_ISR);
+}
+
+#endif
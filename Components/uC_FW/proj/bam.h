@@ -0,0 +1,76 @@
+/*
+ * bam.h
+ *
+ * Bit angle modulation: any number of dimmable outputs on plain port pins, all from Timer2.
+ *
+ * The lights get their PWM from the compare outputs, and there are only so many of those - OC0A, OC0B
+ * and OC1A are the three lights, and the rest are either on pins that are spoken for or on Timer2, which
+ * only has two.  The ULN2803 has eight inputs.  Software PWM would do any pin, but it needs an interrupt
+ * for every step of the count - 255 of them a period - and each one has to compare every channel.
+ *
+ * BAM only needs one interrupt per bit of the level.  A level is 8 bits, so a period is 8 bit planes,
+ * and plane n lasts 2^n time units: 1, 2, 4 ... 128, 255 units in all.  During plane n a channel is on if
+ * bit n of its level is set, so it's on for exactly 'level' units of the 255.  The eye doesn't care which
+ * order the units come in.
+ *
+ * The planes are worked out when a level changes, not in the ISR: bam_set() keeps a byte per plane per
+ * port with a 1 in it for every channel on that port that's lit in that plane.  All the ISR does is write
+ * the next plane's byte into each port and set the timer for when it ends - the same handful of cycles
+ * whether one channel is lit or all of them.
+ *
+ *	Timer2		Normal mode, clkIO/128: a time unit is 16us
+ *	Period		255 units - 4.08ms, 245Hz
+ *	Interrupts	8 per period, about 2000 a second.  At ~60 cycles each that's 1.5% of the CPU.
+ *
+ * The shortest plane is one unit, 128 cycles - longer than the ISR itself, which is why the prescaler is
+ * 128 and not something faster.  The compare is scheduled from where the last plane was supposed to end,
+ * not from when the ISR got round to it, so a late ISR (behind the tick ISR, say) only shortens the plane
+ * it was late starting.  If it's so late that the next plane should already be over, that plane is
+ * skipped rather than setting a compare that's already gone by, which would cost a whole timer wrap.
+ *
+ * Changes wait for the end of the period: bam_set() works on a second copy of the planes, and the ISR
+ * copies it over as the last plane starts - the longest one, so there's plenty of time.  Changing a level
+ * halfway through a period would show half the old level and half the new one, and a light fading past
+ * 127 would blink.  bam_apply() copies it straight away for the times when now matters more than that.
+ *
+ * The channels are in bam_channels[] in bam.c, a pin each on port B or D.  The first three are the light
+ * pins in enum Light_Channels order, which is how lights.c runs the lights on this when LIGHTS_BAM is on
+ * (see common.h).  The other five are the spare pins - see bam.c for how they'd get to the ULN2803.
+ */
+
+#ifndef BAM_H_
+#define BAM_H_
+
+#include "common.h"
+
+enum Bam_Ports
+{
+	BAM_PORT_B = 0,
+	BAM_PORT_D,
+	BAM_PORTS
+};
+
+/*Bits in a level, and a plane for each*/
+#define BAM_PLANES 8
+
+#define BAM_CHANNELS 8
+
+/*Timer2 prescaler - clock select 101b is clkIO/128 (ATMega328 Datasheet Section 18.11.2 Table 18-9)*/
+#define BAM_PRESCALER 128
+#define BAM_CLOCK_SELECT 0x05
+
+/*A period, in CPU cycles*/
+#define BAM_PERIOD_CYCLES (255UL * BAM_PRESCALER)
+
+typedef struct
+{
+	uint8_t port;	//enum Bam_Ports
+	uint8_t pin;	//Bit number in the port
+} bam_channel_t;
+
+void bam_init(void);
+void bam_set(uint8_t channel, uint8_t level);
+uint8_t bam_level(uint8_t channel);
+void bam_apply(void);
+
+#endif /* BAM_H_ */
@@ -0,0 +1,74 @@
+/*
+ * biquad.c
+ *
+ * Cascaded fixed-point biquad filters - see biquad.h for the number formats.
+ */
+
+#include <stdint.h>
+
+#include "fixed_point.h"
+#include "progmem.h"
+#include "biquad.h"
+
+/*Run one sample through a cascade of sections.  coeffs points to a flash table of 'sections' entries
+ and state to the same number of states in RAM.  Returns the output of the last section.*/
+int32_t biquad_run(const biquad_coeffs_t *coeffs, biquad_state_t *state, uint8_t sections, int32_t x)
+{
+	fix_acc_t feed_forward;
+	fix_acc_t feedback;
+	int32_t y;
+	
+	while(0 != sections--)
+	{
+		feed_forward.high = 0;
+		feed_forward.low = 0;
+		fix_mac_s16(&feed_forward,x,(int16_t)pgm_read_word(&coeffs->b0));
+		fix_mac_s16(&feed_forward,state->x1,(int16_t)pgm_read_word(&coeffs->b1));
+		fix_mac_s16(&feed_forward,state->x2,(int16_t)pgm_read_word(&coeffs->b2));
+		
+		feedback.high = 0;
+		feedback.low = 0;
+		fix_mac_s16(&feedback,state->y1,(int16_t)pgm_read_word(&coeffs->a1));
+		fix_mac_s16(&feedback,state->y2,(int16_t)pgm_read_word(&coeffs->a2));
+		
+		//The b's have 16 + b_shift fraction bits, the a's have a_shift.  Unsigned so overflow wraps.
+		y = (int32_t)((uint32_t)fix_acc_shift(&feed_forward,16 + (int8_t)pgm_read_byte(&coeffs->b_shift))
+					- (uint32_t)fix_acc_shift(&feedback,pgm_read_byte(&coeffs->a_shift)));
+		
+		state->x2 = state->x1;
+		state->x1 = x;
+		state->y2 = state->y1;
+		state->y1 = y;
+		
+		x = y;	//This section's output is the next one's input
+		coeffs++;
+		state++;
+	}
+	
+	return x;
+}
+
+/*Put every section in the state it would settle to after seeing x forever, so the filter starts
+ out at rest instead of ringing while it climbs up from zero.*/
+void biquad_preload(const biquad_coeffs_t *coeffs, biquad_state_t *state, uint8_t sections, int32_t x)
+{
+	fix_acc_t gain;
+	int32_t y;
+	
+	while(0 != sections--)
+	{
+		gain.high = 0;
+		gain.low = 0;
+		fix_mac_s16(&gain,x,(int16_t)pgm_read_word(&coeffs->dc_gain));
+		y = fix_acc_shift(&gain,BIQUAD_DC_GAIN_FRAC_BITS);
+		
+		state->x1 = x;
+		state->x2 = x;
+		state->y1 = y;
+		state->y2 = y;
+		
+		x = y;
+		coeffs++;
+		state++;
+	}
+}
@@ -0,0 +1,70 @@
+/*
+ * biquad.h
+ *
+ * Cascaded fixed-point biquad filters.
+ *
+ * Each second-order section is Direct Form I:
+ *
+ *	y[n] = b0*x[n] + b1*x[n-1] + b2*x[n-2] - a1*y[n-1] - a2*y[n-2]
+ *
+ * Samples and states are Q16.16, the same as the rest of the signal chain.  Coefficients are 16 bits
+ * so every product is one fix_mac_s16 (see fixed_point.h):
+ *
+ *	a1, a2	Scaled by 2^a_shift.  Butterworth poles need |a1| up to 2, so a_shift is 14 (Q2.14) at most.
+ *			Low cutoffs put the poles close to 1, and a few more fraction bits in a1 and a2 can
+ *			be worth more than the integer bit they cost - tools/filter_explore weighs that up.
+ *	b0..b2	Scaled by 2^(16 + b_shift).  A 10Hz low-pass at 800Hz has b's around 0.0015, which would
+ *			only be 25 counts in Q2.14.  b_shift pushes them up to use all 16 bits, and the feed-forward
+ *			sum is shifted back down by the same amount afterwards.  That's the per-section headroom
+ *			knob - the coefficient generator picks the biggest shift that doesn't overflow.
+ *
+ * The coefficients live in flash, one table per filter.  The state lives in RAM, one biquad_state_t
+ * per section per channel, so any number of channels can run through the same coefficients.  Nothing
+ * is hidden in statics.
+ *
+ * Tables are generated from filter_spec.txt by tools/biquad_gen - don't edit biquad_coeffs.c by hand.
+ *
+ * The products are summed exactly (fix_mac_s16) and rounded down once per sum, so a high-pass whose
+ * b's cancel on DC really does put out zero.  What's left is the rounding of y itself, which a pole
+ * very close to 1 amplifies by 1/(1 + a1 + a2) - keep that in mind for cutoffs far below 1Hz.
+ *
+ * Cost: about 500 cycles per section worst case (b_shift = 15), most of it the five 16x32 multiplies.
+ * Shifting the feed-forward sum is ~6 cycles per bit of b_shift past 0, so sections with small shifts
+ * are cheaper.  Build with FILTER_BENCHMARK to measure it on the target.  At 800Hz one tick is 10000
+ * cycles, so each section costs about 5% of the CPU per channel.
+ */
+
+#ifndef BIQUAD_H_
+#define BIQUAD_H_
+
+#include <stdint.h>
+
+#include "progmem.h"
+
+/*dc_gain is always Q2.14, whatever the a's are*/
+#define BIQUAD_DC_GAIN_FRAC_BITS 14
+
+typedef struct
+{
+	int16_t b0;			//Feed-forward, scaled by 2^(16 + b_shift)
+	int16_t b1;
+	int16_t b2;
+	int16_t a1;			//Feedback, scaled by 2^a_shift
+	int16_t a2;
+	int16_t dc_gain;	//Steady-state output/input, Q2.14 - used to preload the state
+	int8_t b_shift;
+	int8_t a_shift;		//Fraction bits in a1 and a2 - 14 for Q2.14
+} biquad_coeffs_t;
+
+typedef struct
+{
+	int32_t x1;			//x[n-1]
+	int32_t x2;			//x[n-2]
+	int32_t y1;			//y[n-1]
+	int32_t y2;			//y[n-2]
+} biquad_state_t;
+
+int32_t biquad_run(const biquad_coeffs_t *coeffs, biquad_state_t *state, uint8_t sections, int32_t x);
+void biquad_preload(const biquad_coeffs_t *coeffs, biquad_state_t *state, uint8_t sections, int32_t x);
+
+#endif /* BIQUAD_H_ */
@@ -0,0 +1,19 @@
+/*
+ * biquad_coeffs.c
+ *
+ * Generated by tools/biquad_gen from filter_spec.txt - do not edit.
+ *
+ * Per section: b0, b1, b2 (scaled by 2^(16 + b_shift)), a1, a2 (scaled by 2^a_shift), dc_gain (Q2.14), b_shift, a_shift
+ */
+
+#include "biquad_coeffs.h"
+
+const biquad_coeffs_t biquad_accel_lp[BIQUAD_ACCEL_LP_SECTIONS] PROGMEM =
+{
+	{ 12288,  24576,  12288, -30950,  14662,  16384,   7, 14},	//Pole radius 0.945990
+};
+
+const biquad_coeffs_t biquad_motion_hp[BIQUAD_MOTION_HP_SECTIONS] PROGMEM =
+{
+	{ 30377, -30377,      0, -13993,      0,      0,  -1, 14},	//Pole radius 0.854065
+};
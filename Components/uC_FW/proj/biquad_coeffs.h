@@ -0,0 +1,20 @@
+/*
+ * biquad_coeffs.h
+ *
+ * Generated by tools/biquad_gen from filter_spec.txt - do not edit.
+ */
+
+#ifndef BIQUAD_COEFFS_H_
+#define BIQUAD_COEFFS_H_
+
+#include "biquad.h"
+
+/*accel_lp: order 2 Butterworth low-pass, 10 Hz at 800 Hz*/
+#define BIQUAD_ACCEL_LP_SECTIONS 1
+extern const biquad_coeffs_t biquad_accel_lp[BIQUAD_ACCEL_LP_SECTIONS] PROGMEM;
+
+/*motion_hp: order 1 Butterworth high-pass, 0.5 Hz at 20 Hz*/
+#define BIQUAD_MOTION_HP_SECTIONS 1
+extern const biquad_coeffs_t biquad_motion_hp[BIQUAD_MOTION_HP_SECTIONS] PROGMEM;
+
+#endif /* BIQUAD_COEFFS_H_ */
@@ -0,0 +1,235 @@
+/*
+ * blackbox.c
+ *
+ * Pre/post-trigger recorder for the signal chain - see blackbox.h.
+ */
+
+#include "common.h"
+#include "blackbox.h"
+
+enum Blackbox_States
+{
+	BLACKBOX_RECORDING,		//Going round and round, waiting for a trigger
+	BLACKBOX_FILLING,		//Triggered - recording the entries after it
+	BLACKBOX_FROZEN			//Waiting to be sent
+};
+
+volatile boolean blackbox_fall = FALSE;
+
+static blackbox_entry_t blackbox_ring[BLACKBOX_ENTRIES];
+static uint8_t blackbox_head = 0;		//Where the next entry goes
+static uint8_t blackbox_count = 0;		//Entries recorded since it was last started, up to BLACKBOX_ENTRIES
+static uint8_t blackbox_state = BLACKBOX_RECORDING;
+static uint8_t blackbox_post_left = 0;
+static uint8_t blackbox_lights = 0;		//The lights last sample, to see them change
+static uint32_t blackbox_samples = 0;	//Decimated samples since reset
+
+/*About the trigger, for the header*/
+static uint8_t blackbox_reason = BLACKBOX_NONE;
+static uint8_t blackbox_trigger_lights = 0;
+static uint8_t blackbox_after = 0;		//Entries recorded after the trigger entry
+static uint32_t blackbox_trigger_sample = 0;
+static uint16_t blackbox_missed = 0;
+
+/*Dump progress.  blackbox_dump_next is the next entry to send, or BLACKBOX_HEADER_INDEX for the header.*/
+static boolean blackbox_dump_wanted = FALSE;
+static uint8_t blackbox_dump_next = BLACKBOX_HEADER_INDEX;
+
+void blackbox_init(void)
+{
+	blackbox_head = 0;
+	blackbox_count = 0;
+	blackbox_state = BLACKBOX_RECORDING;
+	blackbox_reason = BLACKBOX_NONE;
+	blackbox_missed = 0;
+	blackbox_samples = 0;
+	blackbox_dump_wanted = FALSE;
+	blackbox_fall = FALSE;
+}
+
+/*Squeeze one sample of the three chains into an entry*/
+void blackbox_pack(blackbox_entry_t *entry, const dsp_chain_t *chains, uint8_t stepped, uint8_t state)
+{
+	uint32_t step = 0;
+	int32_t value;
+	uint8_t axis;
+	
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		value = chains[axis].accel >> 16;
+		entry->accel[axis] = (value < 0) ? 0 : ((value > 0xFF) ? 0xFF : (uint8_t)value);
+	
+		value = chains[axis].motion >> BLACKBOX_MOTION_SHIFT;
+		entry->motion[axis] = (value < -127) ? -127 : ((value > 127) ? 127 : (int8_t)value);
+	
+		if(chains[axis].steps.output > step)
+		{
+			step = chains[axis].steps.output;
+		}
+	}
+	
+	step >>= 8;
+	entry->step = (step > 0xFF) ? 0xFF : (uint8_t)step;
+	entry->flags = (stepped & BLACKBOX_STEP_MASK) | (uint8_t)(state << BLACKBOX_STATE_SHIFT);
+}
+
+/*Note down why and when it stopped.  The entry it stopped on is the newest one.*/
+static void blackbox_trigger(uint8_t reason, uint8_t after)
+{
+	blackbox_ring[(blackbox_head - 1) & BLACKBOX_MASK].flags |= BLACKBOX_TRIGGER_FLAG;
+	blackbox_reason = reason;
+	blackbox_trigger_lights = blackbox_lights;
+	blackbox_trigger_sample = blackbox_samples;
+	blackbox_after = after;
+}
+
+/*Call for every decimated sample, after the streetlight has been stepped with it.  stepped has a bit
+ for each axis that counted a step.*/
+void blackbox_record(const dsp_chain_t *chains, uint8_t stepped, const streetlight_t *light)
+{
+	uint8_t lights = streetlight_lights(light);
+	uint8_t reason = BLACKBOX_NONE;
+	
+	blackbox_samples++;
+	
+	//A fall that came in twice between samples is still one fall
+	if(FALSE != blackbox_fall)
+	{
+		blackbox_fall = FALSE;
+		reason = BLACKBOX_FREEFALL;
+	}
+	else if((lights != blackbox_lights) && (0 != (lights & BLACKBOX_TRIGGER_LIGHTS)))
+	{
+		reason = BLACKBOX_LIGHTS;
+	}
+	blackbox_lights = lights;
+	
+	if(BLACKBOX_RECORDING != blackbox_state)
+	{
+		if((BLACKBOX_NONE != reason) && (0xFFFF != blackbox_missed))
+		{
+			blackbox_missed++;
+		}
+		if(BLACKBOX_FROZEN == blackbox_state)
+		{
+			return;
+		}
+	}
+	
+	blackbox_pack(&blackbox_ring[blackbox_head],chains,stepped,light->state);
+	blackbox_head = (blackbox_head + 1) & BLACKBOX_MASK;
+	if(blackbox_count < BLACKBOX_ENTRIES)
+	{
+		blackbox_count++;
+	}
+	
+	if(BLACKBOX_RECORDING == blackbox_state)
+	{
+		if(BLACKBOX_NONE != reason)
+		{
+			blackbox_trigger(reason,BLACKBOX_POST);
+			blackbox_post_left = BLACKBOX_POST;
+			blackbox_state = BLACKBOX_FILLING;
+		}
+	}
+	else if(0 == --blackbox_post_left)
+	{
+		blackbox_state = BLACKBOX_FROZEN;
+	}
+}
+
+/*Send the window.  If nothing has frozen it yet, freeze it now - that's what somebody who just saw
+ something wrong wants.  If it's still filling, it goes once it's full.*/
+void blackbox_request_dump(void)
+{
+	if(BLACKBOX_RECORDING == blackbox_state)
+	{
+		if(0 != blackbox_count)
+		{
+			blackbox_trigger(BLACKBOX_MANUAL,0);
+		}
+		else
+		{
+			blackbox_reason = BLACKBOX_MANUAL;
+			blackbox_after = 0;
+		}
+		blackbox_state = BLACKBOX_FROZEN;
+	}
+	blackbox_dump_wanted = TRUE;
+	blackbox_dump_next = BLACKBOX_HEADER_INDEX;
+}
+
+/*Start over after a dump.  What's in the ring is from before the freeze, so none of it counts.*/
+static void blackbox_restart(void)
+{
+	blackbox_count = 0;
+	blackbox_reason = BLACKBOX_NONE;
+	blackbox_missed = 0;
+	blackbox_dump_wanted = FALSE;
+	blackbox_state = BLACKBOX_RECORDING;
+}
+
+/*The next CHANNEL_BLACKBOX frame of a dump into payload, which needs room for BLACKBOX_FRAME_SIZE.
+ Returns its length, or 0 if there's nothing to send.  Only call it if the frame can go out straight
+ away - it's counted as sent.*/
+uint8_t blackbox_frame(uint8_t *payload)
+{
+	const blackbox_entry_t *entry;
+	uint8_t oldest, entries, i;
+	uint8_t *p = payload;
+	
+	if((FALSE == blackbox_dump_wanted) || (BLACKBOX_FROZEN != blackbox_state))
+	{
+		return 0;
+	}
+	
+	if(BLACKBOX_HEADER_INDEX == blackbox_dump_next)
+	{
+		*p++ = BLACKBOX_HEADER_INDEX;
+		*p++ = blackbox_reason;
+		*p++ = blackbox_trigger_lights;
+		*p++ = blackbox_count;
+		*p++ = (0 == blackbox_count) ? 0 : (uint8_t)(blackbox_count - 1 - blackbox_after);
+		*p++ = (uint8_t)(blackbox_trigger_sample);
+		*p++ = (uint8_t)(blackbox_trigger_sample >> 8);
+		*p++ = (uint8_t)(blackbox_trigger_sample >> 16);
+		*p++ = (uint8_t)(blackbox_trigger_sample >> 24);
+		*p++ = (uint8_t)(blackbox_missed);
+		*p++ = (uint8_t)(blackbox_missed >> 8);
+	
+		blackbox_dump_next = 0;
+		if(0 == blackbox_count)
+		{
+			blackbox_restart();
+		}
+		return BLACKBOX_HEADER_SIZE;
+	}
+	
+	entries = blackbox_count - blackbox_dump_next;
+	if(entries > BLACKBOX_FRAME_ENTRIES)
+	{
+		entries = BLACKBOX_FRAME_ENTRIES;
+	}
+	
+	oldest = (blackbox_head - blackbox_count) & BLACKBOX_MASK;
+	*p++ = blackbox_dump_next;
+	for(i = 0; i < entries; i++)
+	{
+		entry = &blackbox_ring[(oldest + blackbox_dump_next + i) & BLACKBOX_MASK];
+		*p++ = entry->accel[0];
+		*p++ = entry->accel[1];
+		*p++ = entry->accel[2];
+		*p++ = (uint8_t)entry->motion[0];
+		*p++ = (uint8_t)entry->motion[1];
+		*p++ = (uint8_t)entry->motion[2];
+		*p++ = entry->step;
+		*p++ = entry->flags;
+	}
+	
+	blackbox_dump_next += entries;
+	if(blackbox_dump_next == blackbox_count)
+	{
+		blackbox_restart();
+	}
+	return (uint8_t)(p - payload);
+}
@@ -0,0 +1,124 @@
+/*
+ * blackbox.h
+ *
+ * A flight recorder for the motion detection: the last few seconds of the signal chain, kept in SRAM
+ * all the time, and frozen around anything interesting so it can be sent later.
+ *
+ * The only way to see what the accelerometer did around a misdetection used to be to have the sample
+ * stream going (transmit_adc_enabled) and a laptop on the other end at the time.  Now every decimated
+ * sample goes into a ring of BLACKBOX_ENTRIES entries, and when something happens - the lights change in
+ * a way that's in BLACKBOX_TRIGGER_LIGHTS, or a fall - the ring records BLACKBOX_POST more and stops.
+ * That's a window of BLACKBOX_PRE entries before the trigger, the trigger and BLACKBOX_POST after, and it
+ * stays put until somebody plugs in and sends a 'B' (UART_CMD_BLACKBOX_DUMP).  The dump starts it
+ * recording again.  A 'B' while it isn't frozen freezes it on the spot and sends what it has.
+ *
+ * The first trigger wins - anything that happens while the window is filling or frozen is only counted.
+ * The default trigger is the light going yellow, which is the wearer stopping: yellow while they were
+ * still walking is the misdetection that matters.  Red to green is left out, or the first step after
+ * every re-arm would use the window up.
+ *
+ * Memory is fixed at compile time: BLACKBOX_BYTES, 512 bytes for 64 entries of 8.  At 20Hz that's 3.2s,
+ * enough to see the last step before a yellow (which comes STREET_WALK_STEPS - 1.5s - after it).
+ * Recording is, per axis, two 32-bit shifts and saturations, then the ring index and the flags, once a
+ * decimated sample.  It hasn't been timed on the target.  It runs inside task_decimate, so whatever it
+ * costs is in that task's worst and average in the CHANNEL_TASK_STATS report (sched_report()).
+ *
+ * An entry, 8 bytes:
+ *
+ *	Byte	Contents
+ *	-------------------------------------------------------------
+ *	0..2	Acceleration of X, Y and Z, gravity and all - the decimated sample, whole ADC counts
+ *	3..5	Motion of X, Y and Z - the high-pass output, quarter ADC counts, signed, saturated at +/-127
+ *	6		The biggest step filter output of the three, whole ADC counts (times the window gain, see
+ *			step_detect.h), saturated at 255
+ *	7		Bits 2:0 - a step was counted on X, Y, Z this sample
+ *			Bits 6:4 - the streetlight state after this sample (enum Street_States)
+ *			Bit 7 - this is the sample the trigger happened on
+ *
+ * The dump is CHANNEL_BLACKBOX frames.  The first is the header, BLACKBOX_HEADER_SIZE bytes:
+ *
+ *	Byte	Contents
+ *	-------------------------------------------------------------
+ *	0		0xFF - BLACKBOX_HEADER_INDEX
+ *	1		Why it froze (enum Blackbox_Reasons)
+ *	2		The lights just after the trigger (STREET_*_LIGHT bits)
+ *	3		Entries in the window - fewer than BLACKBOX_ENTRIES if it froze before the ring filled
+ *	4		Entries before the trigger entry
+ *	5..8	Number of the trigger sample, counting decimated samples from reset, 32-bit little-endian
+ *	9..10	Triggers that came along while it was filling or frozen, 16-bit little-endian
+ *
+ * and then the entries, oldest first, BLACKBOX_FRAME_ENTRIES to a frame after a byte with the index of
+ * the first one.  The last frame can be short.
+ *
+ * Nothing in here touches a register - the command task does the sending - so the host build has it too
+ * (host/streetsim -b checks the dump against what went in).
+ */
+
+#ifndef BLACKBOX_H_
+#define BLACKBOX_H_
+
+#include "common.h"
+#include "adc_scan.h"
+#include "dsp_chain.h"
+#include "streetlight.h"
+
+/*The ring - a power of two*/
+#define BLACKBOX_ENTRIES 64
+#define BLACKBOX_MASK (BLACKBOX_ENTRIES - 1)
+#define BLACKBOX_ENTRY_SIZE (2 * ADC_SCAN_AXES + 2)
+#define BLACKBOX_BYTES (BLACKBOX_ENTRIES * BLACKBOX_ENTRY_SIZE)
+
+/*Entries after the trigger entry, and so before it - 0.8s and 2.35s*/
+#define BLACKBOX_POST 16
+#define BLACKBOX_PRE (BLACKBOX_ENTRIES - 1 - BLACKBOX_POST)
+
+/*Lights that freeze it when they come on*/
+#define BLACKBOX_TRIGGER_LIGHTS STREET_YELLOW_LIGHT
+
+/*Motion is kept in quarter ADC counts - Q16.16 down 14 bits*/
+#define BLACKBOX_MOTION_SHIFT 14
+
+/*Flags byte*/
+#define BLACKBOX_STEP_MASK 0x07
+#define BLACKBOX_STATE_SHIFT 4
+#define BLACKBOX_STATE_MASK 0x70
+#define BLACKBOX_TRIGGER_FLAG 0x80
+
+/*The dump*/
+#define BLACKBOX_HEADER_INDEX 0xFF
+#define BLACKBOX_HEADER_SIZE 11
+#define BLACKBOX_FRAME_ENTRIES 4
+#define BLACKBOX_FRAME_SIZE (1 + BLACKBOX_FRAME_ENTRIES * BLACKBOX_ENTRY_SIZE)
+
+enum Blackbox_Reasons
+{
+	BLACKBOX_NONE = 0,
+	BLACKBOX_MANUAL,		//A dump was asked for before anything happened
+	BLACKBOX_FREEFALL,		//The 0g-detect pin
+	BLACKBOX_LIGHTS			//The lights changed to one in BLACKBOX_TRIGGER_LIGHTS
+};
+
+typedef struct
+{
+	uint8_t accel[ADC_SCAN_AXES];
+	int8_t motion[ADC_SCAN_AXES];
+	uint8_t step;
+	uint8_t flags;
+} blackbox_entry_t;
+
+/*Set by the free-fall ISR, taken by the next blackbox_record()*/
+extern volatile boolean blackbox_fall;
+
+void blackbox_init(void);
+void blackbox_pack(blackbox_entry_t *entry, const dsp_chain_t *chains, uint8_t stepped, uint8_t state);
+void blackbox_record(const dsp_chain_t *chains, uint8_t stepped, const streetlight_t *light);
+void blackbox_request_dump(void);
+uint8_t blackbox_frame(uint8_t *payload);
+
+/*Safe from an ISR - it only sets a flag*/
+static inline void blackbox_freefall(void)
+{
+	blackbox_fall = TRUE;
+}
+
+#endif /* BLACKBOX_H_ */
@@ -0,0 +1,212 @@
+/*
+ * calibrate.c
+ *
+ * Boot-time bias calibration and its EEPROM copy - see calibrate.h.
+ */
+
+#include "common.h"
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "adc_scan.h"
+#include "dsp_chain.h"
+#include "calibrate.h"
+
+/*What's kept in EEPROM.  format says what the numbers mean - a build with different oversampling has
+ different units, so it doesn't trust the old one.  checksum works like the UART frames': the bytes
+ add up to 0.  Blank EEPROM is all 0xFF, which fails both.*/
+typedef struct
+{
+	uint8_t format;
+	uint16_t bias[ADC_SCAN_AXES];
+	uint8_t checksum;
+} cal_record_t;
+
+#define CAL_FORMAT (0xC0 | ADC_OVERSAMPLE_BITS)
+
+static cal_record_t EEMEM cal_eeprom;
+
+/*The last good calibration, from EEPROM at boot or from cal_save()*/
+static cal_record_t cal_record;
+static boolean cal_record_valid = FALSE;
+
+/*The running mean and spread*/
+static uint32_t cal_sum[ADC_SCAN_AXES];
+static uint16_t cal_min[ADC_SCAN_AXES];
+static uint16_t cal_max[ADC_SCAN_AXES];
+static uint8_t cal_count = 0;
+
+/*Next byte of cal_record for cal_service() to write - sizeof(cal_record) when there's nothing to do*/
+static uint8_t cal_write_next = sizeof(cal_record_t);
+
+static uint8_t cal_checksum(const cal_record_t *record)
+{
+	const uint8_t *p = (const uint8_t *)record;
+	uint8_t sum = 0;
+	uint8_t i;
+	
+	for(i = 0; i < sizeof(cal_record_t) - 1; i++)
+	{
+		sum += *p++;
+	}
+	
+	return (uint8_t)(0 - sum);
+}
+
+/*Read last time's calibration.  Takes a few microseconds - EEPROM reads don't wait on anything unless
+ a write is going, and nothing's written before this.*/
+void cal_init(void)
+{
+	eeprom_read_block(&cal_record,&cal_eeprom,sizeof(cal_record_t));
+	cal_record_valid = ((CAL_FORMAT == cal_record.format) && (cal_checksum(&cal_record) == cal_record.checksum))?TRUE:FALSE;
+	cal_count = 0;
+}
+
+/*Last time's calibration, if there's a good one*/
+boolean cal_cached(uint16_t bias[ADC_SCAN_AXES])
+{
+	uint8_t axis;
+	
+	if(FALSE == cal_record_valid)
+	{
+		return FALSE;
+	}
+	
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		bias[axis] = cal_record.bias[axis];
+	}
+	return TRUE;
+}
+
+/*Add one scan to the running mean.  Returns TRUE on the scan that finishes it - after that it's ignored.*/
+boolean cal_sample(const uint16_t sample[ADC_SCAN_AXES])
+{
+	uint8_t axis;
+	
+	if(CAL_SAMPLES <= cal_count)
+	{
+		return FALSE;
+	}
+	
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		if(0 == cal_count)
+		{
+			cal_sum[axis] = 0;
+			cal_min[axis] = sample[axis];
+			cal_max[axis] = sample[axis];
+		}
+		cal_sum[axis] += sample[axis];
+		if(sample[axis] < cal_min[axis])
+		{
+			cal_min[axis] = sample[axis];
+		}
+		if(sample[axis] > cal_max[axis])
+		{
+			cal_max[axis] = sample[axis];
+		}
+	}
+	
+	cal_count++;
+	return (CAL_SAMPLES == cal_count)?TRUE:FALSE;
+}
+
+/*The mean, the biggest spread of any axis and the self-test.  Only once cal_sample() has said it's done.*/
+uint8_t cal_finish(uint16_t bias[ADC_SCAN_AXES], uint16_t *spread)
+{
+	uint8_t flags = CAL_STILL | CAL_IN_RANGE;
+	uint32_t magnitude = 0;
+	int16_t offset;
+	uint8_t axis;
+	
+	*spread = 0;
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		bias[axis] = (uint16_t)(cal_sum[axis] >> CAL_SAMPLES_SHIFT);
+		
+		if((cal_max[axis] - cal_min[axis]) > *spread)
+		{
+			*spread = cal_max[axis] - cal_min[axis];
+		}
+		if((cal_min[axis] < CAL_RAIL_MARGIN) || (cal_max[axis] > (CAL_FULL_SCALE - CAL_RAIL_MARGIN)))
+		{
+			flags &= ~CAL_IN_RANGE;
+		}
+		
+		//Sum of squares of each axis from 0g - three multiplies, once per boot
+		offset = (int16_t)bias[axis] - (int16_t)CAL_ZERO_G;
+		magnitude += (uint32_t)((int32_t)offset * offset);
+	}
+	
+	if(*spread > CAL_STILL_SPREAD)
+	{
+		flags &= ~CAL_STILL;
+	}
+	
+	//1g give or take a quarter is 0.5625 to 1.5625 g^2 - 9/16 and 25/16
+	if((magnitude >= (((uint32_t)CAL_ONE_G * CAL_ONE_G * 9) >> 4)) &&
+	   (magnitude <= (((uint32_t)CAL_ONE_G * CAL_ONE_G * 25) >> 4)))
+	{
+		flags |= CAL_ONE_G_OK;
+	}
+	
+	if(TRUE == cal_record_valid)
+	{
+		flags |= CAL_CACHE_VALID;
+	}
+	
+	return flags;
+}
+
+/*TRUE if the calibration in EEPROM is within CAL_MATCH of bias on every axis*/
+boolean cal_matches(const uint16_t bias[ADC_SCAN_AXES])
+{
+	uint8_t axis;
+	
+	if(FALSE == cal_record_valid)
+	{
+		return FALSE;
+	}
+	
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		if((bias[axis] > (cal_record.bias[axis] + CAL_MATCH)) || ((bias[axis] + CAL_MATCH) < cal_record.bias[axis]))
+		{
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*Keep this calibration for next time.  It's written out by cal_service().*/
+void cal_save(const uint16_t bias[ADC_SCAN_AXES])
+{
+	uint8_t axis;
+	
+	cal_record.format = CAL_FORMAT;
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		cal_record.bias[axis] = bias[axis];
+	}
+	cal_record.checksum = cal_checksum(&cal_record);
+	cal_record_valid = TRUE;
+	cal_write_next = 0;
+}
+
+/*Write the next byte of a saved calibration if the EEPROM has finished the last one.  Never waits - call
+ it regularly from the main loop.  A reset halfway through leaves a record whose checksum fails, so the
+ next boot just measures again.*/
+void cal_service(void)
+{
+	if((sizeof(cal_record_t) == cal_write_next) || (FALSE == eeprom_is_ready()))
+	{
+		return;
+	}
+	
+	//eeprom_update_byte() only writes if the byte has changed, and checks EEPE first - which is already
+	//clear, so it doesn't wait either
+	eeprom_update_byte((uint8_t *)&cal_eeprom + cal_write_next,((const uint8_t *)&cal_record)[cal_write_next]);
+	cal_write_next++;
+}
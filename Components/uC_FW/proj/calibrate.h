@@ -0,0 +1,74 @@
+/*
+ * calibrate.h
+ *
+ * Boot-time resting bias calibration, and a copy of it kept in EEPROM for the next power-up.
+ *
+ * The chains have to start from the accelerometer's resting output (gravity plus the part's own 0g
+ * offset) or the motion high-pass spends the first few seconds decaying the difference, and the step
+ * detector sees all of it as motion.  They used to be seeded from the very first sample after a
+ * one-second _delay_ms() - one noisy sample, taken whenever the delay happened to end.
+ *
+ * Now the first CAL_SAMPLES scans (80ms) go into a running mean per axis, and the spread of each axis
+ * over the same scans says whether the wearer was holding still.  cal_finish() hands back the mean and
+ * a self-test:
+ *
+ *	CAL_STILL		No axis moved more than CAL_STILL_SPREAD
+ *	CAL_IN_RANGE	No axis anywhere near either rail - a rail means a loose wire or a dead part
+ *	CAL_ONE_G_OK	The mean is 1g from the 0g point, give or take a quarter - the MMA7361L at rest
+ *
+ * If all three pass, the mean is a good calibration.  cal_save() writes it to EEPROM, a byte at a time
+ * from cal_service() so nobody waits the 3.4ms each byte takes (ATMega328 Datasheet Section 8.4.1 Table
+ * 8-2).  At the next power-up cal_cached() has it before the first scan is even in, so the chains can
+ * start from it straight away.  The measurement still runs and replaces it if the costume has been put
+ * on differently.
+ *
+ * Everything is in ADC_SCAN_FULL() units: 8-bit ADC counts with DSP_SAMPLE_FRAC_BITS fraction bits,
+ * what the chains take.
+ */
+
+#ifndef CALIBRATE_H_
+#define CALIBRATE_H_
+
+#include "common.h"
+#include "adc_scan.h"
+#include "dsp_chain.h"
+
+/*Scans in the running mean - a power of two so the mean is a shift.  64 is 80ms.*/
+#define CAL_SAMPLES_SHIFT 6
+#define CAL_SAMPLES (0x01 << CAL_SAMPLES_SHIFT)
+
+/*Still: no axis spread over more than 2 ADC counts*/
+#define CAL_STILL_SPREAD DSP_SAMPLE_8BIT(2)
+
+/*A stored calibration that's within half a count of the new measurement on every axis is left alone*/
+#define CAL_MATCH (DSP_SAMPLE_8BIT(1) / 2)
+
+/*In range: at least 4 counts clear of both rails*/
+#define CAL_RAIL_MARGIN DSP_SAMPLE_8BIT(4)
+#define CAL_FULL_SCALE DSP_SAMPLE_8BIT(256)
+
+/*ExtRef/Accelerometer - MMA7361L.pdf, 1.5g range: 0g is half its 3.3V supply and 1g is 800mV, read
+ against the 5V AVCC reference.  1.65V is 84.5 counts and 800mV is 41.*/
+#define CAL_ZERO_G ((uint16_t)((1.65 / 5.0) * 256 * (1 << DSP_SAMPLE_FRAC_BITS)))
+#define CAL_ONE_G ((uint16_t)((0.8 / 5.0) * 256 * (1 << DSP_SAMPLE_FRAC_BITS)))
+
+/*Self-test and calibration results - cal_finish() sets the first three*/
+#define CAL_STILL 0x01
+#define CAL_IN_RANGE 0x02
+#define CAL_ONE_G_OK 0x04
+#define CAL_CACHE_VALID 0x08	//There was a calibration in EEPROM
+#define CAL_CACHE_MATCH 0x10	//...and it agreed with the measurement
+#define CAL_SAVED 0x20			//The measurement is being written to EEPROM
+
+/*Everything a calibration has to pass to be used and saved*/
+#define CAL_GOOD (CAL_STILL | CAL_IN_RANGE | CAL_ONE_G_OK)
+
+void cal_init(void);
+boolean cal_cached(uint16_t bias[ADC_SCAN_AXES]);
+boolean cal_sample(const uint16_t sample[ADC_SCAN_AXES]);
+uint8_t cal_finish(uint16_t bias[ADC_SCAN_AXES], uint16_t *spread);
+boolean cal_matches(const uint16_t bias[ADC_SCAN_AXES]);
+void cal_save(const uint16_t bias[ADC_SCAN_AXES]);
+void cal_service(void);
+
+#endif /* CALIBRATE_H_ */
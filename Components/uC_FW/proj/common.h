@@ -0,0 +1,67 @@
+/*
+ * common.h
+ *
+ * Definitions shared by every source file in the project: the clock frequency, my boolean
+ * type and the bit manipulation macros.
+ */ 
+
+#ifndef COMMON_H_
+#define COMMON_H_
+
+//Always define this before you include delay.h
+#define F_CPU 8000000
+
+//The system tick rate - Timer1 interrupts this many times a second.  See main()
+#define TICK_HZ 800
+
+#include <stdint.h>
+
+/*C99 offers the boolean type but I've used non-C99 compatible compilers enough that I always
+  define TRUE and FALSE as uint8_t's
+*/
+#define TRUE 0xFF
+#define FALSE 0x00
+
+/*This macro takes the internal boolean representation and transforms it into the type of boolean
+ I use in this project
+*/
+#define BOOL(x) ((x == FALSE)?FALSE:TRUE)
+
+/* The rest of these macros define basic boolean logic functions - note that they always return 
+ TRUE or FALSE to maintain boolean type consistency
+*/
+#define NOT(x) ((x==FALSE)?TRUE:FALSE)
+#define AND(x,y) ((FALSE == (x&y))?FALSE:TRUE)
+#define OR(x,y) ((FALSE == (x|y))?FALSE:TRUE)
+
+/* Basic bit manipulation macros - everyone should use these.  Please, steal these! Don't not use them and
+ don't rewrite them yourself!
+*/
+#define SET(x,y) x |= (1 << y)
+#define CLEAR(x,y) x &= ~(1<< y)
+#define READ(x,y) ((FALSE == ((x & (1<<y))>> y))?FALSE:TRUE)
+#define TOGGLE(x,y) (x ^= (1<<y))
+
+/*Build options - uncomment to turn them on*/
+
+/*Time the filters against their original int64_t versions at startup and report over the UART - see
+ filter_bench.c*/
+//#define FILTER_BENCHMARK
+
+/*Record ISR and task entries and exits in a trace ring, a CPU load histogram and the stack high water
+ mark, all dumped over the UART on request - see trace.h*/
+//#define TRACE_ENABLED
+
+/*Run the lights by bit angle modulation off Timer2 instead of the hardware PWM, which frees Timer0 and
+ OC1A and gives five more dimmable outputs on the spare pins - see bam.h*/
+//#define LIGHTS_BAM
+
+/*ADC oversampling - every tick each axis is converted 4^ADC_OVERSAMPLE_BITS times, summed in the ADC
+ ISR and cut down to one 10 + ADC_OVERSAMPLE_BITS bit sample.  0 is plain 10-bit samples, 2 is the most
+ that fits in a tick.  See adc_scan.h for what it costs.*/
+#define ADC_OVERSAMPLE_BITS 1
+
+/*A handy typedef to add boolean support*/
+typedef uint8_t boolean;
+
+#endif /* COMMON_H_ */
@@ -48,140 +48,579 @@
  * at least one.  Before light is red, person has come to a complete stop.  While Red Light is On, person starts
  * walking.  The Red Light will stay on in Held because the person started walking when it was On, not Held.  
  * Requirement 2 coversThere's no requirement about what happens when walking occurs and the light is On.
+ *
+ * These rules are the table in streetlight.c, and host/streetsim checks them - see streetlight.h.
  */ 
 
-//Always define this before you include delay.h
-#define F_CPU 8000000
-	
+#include "common.h"
+
 #include <avr/io.h>
 #include <stdint.h>
-#include <util/delay.h>
-
-/*C99 offers the boolean type but I've used non-C99 compatible compilers enough that I always
-  define TRUE and FALSE as uint8_t's
-*/
-#define TRUE 0xFF
-#define FALSE 0x00
-
-/*This macro takes the internal boolean representation and transforms it into the type of boolean
- I use in this project
-*/
-#define BOOL(x) ((x == FALSE)?FALSE:TRUE)
-
-/* The rest of these macros define basic boolean logic functions - note that they always return 
- TRUE or FALSE to maintain boolean type consistency
-*/
-#define NOT(x) ((x==FALSE)?TRUE:FALSE)
-#define AND(x,y) ((FALSE == (x&y))?FALSE:TRUE)
-#define OR(x,y) ((FALSE == (x|y))?FALSE:TRUE)
-
-/* Basic bit manipulation macros - everyone should use these.  Please, steal these! Don't not use them and
- don't rewrite them yourself!
-*/
-#define SET(x,y) x |= (1 << y)
-#define CLEAR(x,y) x &= ~(1<< y)
-#define READ(x,y) ((FALSE == ((x & (1<<y))>> y))?FALSE:TRUE)
-#define TOGGLE(x,y) (x ^= (1<<y))
-
-/*An enumeration for the various ADC channels available*/
-enum ADC_Channels
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+
+#include "uart.h"
+#include "adc_scan.h"
+#include "filters.h"
+#include "filter_bench.h"
+#include "dsp_chain.h"
+#include "power.h"
+#include "lights.h"
+#include "progmem.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "stream.h"
+#include "freefall.h"
+#include "calibrate.h"
+#include "streetlight.h"
+#include "blackbox.h"
+
+/*The tasks, in the same order as the table in main().  See scheduler.h*/
+enum Tasks
+{
+	TASK_SAMPLES,
+	TASK_DECIMATE,
+	TASK_HEARTBEAT,
+	TASK_TICK_STATS,
+	TASK_TASK_STATS,
+	TASK_COMMANDS,
+	TASK_BOOT,
+	TASK_COUNT
+};
+
+
+/*The system tick comes from Timer1 in fast PWM mode 14.  The timer clears itself in hardware when it
+ reaches TIMER1_TOP so there is no software reload to be late - the only thing that can be late
+ is the ISR that notices the tick.  Timer1 runs off the undivided 8MHz clock, so TCNT1 at ISR
+ entry is exactly how many CPU cycles late we are.*/
+#define TIMER1_TOP ((F_CPU/TICK_HZ) - 1)	//9999 - 10000 cycles per tick, exactly 800Hz
+
+/*Jitter statistics are collected over a window of 256 ticks so the mean is a shift, not a divide*/
+#define TICK_JITTER_WINDOW_SHIFT 8
+
+/*Number of ticks the ISR has signalled that the main loop hasn't handled yet*/
+volatile uint8_t tick_pending = 0;
+
+/*Tick jitter, in CPU cycles late at ISR entry.  The published numbers are updated once per window
+ and include the fixed interrupt entry/prologue cost, so real jitter is late_max - late_min.*/
+typedef struct
 {
-	ADC_ACCEL_X = 0,	/*X-Axis*/
-	ADC_ACCEL_Y,		/*Y-Axis*/
-	ADC_ACCEL_Z,		/*Z-Axis*/
-	ADC_ACCEL_0GD		/*Zero G detect - OMG I'm falling!*/
+	uint16_t late_min;		//Smallest late-by in the last window
+	uint16_t late_max;		//Largest late-by in the last window
+	uint16_t late_mean;		//Mean late-by in the last window
+	uint16_t overruns;		//Ticks that arrived before the main loop handled the previous one (total)
+} tick_jitter_t;
+
+volatile tick_jitter_t tick_jitter = {0xFFFF, 0, 0, 0};
+
+/*One signal chain per axis, indexed by enum ADC_Channels.  See dsp_chain.h*/
+dsp_chain_t accel_chains[ADC_SCAN_AXES];
+
+/*The chains are started at rest - from last power-up's calibration on the first scan if there is one, or
+ from this one's when it's done.  See calibrate.h*/
+boolean chains_seeded = FALSE;
+
+/*The boot sequence, run by task_boot()*/
+enum Boot_States
+{
+	BOOT_CALIBRATING,	//task_samples() is measuring the resting bias
+	BOOT_CALIBRATED,	//Measured - task_boot() decides which bias to use
+	BOOT_REPORTING,		//Waiting for the first motion output from that bias, then reporting
+	BOOT_FLASHING,		//All done, but the LED stays on until a second after reset
+	BOOT_DONE			//The heartbeat has the LED
 };
 
-/*This enumerates the events available in this system*/
-enum 
+/*Where the bias the chains started from came from*/
+enum Boot_Sources
 {
-	EVENT_500MS,
-	EVENT_DECIMATE,
-	EVENT_PUSHBUTTON,
-	EVENT_READ_ADC_Y,
-	EVENT_TX_ADC_DATA
+	BOOT_FROM_CACHE = 1,		//EEPROM, and the measurement didn't disagree
+	BOOT_FROM_MEASUREMENT,		//This boot's measurement, which passed the self-test
+	BOOT_FROM_MOVING			//This boot's measurement, which didn't - the best there is, but not saved
 };
 
+uint8_t boot_state = BOOT_CALIBRATING;
+uint8_t boot_source = 0;
+uint8_t boot_flags = 0;
+uint16_t boot_bias[ADC_SCAN_AXES];
+uint16_t boot_spread = 0;
+
+/*sched_now() at the first decimated output from a bias that was chosen on purpose - 0 until then*/
+uint32_t boot_valid_at = 0;
+
+/*The LED stays on this long after the first tick*/
+#define BOOT_FLASH_CYCLES ((uint32_t)F_CPU)
+
+/*CHANNEL_BOOT payload: time to valid motion output in CPU cycles from the first tick (32-bit), the bias
+ source (enum Boot_Sources), the calibration flags (CAL_* in calibrate.h), the bias of each axis and the
+ biggest spread during calibration (ADC_SCAN_FULL() units) - all little-endian*/
+#define BOOT_REPORT_SIZE 14
+
+/*The lights, stepped with every decimated sample*/
+streetlight_t streetlight;
+
+/*How long a streetlight change takes - the old light fades out while the new one fades in.  100ms is
+ about what a real incandescent signal takes to warm up and cool down.  Requirement 3's 'as soon as
+ possible' still holds: the fade starts on the same tick as the change, and it's well under the
+ shortest state (a second), so one is always over before the next can start.*/
+#define STREETLIGHT_FADE_TICKS (TICK_HZ / 10)
 
+/*Y-axis samples per CHANNEL_ACCEL_Y frame - 8 samples is 14 bytes on the wire every 10ms*/
+#define ADC_FRAME_SAMPLES 8
 
-/*A handy typedef to add boolean support*/
-typedef uint8_t boolean;
+uint8_t adc_frame[ADC_FRAME_SAMPLES];
+uint8_t adc_frame_count = 0;
 
-//System ticks - always important
-uint32_t ticks = 0;
-uint32_t events = 0x0000;
+/*TRUE to stream all three axes, 10 bits each, compressed (CHANNEL_ACCEL_XYZ) instead of raw Y*/
+boolean stream_compressed = FALSE;
+stream_encoder_t accel_stream;
 
-/*This starts the fixed-point DSP routine definitions
- The first filter is a low-pass filter with a pole at 10Hz I believe*/
+/*CHANNEL_TICK_STATS payload: late_min, late_max, late_mean, tick overruns, ADC overruns, dropped
+ UART frames and the fraction of the last second the CPU was awake in tenths of a percent, all 16-bit
+ little-endian*/
+#define TICK_STATS_FRAME_SIZE 14
 
-//Filter coefficients
-//#define B0 .037786f
-//#define B1 .037786f
-//#define A1 -.92443f
+/*CHANNEL_TASK_STATS payload - see sched_report()*/
+#define TASK_STATS_FRAME_SIZE SCHED_REPORT_SIZE(TASK_COUNT)
 
-//Fixed-point coefficients
-#define LPF_B0 0x000009AC	
-#define LPF_B1 0x000009AC
-#define LPF_A1 0x0000ECA7
+/*Timer1 count at which the ADC scan is triggered within each tick*/
+#define ADC_TRIGGER_OFFSET 0
 
-#define NOMINAL_Y_ACCEL 0x00580000	//Split the difference between 0x59 and 0x58
+//ATMega328 Datasheet Section 11.1 Table 11-1 - Timer/Counter1 Capture Event vector
+//In mode 14 ICF1 is set when TCNT1 reaches TOP (ICR1), so this is the tick interrupt
+ISR(TIMER1_CAPT_vect)
+{
+	static uint16_t window_min = 0xFFFF;
+	static uint16_t window_max = 0;
+	static uint32_t window_sum = 0;
+	static uint8_t window_count = 0;
+	uint16_t late;
+	
+	late = TCNT1;	//Read this first - everything after it is part of the ISR's own cost
+	power_woke();
+	TRACE_ISR_ENTER(TRACE_ID_TICK_ISR);
+	TRACE_TICK(power_tick());
+	lights_tick();
+	freefall_tick();
+	sched_tick_isr();
+	
+	if(0 != tick_pending)
+	{
+		tick_jitter.overruns++;
+	}
+	tick_pending++;
+	
+	if(late < window_min)
+	{
+		window_min = late;
+	}
+	if(late > window_max)
+	{
+		window_max = late;
+	}
+	window_sum += late;
+	
+	//window_count wraps every 256 ticks - that's the end of the window
+	window_count++;
+	if(0 == window_count)
+	{
+		tick_jitter.late_min = window_min;
+		tick_jitter.late_max = window_max;
+		tick_jitter.late_mean = (uint16_t)(window_sum >> TICK_JITTER_WINDOW_SHIFT);
+		window_min = 0xFFFF;
+		window_max = 0;
+		window_sum = 0;
+	}
+	
+	TRACE_ISR_EXIT(TRACE_ID_TICK_ISR);
+}
+
+/*Start every chain as if it had been sitting at bias forever.  Any output from before was from some other
+ bias, so it's not valid.*/
+static void chains_seed(const uint16_t bias[ADC_SCAN_AXES])
+{
+	uint8_t axis;
+	
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		dsp_chain_init(&accel_chains[axis],bias[axis]);
+	}
+	chains_seeded = TRUE;
+	boot_valid_at = 0;
+}
 
-int32_t adc_lp_filter(uint8_t adc_sample)
+/*One scan's worth of samples, oldest first.  Gives the frame back to the ADC queue as soon as it's been
+ read.*/
+static void samples_frame(const adc_frame_t *scan)
 {
-	static uint8_t last_sample=(NOMINAL_Y_ACCEL>>16);	//Idle
-	static int32_t last_result=NOMINAL_Y_ACCEL;
-	int32_t result;
-	uint32_t temp,temp2;
-	int64_t temp3;
+	uint8_t axis;
+	uint8_t adc_y_axis;
+	boolean decimated = FALSE;
+	uint16_t adc_10bit[ADC_SCAN_AXES];
+	uint16_t adc_full[ADC_SCAN_AXES];
+	
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		adc_full[axis] = ADC_SCAN_FULL(scan->channel[axis]);
+	}
+	
+	//Start the filters off at rest so they don't spend the first few seconds settling.  They used to start
+	//from the first sample, noise and all.  Now the first CAL_SAMPLES scans are a proper measurement, and if
+	//last power-up saved one the chains don't even wait for that.  task_boot() sorts out which one wins.
+	if(BOOT_CALIBRATING == boot_state)
+	{
+		if((FALSE == chains_seeded) && (TRUE == cal_cached(boot_bias)))
+		{
+			chains_seed(boot_bias);
+		}
+		if(TRUE == cal_sample(adc_full))
+		{
+			boot_state = BOOT_CALIBRATED;
+		}
+	}
 	
-	/*Make sure you have enough 'room' to do these calculations by casting:
-	  When you multiply two 32-bit fixed-point integers together you get 
-	  16 extra decimal bits that you have to ignore*/
+	//Only the CIC integrators run here at 800Hz - three 32-bit adds per axis.  The chains all
+	//decimate on the same sample, so one release covers all three.
+	if(TRUE == chains_seeded)
+	{
+		for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+		{
+			if(TRUE == dsp_chain_process(&accel_chains[axis],adc_full[axis]))
+			{
+				decimated = TRUE;
+			}
+		}
+		if(TRUE == decimated)
+		{
+			sched_release(TASK_DECIMATE);
+		}
+	}
+	
+	adc_y_axis = ADC_SCAN_8BIT(scan->channel[ADC_ACCEL_Y]);
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		adc_10bit[axis] = ADC_SCAN_10BIT(scan->channel[axis]);
+	}
+	adc_scan_release();
+	
+	/*	Samples are sent ADC_FRAME_SAMPLES at a time - a frame per sample would be 7 bytes for every
+		1 byte of data, and 800 of those a second didn't fit through 38400 baud.  The queue is
+		interrupt driven so this never waits on the UART.  If the queue is full the frame is
+		dropped and the host sees the gap in sequence numbers.
+		
+		The compressed stream sends all three axes at full resolution in about the same number of
+		bytes - see stream.h.  A dropped frame doesn't matter to it either: the next one starts
+		over with a whole sample.
+	*/
+	if((TRUE == transmit_adc_enabled) && (TRUE == stream_compressed))
+	{
+		if(TRUE == stream_encode(&accel_stream,adc_10bit))
+		{
+			uart_send_frame(CHANNEL_ACCEL_XYZ,accel_stream.payload,stream_length(&accel_stream));
+			stream_reset(&accel_stream);
+		}
+	}
+	else if(TRUE == transmit_adc_enabled)
+	{
+		adc_frame[adc_frame_count++] = adc_y_axis;
+		
+		if(ADC_FRAME_SAMPLES == adc_frame_count)
+		{
+			uart_send_frame(CHANNEL_ACCEL_Y,adc_frame,ADC_FRAME_SAMPLES);
+			adc_frame_count = 0;
+		}
+	}
+	else
+	{
+		adc_frame_count = 0;	//Start with a fresh frame when streaming is turned back on
+		stream_reset(&accel_stream);
+	}
+}
+
+/*Handle ADC samples - released by the main loop whenever the ADC ISR has a scan ready.
+ The ADC ISR scans all three axes every tick on its own schedule and queues the frames (see adc_scan.h).
+ If the main loop ran late there can be a few waiting, and they're all handled now, in order.  Only a
+ main loop more than ADC_SCAN_FRAMES - 1 ticks late loses scans, and those are counted in adc_overruns.*/
+void task_samples(void)
+{
+	const adc_frame_t *scan;
+	
+	while(NULL != (scan = adc_scan_frame()))
+	{
+		samples_frame(scan);
+	}
+}
+
+/*Fade the lights to whatever the streetlight state says.  0 ticks jumps straight there.*/
+static void streetlight_show(uint16_t fade_ticks)
+{
+	uint8_t lit = streetlight_lights(&streetlight);
+	uint8_t light;
+	
+	for(light = 0; light < LIGHT_CHANNELS; light++, lit >>= 1)
+	{
+		lights_fade(light,(0 != (lit & 0x01)) ? LIGHT_FULL : LIGHT_OFF,fade_ticks);
+	}
+}
 
-	temp = (int32_t)adc_sample*LPF_B0;		/*This one doesn't need extra overhead because 8bit * 32bit 
-											  fixed-point gives you 32bit fixed-point*/
-	temp2 = (int32_t)last_sample*LPF_B1;	/*Same thing here*/
-	temp3 = ((int64_t)last_result*LPF_A1)>>16;	/*This calculation need the extra overhead because it's 2 32-bit fixed
-											      point values multiplied together*/
+/*Handle the 20Hz decimated samples - this is where all the multiplies are: the high-pass and the
+ velocity integrator, for each axis.  The step detectors run here too and keep their own counts in
+ accel_chains[].steps, and a step on any axis is walking as far as the streetlight is concerned.
+ Released by task_samples when the CIC has a sample ready.*/
+void task_decimate(void)
+{
+	uint8_t axis;
+	uint8_t stepped = 0;
+	
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		if(TRUE == dsp_chain_decimate(&accel_chains[axis]))
+		{
+			stepped |= (0x01 << axis);
+		}
+	}
 	
-	result = temp + temp2 + (int32_t)temp3;
+	if(TRUE == streetlight_step(&streetlight,BOOL(stepped)))
+	{
+		streetlight_show(STREETLIGHT_FADE_TICKS);
+	}
 	
-	last_result = result;
-	last_sample = adc_sample;
+	//Always recording, so there's something to look at when it goes wrong with nobody watching
+	blackbox_record(accel_chains,stepped,&streetlight);
 	
-	return result; 
+	if(0 == boot_valid_at)
+	{
+		boot_valid_at = sched_now();
+	}
 }
 
-/*This is a high-pass filter with a zero at .1Hz I think
- This filter aims to remove the random walk that MEMS accelerometers produce - it is not 100% effective*/
+/*This 500ms tick is for the heartbeat LED, but I'm currently using the LED for debug, so no heartbeat*/
+void task_heartbeat(void)
+{
+	//The boot flash has the LED until it's done
+	if(BOOT_DONE != boot_state)
+	{
+		return;
+	}
+	
+	//Not TOGGLE() - that's a read-modify-write of PORTD, and the free-fall alert changes the light pins on
+	//PORTD from an ISR.  ATMega328 Datasheet Section 14.2.2: writing a 1 to a PIN bit toggles the PORT
+	//bit, in one instruction, and leaves the others alone.
+	PIND = (0x01 << 7);
+}
 
-#define HPF_B0 0x000322A9	//3.1354
-#define HPF_B1 0x000322A9	//3.1354
-#define HPF_A1 0x0000FEFF	//.99608
+/*Report timing health alongside the samples so we can prove the sample clock is right*/
+void task_tick_stats(void)
+{
+	uint8_t stats_frame[TICK_STATS_FRAME_SIZE];
+	tick_jitter_t jitter;
+	uint16_t adc_dropped;
+	uint16_t awake_permille;
+	
+	if(FALSE == transmit_adc_enabled)
+	{
+		return;
+	}
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		jitter = tick_jitter;
+		adc_dropped = adc_overruns;
+	}
+	
+	stats_frame[0] = (uint8_t)(jitter.late_min);
+	stats_frame[1] = (uint8_t)(jitter.late_min >> 8);
+	stats_frame[2] = (uint8_t)(jitter.late_max);
+	stats_frame[3] = (uint8_t)(jitter.late_max >> 8);
+	stats_frame[4] = (uint8_t)(jitter.late_mean);
+	stats_frame[5] = (uint8_t)(jitter.late_mean >> 8);
+	stats_frame[6] = (uint8_t)(jitter.overruns);
+	stats_frame[7] = (uint8_t)(jitter.overruns >> 8);
+	stats_frame[8] = (uint8_t)(adc_dropped);
+	stats_frame[9] = (uint8_t)(adc_dropped >> 8);
+	stats_frame[10] = (uint8_t)(uart_frames_dropped);
+	stats_frame[11] = (uint8_t)(uart_frames_dropped >> 8);
+	awake_permille = power_awake_permille();
+	stats_frame[12] = (uint8_t)(awake_permille);
+	stats_frame[13] = (uint8_t)(awake_permille >> 8);
+	uart_send_frame(CHANNEL_TICK_STATS,stats_frame,TICK_STATS_FRAME_SIZE);
+}
 
-int32_t adc_hp_filter(int32_t adc_sample)
+/*Worst-case and average cycles for every task, once a second.  This is how to tell how much of the
+ 10000-cycle tick is left before adding anything else.*/
+void task_task_stats(void)
 {
-	static int32_t last_sample=NOMINAL_Y_ACCEL;
-	static int32_t last_result = 0x00000000;
-	int32_t result;
-	int32_t temp, temp2, temp3;
-
-	temp = (int32_t)((((int64_t)last_result*HPF_A1))>>16);
-	temp2 = (int32_t)((((int64_t)last_sample*HPF_B1))>>16);
-	temp3 = (int32_t)((((int64_t)adc_sample*HPF_B0))>>16);
-	
-	result = temp-temp2+temp3;
-	last_result = result;
-	last_sample = adc_sample;
-	return result;
+	uint8_t stats_frame[TASK_STATS_FRAME_SIZE];
+	
+	//Always take the report so the averages cover one second, even if it isn't sent
+	sched_report(stats_frame);
+	
+	if(TRUE == transmit_adc_enabled)
+	{
+		uart_send_frame(CHANNEL_TASK_STATS,stats_frame,TASK_STATS_FRAME_SIZE);
+	}
 }
 
-int main(void)
+/*Handle commands from the UART, send any falls the 0g-detect pin has seen, write out a new calibration,
+ and keep any dump that's been asked for going a frame at a time*/
+void task_commands(void)
 {
-	boolean timer_overflow = FALSE;
-	boolean transmit_adc_enabled = FALSE;
-	uint8_t adc_y_axis;
+	uint8_t command;
+	uint8_t blackbox_payload[BLACKBOX_FRAME_SIZE];
+	uint8_t length;
+	
+	while(TRUE == uart_get(&command))
+	{
+		switch(command)
+		{
+			/*	ADC data transmission is toggled by sending a '0' character - 0x30 hex*/
+			case UART_CMD_TOGGLE_STREAM:
+				transmit_adc_enabled = ((TRUE == transmit_adc_enabled)?FALSE:TRUE);
+				break;
+			case UART_CMD_STREAM_FORMAT:
+				stream_compressed = ((TRUE == stream_compressed)?FALSE:TRUE);
+				adc_frame_count = 0;
+				stream_reset(&accel_stream);
+				break;
+			case UART_CMD_BLACKBOX_DUMP:
+				blackbox_request_dump();
+				break;
+#ifdef TRACE_ENABLED
+			case UART_CMD_TRACE_DUMP:
+				trace_request_trace();
+				break;
+			case UART_CMD_PROFILE_DUMP:
+				trace_request_profile();
+				break;
+#endif
+			default:
+				break;
+		}
+	}
+	
+	freefall_service();
+	cal_service();
+	
+	//A frame of the black box window at a time, and only when it fits, like the trace dump
+	if(uart_tx_free() >= (BLACKBOX_FRAME_SIZE + UART_FRAME_OVERHEAD))
+	{
+		length = blackbox_frame(blackbox_payload);
+		if(0 != length)
+		{
+			uart_send_frame(CHANNEL_BLACKBOX,blackbox_payload,length);
+		}
+	}
+	
+#ifdef TRACE_ENABLED
+	trace_service();
+#endif
+}
 
+/*The boot sequence, everything that used to hold up main() before the timer started.  Every 10ms until
+ it's done, and nothing much after.
+ 
+ Once task_samples() has the calibration this picks the bias: a measurement that passed the self-test
+ beats last time's, unless the two agree, and gets saved for next time.  One that didn't pass is only
+ used if there's nothing better.  Then it waits for the first motion output from that bias - that's the
+ time to valid output - and reports all of it on CHANNEL_BOOT.  The LED that used to be flashed with
+ _delay_ms() in main() is on from reset until a second after the timer started.*/
+void task_boot(void)
+{
+	uint8_t report[BOOT_REPORT_SIZE];
+	uint16_t bias[ADC_SCAN_AXES];
+	uint8_t axis;
+	
+	switch(boot_state)
+	{
+		case BOOT_CALIBRATED:
+			boot_flags = cal_finish(bias,&boot_spread);
+			if(CAL_GOOD == (boot_flags & CAL_GOOD))
+			{
+				if(TRUE == cal_matches(bias))
+				{
+					boot_flags |= CAL_CACHE_MATCH;
+					boot_source = BOOT_FROM_CACHE;		//Already running from it
+				}
+				else
+				{
+					for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+					{
+						boot_bias[axis] = bias[axis];
+					}
+					chains_seed(boot_bias);
+					cal_save(boot_bias);
+					boot_flags |= CAL_SAVED;
+					boot_source = BOOT_FROM_MEASUREMENT;
+				}
+			}
+			else if(FALSE == chains_seeded)
+			{
+				for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+				{
+					boot_bias[axis] = bias[axis];
+				}
+				chains_seed(boot_bias);
+				boot_source = BOOT_FROM_MOVING;
+			}
+			else
+			{
+				boot_source = BOOT_FROM_CACHE;
+			}
+			boot_state = BOOT_REPORTING;
+			break;
+		case BOOT_REPORTING:
+			if((0 == boot_valid_at) || (uart_tx_free() < (BOOT_REPORT_SIZE + UART_FRAME_OVERHEAD)))
+			{
+				break;
+			}
+			
+			report[0] = (uint8_t)(boot_valid_at);
+			report[1] = (uint8_t)(boot_valid_at >> 8);
+			report[2] = (uint8_t)(boot_valid_at >> 16);
+			report[3] = (uint8_t)(boot_valid_at >> 24);
+			report[4] = boot_source;
+			report[5] = boot_flags;
+			for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+			{
+				report[6 + 2 * axis] = (uint8_t)(boot_bias[axis]);
+				report[7 + 2 * axis] = (uint8_t)(boot_bias[axis] >> 8);
+			}
+			report[12] = (uint8_t)(boot_spread);
+			report[13] = (uint8_t)(boot_spread >> 8);
+			uart_send_frame(CHANNEL_BOOT,report,BOOT_REPORT_SIZE);
+			boot_state = BOOT_FLASHING;
+			break;
+		case BOOT_FLASHING:
+			if(sched_now() >= BOOT_FLASH_CYCLES)
+			{
+				CLEAR(PORTD,7);
+				boot_state = BOOT_DONE;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/*The task table, in enum Tasks order.  The periodic tasks are spread out so no two land on the same
+ tick.  Samples come before decimation so the 20Hz work never holds up a scan.*/
+const sched_task_t tasks[TASK_COUNT] PROGMEM =
+{
+	//Period				Phase				Priority	Handler
+	{0,						0,					0,			task_samples},		//TASK_SAMPLES
+	{0,						0,					1,			task_decimate},		//TASK_DECIMATE
+	{TICK_HZ/2,				0,					2,			task_heartbeat},	//TASK_HEARTBEAT - 500ms
+	{TICK_HZ/2,				TICK_HZ/4,			3,			task_tick_stats},	//TASK_TICK_STATS - 500ms
+	{TICK_HZ,				(TICK_HZ*3)/8,		4,			task_task_stats},	//TASK_TASK_STATS - 1s
+	{TICK_HZ/100,			1,					5,			task_commands},		//TASK_COMMANDS - 10ms
+	{TICK_HZ/100,			5,					6,			task_boot}			//TASK_BOOT - 10ms
+};
+
+//The scheduler only has room for SCHED_MAX_TASKS - one bit each in its ready mask.  TASK_COUNT is an
+//enum so #if can't see it; this array gets a negative size (and the build stops) if the table outgrows it.
+typedef uint8_t task_table_fits[(sizeof(tasks) / sizeof(tasks[0]) <= SCHED_MAX_TASKS) ? 1 : -1];
+
+int main(void)
+{
 
 
 	//Init
@@ -227,7 +666,7 @@ int main(void)
 	//UART baud rate when the oscillator is 1MHz.  To remedy this I've disabled the CKDIV8 fuse so that the
 	//oscillator frequency is 8MHz again
 	
-
+	
 		 
 	//I/O Time
 	
@@ -240,6 +679,8 @@ int main(void)
 	//	B		1		O		Green Light PWM		Controlled via timer, not GPIO
 	//	D		5		O		Red Light PWM		Controlled via timer, not GPIO
 	//	D		6		O		Yellow Light PWM	Controlled via timer, not GPIO
+	//	C		3		I		0G detect			Pin change interrupt - see freefall.h
+	//	B/D		B0,B2,D2-4	O	Spare light outputs	Only with LIGHTS_BAM, and not wired - see bam.c
 	
 	//Due to the way the AVR is designed, pins can be configured as General Purpose I/O pins (GPIO) (Section 14.2) or 
 	//as their Alternate Port Functions (Section 14.3). Since we'll be using three of these pins as PWM outputs
@@ -258,14 +699,18 @@ int main(void)
 	//Set as Output High (initially)
 	SET(DDRD,7);	//Direction: output
 	CLEAR(PORTD,7);	//State: Lo
-
-	PRR = 0x00;	//DIsable all power reduction
+	
+	//PRR used to be 0x00 - no power reduction at all.  power_init() turns off the peripherals nobody uses
+	//and sets up Idle sleep for the main loop.  See power.h
+	power_init();
 	
 	//ATMega328 Datasheet Section 16.11.1 pg 132 - TCCR1A
 	//No waveform generation is required on this timer, so set all 
 	//ports to normal operation
+	//...except now it generates the green light's PWM on OC1A as well as the tick.  WGM11:10 = 10b for mode 14
+	//(see below).  The COM1A bits are left for lights.c - OC1A starts disconnected.
 	
-	TCCR1A = 0x00;
+	TCCR1A = (0x02);	//WGM11:10
     
 	//ATMega328 Datasheet Section 16.11.3 pg 135 - TCCR1C
 	//This register is used for output compare.  Again, we're not doing that
@@ -275,100 +720,54 @@ int main(void)
 	
 	//TCCR1B
 	//Note: I've disabled the CKDIV8 fuse so that the Fosc and clock source is 8MHz
-	//ATMega328 Datasheet Section 16.11.2 pg 134 - TCCR1A
+	//ATMega328 Datasheet Section 16.11.2 pg 134 - TCCR1B
 	//No input capture used - bits 7:6 are 0
-	//No waveform generation used - bits 4:3 are 0
+	//Waveform generation bits WGM13:12 are bits 4:3
 	//Clock source select is bits 2:0
-	//Timer is either stopped or clocked from either ClkIO or an external source
-	//ClkIO is source, 1MHz clock
 	//There are prescaler options of 1,8,64,256,1024
-	//We need to generate a time of 3s
-	//We have 16 bits to work with as well, so a lot of different ways we can do this 
-	
-	//As per ATMega328 Datasheet Section 16.9.1 page 123, setting the timer to Normal mode causes the counter
-	//to count up until it reaches 0xFFFF at which point it will overrun and start back at 0.  To configure this
-	//timer/counter to produce a reliable period we need to start counting at a value that causes it to reach
-	//0xFFFF in a known period of time.  THe first question is what period of time do we want that to be?
-	
-	//First question is what is the default? 
-	//The default behavior is a prescaler of 1, clock source of 8MHz and a period of 0xFFFF counts or 65566 counts
-	//That gives us a period of .125e-6*65536 = ~.008192s = 8.192ms
-	
-	//A prescaler of 256 gives us 256 times that, roughly 2.1s
-	//The clock source is 8000000/256.  This means 1 tick is .125e-6*256 = 32us
-	//500ms / .032ms /tick = 1953.125 ticks
-	//We can only count an integer number of ticks so we either have to count up to 1953 ticks or 1954 ticks
-	//1953 is closest to 1953.125 so we'll use that
-	//However, this isn't the value that we will put into the count registers.  We need to count 1953 counts and 
-	//be at 0xFFFF for this scheme to work.  So, we need to populate the count register with a value that is 1953
-	//less than 0xFFFF.  Some quick math gives us 65535-1953 = 63852 = 0xF85E 
-	//Why do I use hex when I could use decimal?  I don't know.  I'm old school.
-	
-	//Name this something that makes sense when you write it in code
-	#define PERIOD_500MS 0xC2F6
-	#define PERIOD_10MS  0xF3C7
-	#define PERIOD_100MS 0xF3CA
-	#define PERIOD_250MS 0xE17B
-	#define PERIOD_800HZ 0xFFD9
-	
-	#define PERIOD_HB_LED 400
-	#define PERIOD_DECIMATE 40
-	
-	#define TIMER1_PERIOD PERIOD_800HZ
-	
-	//See?  It's obvious what's going on here
-	TCNT1 = TIMER1_PERIOD;
+	
+	//This used to run the timer in Normal mode and reload TCNT1 by hand every time the main loop noticed the
+	//overflow flag.  Every cycle between the overflow and the reload was lost, so the 800Hz tick was really
+	//however long the previous frame took plus 39 counts.  Not good for a sample clock.
+	
+	//As per ATMega328 Datasheet Section 16.9.2 page 124, CTC mode clears the counter in hardware when it
+	//matches TOP.  Nothing has to happen in software for the period to be right.  Table 16-4 pg 133 gives
+	//two CTC modes: mode 4 (TOP = OCR1A) and mode 12 (TOP = ICR1).  Mode 12 leaves OCR1A and OCR1B free, and
+	//OC1A is the green light pin, so I was using mode 12: WGM13:12 = 11b, WGM11:10 = 00b (TCCR1A).
+	
+	//But the green light needs PWM, and CTC can't do that.  Fast PWM mode 14 (Section 16.9.3) counts exactly
+	//the same way - 0 to TOP = ICR1 and back to 0 in hardware - and sets ICF1 at TOP just like mode 12 did,
+	//so the tick doesn't change at all.  On top of that it drives OC1A from OCR1A, at the tick rate: 800Hz
+	//is plenty for an LED.  Mode 14: WGM13:12 = 11b, WGM11:10 = 10b.
+	
+	//With a prescaler of 1 the timer counts CPU cycles: 8000000/800 = 10000 counts per tick, which fits in 
+	//16 bits and divides exactly.  A nice side effect is that TCNT1 is a cycle counter within the tick.
+	
+	ICR1 = TIMER1_TOP;
+	TCNT1 = 0x0000;
 	
 	//Now to set the interrupt masks
-	//I want no interrupts - we'll poll the overflow flag to determine when an overflow has occurred
 	//ATMega328 Datasheet Section 16.11.8 Pg 136 - TIMSK1
-	//No interrupts, all 0's
+	//Bit 5 - ICIE1 - Input capture interrupt enable.  In mode 14 this is the 'reached TOP' interrupt: 1
 	
-	TIMSK1 = 0x00;
+	TIMSK1 = (0x01 << 5);
 	
 	//Now the only thing left to do is turn the timer/counter on.  But don't do it yet!  That's always the last
 	//thing you do before you start the main loop.  You don't want to miss an overflow situation while you're 
 	//initializing other parts of the system.
-
-	//Setting up Timer 0 for PWM mode
-	//As per ATMega Datasheet Section 15.9.1 Page 105 Paragraph 1: the DDRn bits for the output compare lines
-	//must be set to output for any of this to work
-	//Output compare A - Port D pin 6
-	//This is 
-	SET(DDRD,6);	//Direction: output
-
-	//Output compare B - Port D pin 5
-	//SET(DDRD,5);
-		
-	//Fast PWM mode for Timer 0 
-	//Count increases from 0x00 to 0xFF
-	//It is SET at 0x00 and is CLEARED when it matches the output compare 
-	//Period is set only according to the source
-
-	TCNT0 = 0x00;
-	//ATMega328 Datasheet Section 15.9.1 Pg 105 - TCCR0A 
-	TCCR0A =	(0x02<<6) |	//Noninverting PWM output A: Set output A at BOTTOM, CLEAR at compare match
-				(0x02<<4) |	//Noninverting PWM output B
-				(0x03);	//Fast PWM mode 3: RUn from 0x00 to 0xFF
-				
-	//ATMega328 Datasheet Section 15.9.2 Pg 108 - TCCR0B
-	TIMSK0 =	0X00;		//No interupts needed
 	
-	#define GREEN_PWM 0x80
-	#define YELLOW_PWM 0x80
-	#define RED_PWM 0x80
+	//The lights - Timer0 PWM for yellow and red, OC1A on Timer1 for green.  They used to be set up right here,
+	//with fixed duty cycles and the red pin never enabled.  See lights.c
+	lights_init();
 	
-	OCR0A = YELLOW_PWM;
-	OCR0B = 0x01;		//NOTE!: even at OCR0B at 0x00 it still turns on!  Turn the output off if you don't want 
-						//lights to turn on.
+	//Requirement 1 - start up with red on.  From here on streetlight.c decides.
+	streetlight_init(&streetlight);
+	streetlight_show(0);
+	blackbox_init();
 	
-	TCCR0B =	(0x00<<7) |	//Force output compare A - not needed because of PWM
-				(0x00<<6) |	//Force output compare B - not needed because of PWM mode
-				(0x00<<3) |	//WGM most-significant bit - should be set to 0 for this mode
-				(0x01);		//Clock-select = 4 - 8MHz/256 = 31KHz period. But for now set it to 0 so it doesn't run
-				
-
-
+	//The accelerometer's 0G detect pin - a pin change interrupt that flashes the lights the moment the wearer
+	//starts falling.  See freefall.h
+	freefall_init();
 	
 	//Now it's time for the ADC
 	//I just go through the datasheet registers and configure them as I see fit.
@@ -385,18 +784,24 @@ int main(void)
 	significant 8 bits are stored in one register.  Thus, if you left-adjust the result you only
 	need to read one register to get the result*/
 	
-	/*ADC Channel - I only care about one - the Y axis on the accelerometer which is channel 1.*/
+	/*ADC Channel - I used to only care about one - the Y axis on the accelerometer which is channel 1.  Knowing
+	which way is forward no matter how the board is mounted needs all three, so now the ADC ISR scans X, Y and Z
+	every tick (see adc_scan.c) and rewrites the channel bits as it goes.  It starts on X.  0G detect used to be
+	in the scan too, but it's a logic output and has its own pin change interrupt now - see freefall.h.*/
+	
+	/*Not any more.  The ADC ISR oversamples (see adc_scan.h) and adds up the whole 10-bit results, so they're
+	right-adjusted now, and the noisy LSB is exactly what makes the extra bits work.  The frames are still
+	left-adjusted, so the top byte is the same 8-bit sample it always was.*/
 	
 	ADMUX =		(0x01 << 6) /*Reference - AVCC - 5V. */ 
-			|	(0x01 << 5) /* Left-adjust ADC result - refer to Section 24.9.3.2 pg 256*/
-			|	(ADC_ACCEL_Y); /*Channel set to Y-Axis output on accelerometer*/
+			|	(ADC_ACCEL_X); /*First channel of the scan - X-Axis.  ADC_SCAN_ADMUX has to match the other bits*/
 	
 	//ATMega328 Datasheet - Section 24.9.2 - ADCSRA - ADC Status and Control Register
 	//ADCEN - Bit 7 - Enable ADC - Obviously set this to 1
 	//ADCSC - Bit 6 - Start Converstion - Not yet: 0
-	//ADATE - Bit 5 - Auto-trigger ADC - I'll be manually triggering the ADC, so 0
-	//ADCIF - Bit 4 - ADC Interrupt Flag - Set when conversion completes.  Ignore.
-	//ADCIE - Bit 3 - ADC Interrupt Enable - Everything will be polled for this, so 0
+	//ADATE - Bit 5 - Auto-trigger ADC - Timer1 starts every conversion, so 1
+	//ADCIF - Bit 4 - ADC Interrupt Flag - Set when conversion completes.  Cleared by the ISR.
+	//ADCIE - Bit 3 - ADC Interrupt Enable - The ISR stores each sample, so 1
 	//ADPS - Bits 2:0 - ADC Prescaler
 	/*ATMega328 Section 24.4 Pg245 discusses what the prescaler should be set to:
 	
@@ -405,194 +810,116 @@ int main(void)
 	
 	The ClkIO is 1MHz and the prescaler options are 2,4,8,16,32,64 and 128. 1MHz/8 = ~125KHz, so that seems good.
 	That value is 3
+	
+	Except ClkIO isn't 1MHz any more - I turned CKDIV8 off, so it's 8MHz and the ADC clock is really 1MHz.
+	Section 24.4 says that's allowed if you don't need all 10 bits.  The oversampling in adc_scan.c averages
+	the noise down into extra bits, but it can't give back the linearity a slower clock would have.  A
+	conversion is 13us, which is what lets 4^n conversions of every axis fit in the tick.
 	*/
 	
 	ADCSRA =	(0x01 << 7)	//Enable ADC
-			  |	(0x03);		//Set prescaler to 1/8 ClkIO - 125KHz
-			  
-	//ATMega328 Datasheet Section 24.9.5 Pg 257 - DIDR0
-	//This register allows digital input buffers on ADC pins to be disabled.  This saves power, so I'll do it
-	//I have four channels: 0-3 which equates to 0x0F
-	
-	DIDR0 = 0x0F;	//Turn off digital filtering on ADC channels 0-3
+			  |	(0x01 << 5)	//Auto-trigger enable
+			  |	(0x01 << 3)	//ADC interrupt enable
+			  |	(0x03);		//Set prescaler to 1/8 ClkIO - 1MHz
 	
+	//I used to start each conversion from the main loop and then spin on ADCIF for ~14.5us.  That's 800 spins
+	//a second doing nothing, and the sample time depended on when the main loop got around to it.
+	//Now Timer1 starts the scan in hardware and the ADC ISR runs the rest of it - see adc_scan.c.
 	
-	//Configure UART for 38400 8N1 Tx Communication
-	//We want to transmit accelerometer information for debug purposes
+	//ATMega328 Datasheet Section 24.9.4 Pg 257 - ADCSRB
+	//ADTS - Bits 2:0 - Auto trigger source - Timer/Counter1 Compare Match B: 101b
+	//Section 24.3 pg 242 - the trigger is the rising edge of the interrupt flag, so OCF1B has to be cleared
+	//before the next one.  The ADC ISR does that, so no OCF1B interrupt is needed.
 	
-	//Step 1 - Baud rate
-	//ATMega328 Datasheet Section 20.10 - Table 20-6 pg 192
-	//Baud rate settings for fosc of 8MHZ
-	//Choosing baud rate of 38.4K for minimum error
-	//U2Xn = 0
-	//UBRRn = 12
+	ADCSRB = 0x05;
 	
-	UBRR0 = 12;
-	
- 	//UCSR0A - UART 0 Control and Status Register A
-	//ATMega328 Datasheet Section 20.11.2 pg 194
-	//Bits 7:2 - Status bits
-	//Bit 1 - Double UART transmission speed - Yes : 1
-	//Bit 0 - Multi-Processor Communication Mode - No:0
-	
-	UCSR0A = 0x00;
-	
-	//UCSR0B - UART 0 Control and Status Register B
-	//ATMega328 Datasheet Section 20.11.3 pg 
-	//Bit 7 - Rx Complete Interrupt Enable - 0
-	//Bit 6 - Tx Complete Interrupt Enable - 0
-	//Bit 5 - USART Data Register Empty interrupt enable - 0
-	//Bit 4 - Receiver Enable - Set to 1
-	//Bit 3 - Transmitter Enable - Set to 1
-	//Bit 2 - Character Size Bit 2 - Set to 0 for 8 bits
-	//Bit 1 - 9th receive bit - Ignore
-	//Bit 0 - 9th transmit bit - Ignore
-	
-	UCSR0B = 0x00	| (1 << 3)
-					| (1 << 4);
-	
-	//UCSR0C - UART 0 Control and Status Register C
-	//ATMega328 Datasheet Section 20.11.4 - Pg 196
-	//BIts 7:6 - Set to asynchronous (clockless) mode: 00
-	//Bits 5:4 - Parity setting - None : 00
-	//Bit 3 - Stop select - 1 : 0
-	//Bit 2:1 - Character size - 8 : 11
-	//Bit 0 - Clock polarity: Don't care : 0
-	
-	UCSR0C = 0x03 << 1;
-	
-	//Send a known pattern to verify the UART works
-	UDR0 = 0xA5;
-	
-	//Wait until transmit is complete
-	while(FALSE == READ(UCSR0A,6));
+	//OCR1B is the point in the tick where the conversion starts.  At 0 it starts the moment the counter
+	//wraps, so the sample instant is exactly as good as the timer.
+	OCR1B = ADC_TRIGGER_OFFSET;
+			  
+	//ATMega328 Datasheet Section 24.9.5 Pg 257 - DIDR0
+	//This register allows digital input buffers on ADC pins to be disabled.  This saves power, so I'll do it
+	//I have four channels: 0-3 which equates to 0x0F
+	//...but 0G detect on ADC3 is read as a digital pin now, and with its buffer off PINC bit 3 always reads 0
+	//and the pin change interrupt never fires.  Only the three axes: 0x07
 	
-	UDR0 = 0x5A;
+	DIDR0 = 0x07;	//Turn off digital filtering on ADC channels 0-2
 	
-	while(FALSE == READ(UCSR0A,6));
 	
-	UDR0 = 0xA5;
+	//The UART is set up in uart.c - 250000 8N1, interrupt driven
+	uart_init();
 	
-	//Wait until transmit is complete
-	while(FALSE == READ(UCSR0A,6));
+	//Send a known pattern to verify the UART works.  This just queues it - it goes out as soon as
+	//interrupts are enabled
+	uart_put(0xA5);
+	uart_put(0x5A);
+	uart_put(0xA5);
 	
 	
 	//Flash the LED for a second to show that initialization has successfully occurred
 	//For some reason this does not last 1s at all
+	//It didn't need to hold everything else up for that second either - the sampling could have been going
+	//the whole time.  The LED goes on here and task_boot() turns it off, and the boot calibration starts on
+	//the first scan.  Last power-up's calibration comes out of EEPROM now so the first scan can use it.
 	SET(PORTD,7);
-	_delay_ms(1000);
-	CLEAR(PORTD,7);
+	cal_init();
+	
+	//ADC all done! The first conversion starts on the first OCR1B match once the timer is running
 	
-	//ADC all done! Now I can initiate a conversion by setting bit 6 (ADCSC) of ADCSRA to 1 and then polling 
-	//bit 3 (ADCIF) until it turns to 1
+#ifdef FILTER_BENCHMARK
+	//Before anything else uses Timer1, borrow it to time the filters
+	filter_benchmark();
+#endif
+	
+	//The main loop used to be a chain of if(event) blocks with a 32-bit events word.  Now everything it does
+	//is a task in the table above - see scheduler.h
+	sched_init(tasks,TASK_COUNT);
 	
 	//Here we can turn the timer on
 	//ATMega328 Datasheet Section 16.11.2 Pg 135 - TCCR1B
-	//No Waveform generation: bits 4:3 = 0
 	//No input capture: bits 7:6 = 0
-	//Clock select: ClkIO/256 - bits 2:0 = 100b = 0x04
+	//Waveform generation: fast PWM, TOP = ICR1 - bits 4:3 = 11b
+	//Clock select: ClkIO/1 - bits 2:0 = 001b
 	
-	TCCR1B = 0x04;	//This starts the counter/timer
+	TCCR1B =	(0x03 << 3)	//WGM13:12 - fast PWM mode 14 with WGM11:10 in TCCR1A
+			|	(0x01);		//Clock select - no prescaling.  This starts the counter/timer
 	
+	sei();	//Global interrupt enable - tick, ADC, UART and free-fall ISRs
 	
 	while(1)
-    {
-
-		//Determine what events need to be handled this frame
-		
-		//Handle system timer
-		timer_overflow = READ(TIFR1,0);
-			
-		if(TRUE == timer_overflow)
+	{
+		//Handle system timer - the ISR counts ticks, the main loop consumes them one at a time.  If a frame
+		//overruns, the next tick is still pending and gets handled straight away, so no tick is ever lost.
+		//Each tick releases whichever periodic tasks are due.
+		if(0 != tick_pending)
 		{
-			SET(TIFR1,0);		//ATMega328 datasheet Section 16.11.9 pg137 - This clears the overflow flag
-
-			TCNT1 = TIMER1_PERIOD;	//Reset the counter period
-			ticks++;
-			
-			//Signal ADC Read - this is done every 1.25ms
-			SET(events,EVENT_READ_ADC_Y);
-
-			//The plan was to decimate the data prior to integrating, so this event would
-			//be signaled every 20Hz to perform the decimation and velocity calculation. 
-			//It's still here but it probably won't work that way in the end.
-			switch(ticks)
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 			{
-				case 0:
-				case 40:
-				case 80:
-				case 120:
-				case 160:
-				case 200:
-				case 240:
-				case 280:
-				case 320:
-				case 360:
-				case 400:
-					SET(events,EVENT_DECIMATE);
-					break;
-				default:
-					break;
+				tick_pending--;
 			}
 			
-			if(PERIOD_HB_LED == ticks)
-			{
-				ticks = 0;
-				//Signal that this event occurred in this frame
-				SET(events,EVENT_500MS);
-			}
-		}			
+			sched_tick();
+		}
 		
-		//This 500ms tick is for the heartbeat LED, but I'm currently using the LED for debug, so no heartbeat
-
-		//Handle 500ms tick
-		if(TRUE == READ(events,EVENT_500MS))
+		//A finished ADC scan releases the sample task
+		if(NULL != adc_scan_frame())
 		{
-			TOGGLE(PORTD,7);
+			sched_release(TASK_SAMPLES);
 		}
-
-		//Handle reading ADC - Y axis
-		if(TRUE == READ(events,EVENT_READ_ADC_Y))
-		{
-
-			SET(ADCSRA,6);	//Start conversion
-			
-			//Wait until conversion finishes - this should never be more than
-			//25* (8000000/8)^-1 seconds, which is about 25us
-			//Typical measured is ~14.5us
-			while(FALSE == READ(ADCSRA,4));	
-	
-			SET(ADCSRA,4);	//Clear the interrupt flag by setting it to 1
-
-			adc_y_axis = ADCH;	//Transfer ADC result to y-axis variable
-			
-			/*	If USART is in the middle of a transmission then delay until 
-				it's finished.
-				You may be wondering - why not put this after the transmit?  
-				In this case I'm only sending one byte so I don't need to 
-				wait for the USART to finish to send another.  I can do useful
-				work while the USART is transmitting instead of just blocking 
-				until it's done for no good reason
-			*/
-			SET(events,EVENT_TX_ADC_DATA);
-		}	
-
-		if(READ(events,EVENT_TX_ADC_DATA) && (TRUE == transmit_adc_enabled))
+		
+		//Run everything that's ready, most urgent first
+		sched_run();
+		
+		//Nothing left to do until the next interrupt, so sleep until then.  Interrupts go off for the check so
+		//a tick or a scan can't finish between deciding to sleep and actually sleeping.
+		cli();
+		if((0 == tick_pending) && (NULL == adc_scan_frame()) && (TRUE == sched_idle()))
 		{
-			while(FALSE == READ(UCSR0A,6));	
-			UDR0 = (uint8_t)(adc_y_axis);
+			power_idle();	//Turns interrupts back on
 		}
-		
-		/*	ADC data transmission is toggled by sending a '0' character - 0x30 hex*/
-		if(TRUE == (READ(UCSR0A,7)))
+		else
 		{
-			if(0x30 == UDR0)
-			{
-				transmit_adc_enabled = ((TRUE == transmit_adc_enabled)?FALSE:TRUE);
-			}
+			sei();
 		}
-		
-		//Clear all events in this frame
-		events = 0x0000;
-    }
-}
\ No newline at end of file
+	}
+}
@@ -0,0 +1,140 @@
+/*
+ * dsp_chain.c
+ *
+ * The accelerometer signal chain - see dsp_chain.h.
+ */
+
+#include <stdint.h>
+
+#include "common.h"
+#include "fixed_point.h"
+#include "biquad.h"
+#include "biquad_coeffs.h"
+#include "step_detect.h"
+#include "dsp_chain.h"
+
+/*1/64000 in Q0.32, i.e. 2^16/64000 as a Q16.16 multiplier - takes the CIC output (64000 times the
+ input, in ADC counts) to Q16.16 ADC counts.  It's 1.0000020 times too big, which is nothing.*/
+#define CIC_GAIN_Q16 67109UL
+
+/*The 20Hz step, 0.05s in Q16.16*/
+#define VELOCITY_DT_Q16 3277UL
+
+/*The bits of the CIC output that mean anything - see dsp_chain.h*/
+#define CIC_OUTPUT_MASK ((0x01UL << (24 + DSP_SAMPLE_FRAC_BITS)) - 1)
+
+/*The comb delays of a third-order CIC that has had a constant input of 1 forever, with its integrators
+ at 0 - see dsp_chain_init().  With a constant input s, and the integrators at 0 at sample 0, the last
+ integrator goes I(n) = s * n(n+1)(n+2)/6 for every n, before 0 as well as after.  The combs hold I at
+ the last decimated sample (n = 0) and its first and second differences one step (R samples) apart.*/
+#if DSP_CIC_ORDER != 3
+#error "CIC_REST_COMB_1 and CIC_REST_COMB_2 are worked out for a third-order CIC"
+#endif
+#define CIC_R ((int32_t)DSP_DECIMATE_RATIO)
+#define CIC_I(n) (((n) * ((n) + 1) * ((n) + 2)) / 6)
+#define CIC_REST_COMB_1 (CIC_I(0) - CIC_I(-CIC_R))
+#define CIC_REST_COMB_2 (CIC_REST_COMB_1 - (CIC_I(-CIC_R) - CIC_I(-2 * CIC_R)))
+
+/*Run the combs on the latched integrator output.  Returns Q16.16 ADC counts.*/
+static int32_t cic_comb(dsp_chain_t *chain)
+{
+	uint32_t value = chain->decimated;
+	uint32_t delayed;
+	uint8_t i;
+	
+	for(i = 0; i < DSP_CIC_ORDER; i++)
+	{
+		delayed = chain->comb[i];
+		chain->comb[i] = value;
+		value -= delayed;
+	}
+	
+	//Only the bottom 24 + DSP_SAMPLE_FRAC_BITS bits mean anything (see dsp_chain.h), and they're never
+	//negative.  Scaling first and dropping the sample's fraction bits after rounds exactly the same as
+	//an 8-bit sample always did.
+	return fix_mul_q16((int32_t)(value & CIC_OUTPUT_MASK),CIC_GAIN_Q16) >> DSP_SAMPLE_FRAC_BITS;
+}
+
+/*Start the chain as if it had been sitting at rest_sample forever*/
+void dsp_chain_init(dsp_chain_t *chain, uint16_t rest_sample)
+{
+	uint8_t i;
+	
+	//This used to feed the CIC DSP_CIC_ORDER decimated steps of rest - 120 samples - and run the combs, which
+	//got it to the same place but cost about 6000 cycles an axis, more than a tick for all three.  The boot
+	//calibration seeds the chains in the middle of running (see calibrate.h), so it has to be cheap.  The
+	//CIC's output only depends on its input, not on where the integrators happen to be, so they can start
+	//at 0 as long as the combs are set to match (see CIC_REST_COMB_1).  Everything wraps the same way it
+	//would have, so the outputs are bit for bit what the old preload gave.
+	for(i = 0; i < DSP_CIC_ORDER; i++)
+	{
+		chain->integrator[i] = 0;
+	}
+	chain->comb[0] = 0;
+	chain->comb[1] = (uint32_t)rest_sample * (uint32_t)CIC_REST_COMB_1;
+	chain->comb[2] = (uint32_t)rest_sample * (uint32_t)CIC_REST_COMB_2;
+	chain->phase = 0;
+	
+	//And the output it's been giving all along: the CIC gain times the sample
+	chain->decimated = (uint32_t)rest_sample * ((uint32_t)DSP_DECIMATE_RATIO * DSP_DECIMATE_RATIO * DSP_DECIMATE_RATIO);
+	chain->accel = fix_mul_q16((int32_t)(chain->decimated & CIC_OUTPUT_MASK),CIC_GAIN_Q16) >> DSP_SAMPLE_FRAC_BITS;
+	
+	biquad_preload(biquad_motion_hp,chain->high_pass,BIQUAD_MOTION_HP_SECTIONS,chain->accel);
+	chain->motion = 0;
+	chain->velocity = 0;
+	chain->still_count = DSP_STILL_SAMPLES;
+	step_detect_init(&chain->steps);
+}
+
+/*Run one ADC sample (DSP_SAMPLE_FRAC_BITS fraction bits) through the integrators.  This is the only part that runs at 800Hz.
+ Returns TRUE when a decimated sample is ready and dsp_chain_decimate() should be called - that has to
+ happen within the next DSP_DECIMATE_RATIO samples.*/
+boolean dsp_chain_process(dsp_chain_t *chain, uint16_t sample)
+{
+	uint32_t value = sample;
+	uint8_t i;
+	
+	for(i = 0; i < DSP_CIC_ORDER; i++)
+	{
+		chain->integrator[i] += value;
+		value = chain->integrator[i];
+	}
+	
+	if(DSP_DECIMATE_RATIO == ++chain->phase)
+	{
+		chain->phase = 0;
+		chain->decimated = value;
+		return TRUE;
+	}
+	
+	return FALSE;
+}
+
+/*The 20Hz half: combs, high-pass, velocity and step detection.  Returns TRUE if a step was counted.*/
+boolean dsp_chain_decimate(dsp_chain_t *chain)
+{
+	chain->accel = cic_comb(chain);
+	chain->motion = biquad_run(biquad_motion_hp,chain->high_pass,BIQUAD_MOTION_HP_SECTIONS,chain->accel);
+	
+	chain->velocity -= chain->velocity >> DSP_VELOCITY_LEAK_SHIFT;
+	chain->velocity += fix_mul_q16(chain->motion,VELOCITY_DT_Q16);
+	
+	if((chain->motion < DSP_STILL_THRESHOLD) && (chain->motion > -DSP_STILL_THRESHOLD))
+	{
+		if(chain->still_count < DSP_STILL_SAMPLES)
+		{
+			chain->still_count++;
+		}
+	}
+	else
+	{
+		chain->still_count = 0;
+	}
+	
+	if(DSP_STILL_SAMPLES == chain->still_count)
+	{
+		chain->velocity = 0;
+	}
+	
+	return step_detect_run(&chain->steps,chain->motion);
+}
@@ -0,0 +1,87 @@
+/*
+ * dsp_chain.h
+ *
+ * The accelerometer signal chain, from raw ADC samples to a forward-motion (velocity) signal.
+ *
+ * Nothing in here touches a register, so the same code builds for the AVR and natively on the host
+ * (see host/) where it can be replayed against recorded captures.
+ *
+ *	800Hz:	ADC sample -> CIC decimator integrators
+ *	20Hz:	CIC combs -> motion_hp (0.5Hz high-pass) -> leaky velocity integrator
+ *	     	                                         \-> step detector (see step_detect.h)
+ *
+ * The original plan was always to decimate to 20Hz before working out velocity - EVENT_DECIMATE in
+ * costume_2012.c has been waiting for this.  Walking is a couple of Hz at most, so 20Hz is plenty,
+ * and it means the multiplies run 20 times a second instead of 800.
+ *
+ * The decimator is a third-order CIC (cascaded integrator-comb) with a ratio of 40.  It's the classic
+ * cheap decimator: per sample it's three 32-bit adds and no multiplies at all, and the anti-aliasing
+ * comes for free from its sinc^3 response.  Everything that lands on the 0-2Hz band after decimating
+ * came from within 2Hz of a multiple of 20Hz, and those are all at least 57dB down.  The price is
+ * droop - 0.4dB at 2Hz, 11.7dB at the new Nyquist of 10Hz - which doesn't matter for walking.
+ *
+ * Samples come in as 8-bit ADC counts with DSP_SAMPLE_FRAC_BITS fraction bits - the full oversampled
+ * ADC result (see adc_scan.h) - so the chain keeps every bit the ADC scan can give it.
+ *
+ * The integrators are allowed to wrap.  The gain is 40^3 = 64000 and a sample needs
+ * 8 + DSP_SAMPLE_FRAC_BITS bits, so the output needs 24 + DSP_SAMPLE_FRAC_BITS; as long as the
+ * registers have at least that many the wraps in the integrators cancel in the combs (Hogenauer, 1981).
+ *
+ * Velocity is a leaky integral of the high-passed acceleration.  Integrating MEMS noise is a random
+ * walk, and the high-pass only takes out the part of the bias that's constant, so the velocity
+ * would wander off on its own.  Two things pull it back:
+ *	- A leak: every 20Hz step loses 1/64th of the velocity, a 3.2s time constant.  Steps are a lot
+ *	  faster than that, so they still show up.
+ *	- A zero-velocity update: if the acceleration has stayed inside DSP_STILL_THRESHOLD for
+ *	  DSP_STILL_SAMPLES steps in a row, whoever's wearing this is standing still and the velocity is
+ *	  set back to 0.
+ *
+ * Each chain carries all of its own state, so there can be one per axis.
+ */
+
+#ifndef DSP_CHAIN_H_
+#define DSP_CHAIN_H_
+
+#include <stdint.h>
+
+#include "common.h"
+#include "biquad.h"
+#include "biquad_coeffs.h"
+#include "step_detect.h"
+
+/*Samples in per sample out, and the number of integrator/comb stages*/
+#define DSP_DECIMATE_RATIO 40
+#define DSP_CIC_ORDER 3
+
+/*Fraction bits in each sample - the 10-bit ADC result has 2, oversampling adds more*/
+#define DSP_SAMPLE_FRAC_BITS (2 + ADC_OVERSAMPLE_BITS)
+
+/*Turn a plain 8-bit sample into the chain's format*/
+#define DSP_SAMPLE_8BIT(sample) ((uint16_t)(sample) << DSP_SAMPLE_FRAC_BITS)
+
+/*Velocity leaks by velocity >> DSP_VELOCITY_LEAK_SHIFT every step - 64 steps is 3.2s at 20Hz*/
+#define DSP_VELOCITY_LEAK_SHIFT 6
+
+/*Zero-velocity update: |motion| below half an ADC count (Q16.16) for half a second*/
+#define DSP_STILL_THRESHOLD 0x00008000L
+#define DSP_STILL_SAMPLES 10
+
+typedef struct
+{
+	uint32_t integrator[DSP_CIC_ORDER];	//CIC integrators - these wrap, see above
+	uint32_t comb[DSP_CIC_ORDER];		//CIC comb delays, one decimated step back
+	uint32_t decimated;					//Last integrator output, latched for dsp_chain_decimate()
+	uint8_t phase;						//Samples since the last decimated output
+	biquad_state_t high_pass[BIQUAD_MOTION_HP_SECTIONS];
+	uint8_t still_count;				//Steps in a row with |motion| under DSP_STILL_THRESHOLD
+	int32_t accel;		//Last decimated sample - acceleration including gravity, Q16.16 ADC counts
+	int32_t motion;		//Last high-pass output - gravity and drift removed, Q16.16 ADC counts
+	int32_t velocity;	//Leaky integral of motion, Q16.16 ADC count-seconds
+	step_detect_t steps;
+} dsp_chain_t;
+
+void dsp_chain_init(dsp_chain_t *chain, uint16_t rest_sample);
+boolean dsp_chain_process(dsp_chain_t *chain, uint16_t sample);
+boolean dsp_chain_decimate(dsp_chain_t *chain);
+
+#endif /* DSP_CHAIN_H_ */
@@ -0,0 +1,191 @@
+/*
+ * filter_bench.c
+ *
+ * Startup cycle-count comparison of the filters against their original int64_t versions.
+ *
+ * Timer1 runs from the undivided 8MHz clock, so reading TCNT1 either side of a call gives the cost
+ * of the call in CPU cycles.  Both versions get the same pseudo-random samples (the full 0-255
+ * range, not just the values you see at rest) and every output is compared, so this also proves the
+ * hardware-multiply versions are bit-exact.
+ *
+ * It also times a pass through the accel_lp biquad cascade and reports the cost per section - that's
+ * the number to budget with when adding sections to filter_spec.txt.
+ *
+ * This runs before the tick is started, with interrupts still off, so nothing can land in the middle
+ * of a measurement.  It does run the real filters, so their state isn't at rest when the main loop
+ * starts - don't leave it turned on for the costume.
+ */
+
+#include "common.h"
+
+#ifdef FILTER_BENCHMARK
+
+#include <avr/io.h>
+
+#include "filters.h"
+#include "biquad.h"
+#include "biquad_coeffs.h"
+#include "filter_bench.h"
+#include "uart.h"
+
+#define BENCH_SAMPLES 256
+#define BENCH_SAMPLES_SHIFT 8
+
+/*These are the filters exactly as they were before fixed_point.h*/
+
+#define REF_LPF_B0 0x000009AC	
+#define REF_LPF_B1 0x000009AC
+#define REF_LPF_A1 0x0000ECA7
+
+static __attribute__((noinline)) int32_t ref_lp_filter(uint8_t adc_sample)
+{
+	static uint8_t last_sample=(NOMINAL_Y_ACCEL>>16);	//Idle
+	static int32_t last_result=NOMINAL_Y_ACCEL;
+	int32_t result;
+	uint32_t temp,temp2;
+	int64_t temp3;
+	
+	temp = (int32_t)adc_sample*REF_LPF_B0;
+	temp2 = (int32_t)last_sample*REF_LPF_B1;
+	temp3 = ((int64_t)last_result*REF_LPF_A1)>>16;
+	
+	result = temp + temp2 + (int32_t)temp3;
+	
+	last_result = result;
+	last_sample = adc_sample;
+	
+	return result; 
+}
+
+#define REF_HPF_B0 0x000322A9	//3.1354
+#define REF_HPF_B1 0x000322A9	//3.1354
+#define REF_HPF_A1 0x0000FEFF	//.99608
+
+static __attribute__((noinline)) int32_t ref_hp_filter(int32_t adc_sample)
+{
+	static int32_t last_sample=NOMINAL_Y_ACCEL;
+	static int32_t last_result = 0x00000000;
+	int32_t result;
+	int32_t temp, temp2, temp3;
+
+	temp = (int32_t)((((int64_t)last_result*REF_HPF_A1))>>16);
+	temp2 = (int32_t)((((int64_t)last_sample*REF_HPF_B1))>>16);
+	temp3 = (int32_t)((((int64_t)adc_sample*REF_HPF_B0))>>16);
+	
+	result = temp-temp2+temp3;
+	last_result = result;
+	last_sample = adc_sample;
+	return result;
+}
+
+typedef struct
+{
+	uint32_t sum;
+	uint16_t max;
+} bench_time_t;
+
+static void bench_record(bench_time_t *time, uint16_t start, uint16_t stop, uint16_t overhead)
+{
+	uint16_t cycles = stop - start - overhead;
+	
+	time->sum += cycles;
+	if(cycles > time->max)
+	{
+		time->max = cycles;
+	}
+}
+
+static uint8_t *bench_put16(uint8_t *payload, uint16_t value)
+{
+	*payload++ = (uint8_t)value;
+	*payload++ = (uint8_t)(value >> 8);
+	return payload;
+}
+
+void filter_benchmark(void)
+{
+	bench_time_t ref_lp = {0,0}, new_lp = {0,0}, ref_hp = {0,0}, new_hp = {0,0}, biquad = {0,0};
+	biquad_state_t biquad_state[BIQUAD_ACCEL_LP_SECTIONS];
+	uint8_t payload[FILTER_BENCH_FRAME_SIZE];
+	uint8_t *p = payload;
+	uint16_t mismatches = 0;
+	uint16_t overhead;
+	uint16_t start, stop;
+	uint8_t timer1_mode;
+	uint16_t i;
+	uint8_t sample = 0x58;
+	int32_t ref_lp_out, new_lp_out, ref_hp_out, new_hp_out;
+	
+	biquad_preload(biquad_accel_lp,biquad_state,BIQUAD_ACCEL_LP_SECTIONS,NOMINAL_Y_ACCEL);
+	
+	//Timer1 in Normal mode, no prescaler, just for counting.  main() has already put the PWM mode bits in
+	//TCCR1A, so those have to come out too.
+	timer1_mode = TCCR1A;
+	TCCR1B = 0x00;
+	TCCR1A = 0x00;
+	TCNT1 = 0x0000;
+	TCCR1B = 0x01;
+	
+	//What two back-to-back reads of TCNT1 cost on their own
+	start = TCNT1;
+	stop = TCNT1;
+	overhead = stop - start;
+	
+	for(i = 0; i < BENCH_SAMPLES; i++)
+	{
+		sample = (sample * 109) + 89;	//8-bit LCG - hits every value once per 256 samples
+		
+		start = TCNT1;
+		ref_lp_out = ref_lp_filter(sample);
+		stop = TCNT1;
+		bench_record(&ref_lp,start,stop,overhead);
+		
+		start = TCNT1;
+		new_lp_out = adc_lp_filter(sample);
+		stop = TCNT1;
+		bench_record(&new_lp,start,stop,overhead);
+		
+		start = TCNT1;
+		ref_hp_out = ref_hp_filter(ref_lp_out);
+		stop = TCNT1;
+		bench_record(&ref_hp,start,stop,overhead);
+		
+		start = TCNT1;
+		new_hp_out = adc_hp_filter(new_lp_out);
+		stop = TCNT1;
+		bench_record(&new_hp,start,stop,overhead);
+		
+		start = TCNT1;
+		biquad_run(biquad_accel_lp,biquad_state,BIQUAD_ACCEL_LP_SECTIONS,(int32_t)sample << 16);
+		stop = TCNT1;
+		bench_record(&biquad,start,stop,overhead);
+		
+		if((ref_lp_out != new_lp_out) || (ref_hp_out != new_hp_out))
+		{
+			mismatches++;
+		}
+	}
+	
+	//Put Timer1 back the way main() left it
+	TCCR1B = 0x00;
+	TCCR1A = timer1_mode;
+	TCNT1 = 0x0000;
+	TIFR1 = 0x27;	//Clear any flags the bench run set - ICF1, OCF1B, OCF1A, TOV1
+	
+	p = bench_put16(p,BENCH_SAMPLES);
+	p = bench_put16(p,(uint16_t)(ref_lp.sum >> BENCH_SAMPLES_SHIFT));
+	p = bench_put16(p,ref_lp.max);
+	p = bench_put16(p,(uint16_t)(new_lp.sum >> BENCH_SAMPLES_SHIFT));
+	p = bench_put16(p,new_lp.max);
+	p = bench_put16(p,(uint16_t)(ref_hp.sum >> BENCH_SAMPLES_SHIFT));
+	p = bench_put16(p,ref_hp.max);
+	p = bench_put16(p,(uint16_t)(new_hp.sum >> BENCH_SAMPLES_SHIFT));
+	p = bench_put16(p,new_hp.max);
+	p = bench_put16(p,mismatches);
+	p = bench_put16(p,(uint16_t)((biquad.sum >> BENCH_SAMPLES_SHIFT) / BIQUAD_ACCEL_LP_SECTIONS));
+	p = bench_put16(p,biquad.max / BIQUAD_ACCEL_LP_SECTIONS);
+	
+	uart_send_frame(CHANNEL_FILTER_BENCH,payload,FILTER_BENCH_FRAME_SIZE);
+}
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * filter_bench.h
+ *
+ * Startup cycle-count comparison of the filters against their original int64_t versions.
+ * Only built when FILTER_BENCHMARK is defined in common.h.
+ */
+
+#ifndef FILTER_BENCH_H_
+#define FILTER_BENCH_H_
+
+#include "common.h"
+
+#ifdef FILTER_BENCHMARK
+
+/*CHANNEL_FILTER_BENCH payload, all 16-bit little-endian:
+ samples, reference LPF mean/max, new LPF mean/max, reference HPF mean/max, new HPF mean/max, the
+ number of samples where either new filter's output differed from the reference, and biquad cycles
+ per section mean/max*/
+#define FILTER_BENCH_FRAME_SIZE 24
+
+void filter_benchmark(void);
+
+#endif
+
+#endif /* FILTER_BENCH_H_ */
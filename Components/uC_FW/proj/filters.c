@@ -0,0 +1,81 @@
+/*
+ * filters.c
+ *
+ * Fixed-point DSP routines for the accelerometer signal chain.
+ *
+ * Everything is Q16.16.  The products used to be done by casting to int64_t, which pulls in
+ * libgcc's __muldi3 - see fixed_point.h for why that's slow and what replaced it.  The results are
+ * bit-for-bit the same as the int64_t versions; filter_bench.c checks that on the target.
+ *
+ * Nothing runs these any more - the signal chain is dsp_chain.c - so they're only built with
+ * FILTER_BENCHMARK, for the bench to time against their originals.
+ */
+
+#include "common.h"
+
+#ifdef FILTER_BENCHMARK
+
+#include <stdint.h>
+
+#include "fixed_point.h"
+#include "filters.h"
+
+/*This starts the fixed-point DSP routine definitions
+ The first filter is a low-pass filter with a pole at 10Hz I believe*/
+
+//Filter coefficients
+//#define B0 .037786f
+//#define B1 .037786f
+//#define A1 -.92443f
+
+//Fixed-point coefficients
+#define LPF_B0 0x000009AC	
+#define LPF_B1 0x000009AC
+#define LPF_A1 0x0000ECA7
+
+int32_t adc_lp_filter(uint8_t adc_sample)
+{
+	static uint8_t last_sample=(NOMINAL_Y_ACCEL>>16);	//Idle
+	static int32_t last_result=NOMINAL_Y_ACCEL;
+	int32_t result;
+	
+	/*An 8-bit sample times a 16-bit fraction is at most 24 bits, so the feed-forward terms are one
+	  8x16 multiply each with no shifting.  The feedback term is a Q16.16 state times a Q16.16
+	  coefficient, which is where the extra 16 decimal bits come from - fix_mul_q16 drops them
+	  without ever forming the 48-bit product*/
+
+	result = (int32_t)(mul_u8_u16(adc_sample,LPF_B0)
+					 + mul_u8_u16(last_sample,LPF_B1)
+					 + (uint32_t)fix_mul_q16(last_result,LPF_A1));
+	
+	last_result = result;
+	last_sample = adc_sample;
+	
+	return result; 
+}
+
+/*This is a high-pass filter with a zero at .1Hz I think
+ This filter aims to remove the random walk that MEMS accelerometers produce - it is not 100% effective*/
+
+#define HPF_B0 0x000322A9	//3.1354
+#define HPF_B1 0x000322A9	//3.1354
+#define HPF_A1 0x0000FEFF	//.99608
+
+int32_t adc_hp_filter(int32_t adc_sample)
+{
+	static int32_t last_sample=NOMINAL_Y_ACCEL;
+	static int32_t last_result = 0x00000000;
+	int32_t result;
+	int32_t temp, temp2, temp3;
+
+	temp = fix_mul_q16(last_result,HPF_A1);
+	temp2 = fix_mul_q16(last_sample,HPF_B1);
+	temp3 = fix_mul_q16(adc_sample,HPF_B0);
+	
+	result = (int32_t)((uint32_t)temp - (uint32_t)temp2 + (uint32_t)temp3);
+	last_result = result;
+	last_sample = adc_sample;
+	return result;
+}
+
+#endif
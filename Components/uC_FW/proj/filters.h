@@ -0,0 +1,18 @@
+/*
+ * filters.h
+ *
+ * Fixed-point DSP routines for the accelerometer signal chain.  Only built when FILTER_BENCHMARK is
+ * defined in common.h - see filters.c.
+ */
+
+#ifndef FILTERS_H_
+#define FILTERS_H_
+
+#include <stdint.h>
+
+#define NOMINAL_Y_ACCEL 0x00580000	//Split the difference between 0x59 and 0x58
+
+int32_t adc_lp_filter(uint8_t adc_sample);
+int32_t adc_hp_filter(int32_t adc_sample);
+
+#endif /* FILTERS_H_ */
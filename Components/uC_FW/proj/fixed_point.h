@@ -0,0 +1,236 @@
+/*
+ * fixed_point.h
+ *
+ * Fixed-point multiply kernels built on the ATMega328's hardware multiplier.
+ *
+ * The obvious way to multiply two Q16.16 numbers in C is to cast to int64_t and shift, and that's
+ * what the filters used to do.  avr-gcc turns that into a call to libgcc's __muldi3 (0x1a6 bytes
+ * in the map file) which is a generic 64x64 multiply built out of 32-bit pieces - hundreds of cycles
+ * to compute a product that's mostly zeros.  The MUL instructions only do 8x8->16 (ATMega328
+ * Datasheet Section 31 - Instruction Set Summary: MUL, MULS, MULSU are 2 cycles each), so the trick
+ * is to split the operands ourselves and only compute the partial products we need.
+ *
+ * All of the states fit in 32 bits and all of the coefficients fit in 16, so everything here boils
+ * down to four kernels:
+ *
+ *	mul_u8_u16	 8-bit unsigned x 16-bit unsigned -> 24-bit unsigned			 2 MULs
+ *	mul_u16_u16	16-bit unsigned x 16-bit unsigned -> 32-bit unsigned			 4 MULs
+ *	mul_s16_u16	16-bit signed   x 16-bit unsigned -> 32-bit signed			 4 MUL/MULSUs
+ *	mul_s16_s16	16-bit signed   x 16-bit signed   -> 32-bit signed			 4 MUL/MULS/MULSUs
+ *
+ * FMUL/FMULS/FMULSU are the 1.7-format versions of the same instructions.  They save a shift when
+ * everything is Q1.15, but our states are Q16.16 so they don't buy anything here.
+ *
+ * On anything that isn't an AVR (the host build) the kernels are plain C with the same results.
+ * host/fixcheck checks everything here against int64_t arithmetic - make test runs it.
+ */
+
+#ifndef FIXED_POINT_H_
+#define FIXED_POINT_H_
+
+#include <stdint.h>
+
+#if defined(__AVR__)
+
+/*10 cycles.  r0/r1 are used by MUL - r1 is avr-gcc's zero register, so it's cleared on the way out.*/
+static inline uint32_t mul_u8_u16(uint8_t a, uint16_t b)
+{
+	uint32_t product;
+
+	__asm__ (
+		"mul  %[a], %A[b]"		"\n\t"	//a * bL
+		"movw %A[p], r0"		"\n\t"
+		"clr  %C[p]"			"\n\t"
+		"clr  %D[p]"			"\n\t"
+		"mul  %[a], %B[b]"		"\n\t"	//a * bH, shifted up one byte
+		"add  %B[p], r0"		"\n\t"
+		"adc  %C[p], r1"		"\n\t"
+		"clr  r1"
+		: [p] "=&r" (product)
+		: [a] "r" (a), [b] "r" (b)
+	);
+	return product;
+}
+
+/*18 cycles*/
+static inline uint32_t mul_u16_u16(uint16_t a, uint16_t b)
+{
+	uint32_t product;
+	uint8_t zero;
+
+	__asm__ (
+		"clr  %[z]"				"\n\t"
+		"mul  %A[a], %A[b]"		"\n\t"	//aL * bL
+		"movw %A[p], r0"		"\n\t"
+		"mul  %B[a], %B[b]"		"\n\t"	//aH * bH, shifted up two bytes
+		"movw %C[p], r0"		"\n\t"
+		"mul  %B[a], %A[b]"		"\n\t"	//aH * bL, shifted up one byte
+		"add  %B[p], r0"		"\n\t"
+		"adc  %C[p], r1"		"\n\t"
+		"adc  %D[p], %[z]"		"\n\t"
+		"mul  %A[a], %B[b]"		"\n\t"	//aL * bH, shifted up one byte
+		"add  %B[p], r0"		"\n\t"
+		"adc  %C[p], r1"		"\n\t"
+		"adc  %D[p], %[z]"		"\n\t"
+		"clr  r1"
+		: [p] "=&r" (product), [z] "=&r" (zero)
+		: [a] "r" (a), [b] "r" (b)
+	);
+	return product;
+}
+
+/*19 cycles.  MULSU only works on r16-r23, hence the "a" constraints.  MULSU leaves bit 15 of its
+ result in the carry flag, and the SBC right after it sign-extends that partial product into the top
+ byte - same as the muls16x16_32 routine in Atmel app note AVR201.*/
+static inline int32_t mul_s16_u16(int16_t a, uint16_t b)
+{
+	int32_t product;
+	uint8_t zero;
+
+	__asm__ (
+		"clr   %[z]"			"\n\t"
+		"mul   %A[a], %A[b]"	"\n\t"	//aL * bL - both unsigned
+		"movw  %A[p], r0"		"\n\t"
+		"mulsu %B[a], %B[b]"	"\n\t"	//(signed)aH * bH, shifted up two bytes
+		"movw  %C[p], r0"		"\n\t"
+		"mulsu %B[a], %A[b]"	"\n\t"	//(signed)aH * bL, shifted up one byte
+		"sbc   %D[p], %[z]"		"\n\t"	//Sign-extend it
+		"add   %B[p], r0"		"\n\t"
+		"adc   %C[p], r1"		"\n\t"
+		"adc   %D[p], %[z]"		"\n\t"
+		"mul   %A[a], %B[b]"	"\n\t"	//aL * bH - both unsigned
+		"add   %B[p], r0"		"\n\t"
+		"adc   %C[p], r1"		"\n\t"
+		"adc   %D[p], %[z]"		"\n\t"
+		"clr   r1"
+		: [p] "=&r" (product), [z] "=&r" (zero)
+		: [a] "a" (a), [b] "a" (b)
+	);
+	return product;
+}
+
+/*20 cycles.  MULS and MULSU only work on r16-r23.  Same as mul_s16_u16, except bH is signed too, so
+ the aL * bH partial product needs sign-extending as well.  This is muls16x16_32 from AVR201.*/
+static inline int32_t mul_s16_s16(int16_t a, int16_t b)
+{
+	int32_t product;
+	uint8_t zero;
+
+	__asm__ (
+		"clr   %[z]"			"\n\t"
+		"muls  %B[a], %B[b]"	"\n\t"	//(signed)aH * (signed)bH, shifted up two bytes
+		"movw  %C[p], r0"		"\n\t"
+		"mul   %A[a], %A[b]"	"\n\t"	//aL * bL - both unsigned
+		"movw  %A[p], r0"		"\n\t"
+		"mulsu %B[a], %A[b]"	"\n\t"	//(signed)aH * bL, shifted up one byte
+		"sbc   %D[p], %[z]"		"\n\t"	//Sign-extend it
+		"add   %B[p], r0"		"\n\t"
+		"adc   %C[p], r1"		"\n\t"
+		"adc   %D[p], %[z]"		"\n\t"
+		"mulsu %B[b], %A[a]"	"\n\t"	//(signed)bH * aL, shifted up one byte
+		"sbc   %D[p], %[z]"		"\n\t"	//Sign-extend it
+		"add   %B[p], r0"		"\n\t"
+		"adc   %C[p], r1"		"\n\t"
+		"adc   %D[p], %[z]"		"\n\t"
+		"clr   r1"
+		: [p] "=&r" (product), [z] "=&r" (zero)
+		: [a] "a" (a), [b] "a" (b)
+	);
+	return product;
+}
+
+#else
+
+static inline uint32_t mul_u8_u16(uint8_t a, uint16_t b)
+{
+	return (uint32_t)a * b;
+}
+
+static inline uint32_t mul_u16_u16(uint16_t a, uint16_t b)
+{
+	return (uint32_t)a * b;
+}
+
+static inline int32_t mul_s16_u16(int16_t a, uint16_t b)
+{
+	return (int32_t)a * (int32_t)b;
+}
+
+static inline int32_t mul_s16_s16(int16_t a, int16_t b)
+{
+	return (int32_t)a * (int32_t)b;
+}
+
+#endif
+
+/*Multiply a Q16.16 value by a non-negative Q16.16 coefficient: (int32_t)(((int64_t)x * c) >> 16)
+ with exactly the same bits, including the wrap if the answer doesn't fit in 32 bits.
+
+ Split x into its signed top half h and unsigned bottom half l, and c into its integer part ci and
+ fraction cf.  Then
+
+	x * c >> 16 = x * ci + h * cf + ((l * cf) >> 16)
+
+ exactly - every term that got dropped by the >>16 was a whole multiple of 65536, so nothing is
+ rounded any differently.  The sum is done in uint32_t so the wrap is the same as the truncating
+ cast in the 64-bit version.
+
+ This is meant to be inlined with a constant c: for the usual case of a coefficient below 1.0 the
+ ci term disappears and the whole thing is two 16x16 multiplies.*/
+static inline int32_t fix_mul_q16(int32_t x, uint32_t c)
+{
+	uint16_t c_frac = (uint16_t)c;
+	uint16_t c_int = (uint16_t)(c >> 16);
+	uint32_t result;
+
+	result = (uint32_t)mul_s16_u16((int16_t)(x >> 16),c_frac)
+		   + (mul_u16_u16((uint16_t)x,c_frac) >> 16);
+
+	if(0 != c_int)
+	{
+		result += (uint32_t)x * c_int;
+	}
+
+	return (int32_t)result;
+}
+
+/*Exact multiply-accumulate of Q16.16 values times signed 16-bit coefficients.
+
+ Adding up products that have each been truncated to 32 bits doesn't give the same answer as
+ truncating the sum - each one can be off by an LSB.  That matters for something like a high-pass
+ with b = [k, -2k, k], where the products are meant to cancel exactly on a DC input.  So the top of
+ each 48-bit product goes into 'high' and the bottom 16 bits into 'low', which can soak up 65536 of
+ them before overflowing.  fix_acc_shift then rounds the whole sum down once.*/
+typedef struct
+{
+	uint32_t high;		//Sum of the products' bits 16-47
+	uint32_t low;		//Sum of the products' bits 0-15
+} fix_acc_t;
+
+/*acc += x * c.  ~50 cycles*/
+static inline void fix_mac_s16(fix_acc_t *acc, int32_t x, int16_t c)
+{
+	int32_t low_product = mul_s16_u16(c,(uint16_t)x);	//c times the unsigned bottom half of x
+	
+	acc->high += (uint32_t)mul_s16_s16((int16_t)(x >> 16),c) + (uint32_t)(low_product >> 16);
+	acc->low += (uint16_t)low_product;
+}
+
+/*floor(sum / 2^shift), truncated to 32 bits.  shift can be anything from 0 to 47 - it's the number of
+ fraction bits in the coefficients.  Only bits 0-47 of the sum are kept, so past a shift of 16 the sum
+ has to fit in 48 bits (+/-2^47) for the answer to match the int64_t one.  The biquads are nowhere near
+ that: Q16.16 samples under 2^28 times 16-bit coefficients are under 2^43 apiece.*/
+static inline int32_t fix_acc_shift(const fix_acc_t *acc, uint8_t shift)
+{
+	uint32_t high = acc->high + (acc->low >> 16);		//floor(sum / 2^16)
+	uint16_t remainder = (uint16_t)acc->low;			//sum mod 2^16
+	
+	if(shift >= 16)
+	{
+		return (int32_t)high >> (shift - 16);
+	}
+	
+	return (int32_t)((high << (16 - shift)) + (remainder >> shift));
+}
+
+#endif /* FIXED_POINT_H_ */
@@ -0,0 +1,119 @@
+/*
+ * freefall.c
+ *
+ * 0g-detect pin change interrupt, debounce and event log - see freefall.h.
+ */
+
+#include "common.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "power.h"
+#include "trace.h"
+#include "uart.h"
+#include "lights.h"
+#include "scheduler.h"
+#include "blackbox.h"
+#include "freefall.h"
+
+typedef struct
+{
+	uint16_t number;
+	uint32_t stamp;
+} freefall_event_t;
+
+volatile uint8_t freefall_holdoff = 0;
+
+/*Falls seen since reset*/
+static uint16_t freefall_events = 0;
+
+/*The ISR owns head and the command task owns tail, like ring_buffer.h.  One slot is always left empty.*/
+static freefall_event_t freefall_log[FREEFALL_LOG_SIZE];
+static volatile uint8_t freefall_head = 0;
+static volatile uint8_t freefall_tail = 0;
+
+/*PC3 and its pin change interrupt.  ADC3's digital input buffer has to be left on for this to see
+ anything - see DIDR0 in main().*/
+void freefall_init(void)
+{
+	//ATMega328 Datasheet Table 14-1 Pg 78
+	//PC3 - input, no pullup.  The accelerometer drives it both ways.
+	CLEAR(DDRC,3);
+	CLEAR(PORTC,3);
+	
+	//ATMega328 Datasheet Section 12.2.7 - PCMSK1 - Bit 3 - PCINT11 is PC3
+	PCMSK1 = (0x01 << 3);
+	
+	//Section 12.2.5 - PCIFR - clear anything left over from setting the pin up (write a 1)
+	PCIFR = (0x01 << 1);
+	
+	//Section 12.2.4 - PCICR - Bit 1 - PCIE1 - pin change interrupt for PCINT14:8
+	PCICR = (0x01 << 1);
+}
+
+//ATMega328 Datasheet Section 11.1 Table 11-1 - Pin Change Interrupt Request 1 (PCINT14:8)
+ISR(PCINT1_vect)
+{
+	uint8_t head;
+	
+	power_woke();
+	TRACE_ISR_ENTER(TRACE_ID_FREEFALL_ISR);
+	
+	//A pin change interrupt goes off on either edge.  Only high is a fall - if it's already low again it was
+	//a glitch shorter than getting here, and that's not a fall either.
+	if(0 != READ(PINC,3))
+	{
+		//The lights first - that's the part anybody sees
+		lights_alert(FREEFALL_FLASH_TICKS);
+		blackbox_freefall();
+		
+		freefall_events++;
+		head = freefall_head;
+		if(((head + 1) & FREEFALL_LOG_MASK) != freefall_tail)
+		{
+			freefall_log[head].number = freefall_events;
+			freefall_log[head].stamp = sched_now();
+			freefall_head = (head + 1) & FREEFALL_LOG_MASK;
+		}
+		
+		//Off until freefall_tick() has seen the pin stay low for long enough
+		CLEAR(PCMSK1,3);
+		freefall_holdoff = FREEFALL_QUIET_TICKS;
+		
+		//Section 12.2.5 - PCIFR bit 1 - PCIF1.  The pin's bounced while we were in here, before PCMSK1 went
+		//off, and every one of those edges set the flag again.  Left set, this ISR runs again the moment it
+		//returns - and if the pin's bounced back high by then, that's a second fall for one drop.
+		PCIFR = (0x01 << 1);
+	}
+	
+	TRACE_ISR_EXIT(TRACE_ID_FREEFALL_ISR);
+}
+
+/*Send the logged events, a frame each, whenever the UART queue has room.  Call this regularly from the
+ main loop.*/
+void freefall_service(void)
+{
+	uint8_t payload[FREEFALL_FRAME_SIZE];
+	freefall_event_t *event;
+	
+	while(freefall_tail != freefall_head)
+	{
+		if(uart_tx_free() < (FREEFALL_FRAME_SIZE + UART_FRAME_OVERHEAD))
+		{
+			return;
+		}
+		
+		event = &freefall_log[freefall_tail];
+		payload[0] = (uint8_t)(event->number);
+		payload[1] = (uint8_t)(event->number >> 8);
+		payload[2] = (uint8_t)(event->stamp);
+		payload[3] = (uint8_t)(event->stamp >> 8);
+		payload[4] = (uint8_t)(event->stamp >> 16);
+		payload[5] = (uint8_t)(event->stamp >> 24);
+		uart_send_frame(CHANNEL_FREEFALL,payload,FREEFALL_FRAME_SIZE);
+		
+		//Hand the slot back only after it's been read
+		freefall_tail = (freefall_tail + 1) & FREEFALL_LOG_MASK;
+	}
+}
@@ -0,0 +1,84 @@
+/*
+ * freefall.h
+ *
+ * Free-fall detection off the accelerometer's 0g-detect output.
+ *
+ * The MMA7361L drives its 0g-detect pin high when all three axes read 0g at once - it's falling.  That's
+ * a logic output, not an analog one, so it doesn't need the ADC at all.  It used to be converted once
+ * every tick at the end of the scan and never looked at; read that way it would have been up to a tick
+ * and a Y conversion behind.  Now the ADC scan is just X, Y and Z, and the pin (PC3, which is also ADC3)
+ * has a pin change interrupt of its own, PCINT11.  It reacts as soon as whatever ISR is running
+ * finishes - the tick ISR is the longest at a few hundred cycles, so well under 50us - and it costs
+ * nothing at all until the pin moves.
+ *
+ * Why not the analog comparator: it compares AIN0 against AIN1 or an ADC mux input, and the mux is busy
+ * with the scan.  The pin is already a clean logic level, so a pin change does the job with none of that.
+ *
+ * When the pin goes high the ISR:
+ *	1) Flashes all the lights, on the spot - lights_alert() takes the pins off the timers, so it doesn't
+ *	   wait for a PWM period or the next tick.  Whatever the lights were doing carries on underneath.
+ *	2) Stamps the event with sched_now() and puts it in a small log for the command task to send.
+ *	3) Turns its own interrupt off, and throws away any edges the pin made while it was running.
+ *
+ * Debounce: the 0g-detect output chatters as a fall starts and ends, and a jump or a hard landing can
+ * bounce it too.  Rather than see every edge, the ISR turns itself off after the first one and
+ * freefall_tick() turns it back on once the pin has been low for FREEFALL_QUIET_TICKS in a row.  So one
+ * fall is one event, however it bounces, and the tick ISR only pays for a compare when nothing's happening.
+ *
+ * The log goes out from the command task as CHANNEL_FREEFALL frames, 6 bytes each, all
+ * little-endian:
+ *
+ *	Byte	Contents
+ *	-------------------------------------------------------------
+ *	0..1	Event number, counting from 1 since reset - a gap means the log overflowed
+ *	2..5	sched_now() just after the lights went on, in CPU cycles, 32-bit little-endian.  That's a
+ *			couple of hundred cycles after the edge.  It wraps every 2^32 cycles, about 9 minutes.
+ */
+
+#ifndef FREEFALL_H_
+#define FREEFALL_H_
+
+#include "common.h"
+
+#include <avr/io.h>
+
+/*How long the lights flash for - 2 seconds*/
+#define FREEFALL_FLASH_TICKS (TICK_HZ * 2)
+
+/*The pin has to be low this long before another fall can be seen - 100ms*/
+#define FREEFALL_QUIET_TICKS (TICK_HZ / 10)
+
+/*Events waiting to be sent - a power of two*/
+#define FREEFALL_LOG_SIZE 8
+#define FREEFALL_LOG_MASK (FREEFALL_LOG_SIZE - 1)
+
+/*CHANNEL_FREEFALL payload*/
+#define FREEFALL_FRAME_SIZE 6
+
+/*Ticks left before the interrupt is turned back on - 0 while it's on*/
+extern volatile uint8_t freefall_holdoff;
+
+void freefall_init(void);
+void freefall_service(void);
+
+/*Call from the tick ISR.  One compare when there's nothing to debounce.*/
+static inline void freefall_tick(void)
+{
+	if(0 != freefall_holdoff)
+	{
+		//ATMega328 Datasheet Section 14.4.6 - PINC bit 3 is the 0g-detect pin
+		if(0 != READ(PINC,3))
+		{
+			freefall_holdoff = FREEFALL_QUIET_TICKS;	//Still falling, or bouncing - start the quiet time over
+		}
+		else if(0 == --freefall_holdoff)
+		{
+			//Section 12.2.5 - PCIFR bit 1 - PCIF1.  It's been set by every edge since the ISR turned itself off,
+			//so clear it (by writing a 1) or the interrupt goes off the moment it's turned back on.
+			PCIFR = (0x01 << 1);
+			SET(PCMSK1,3);
+		}
+	}
+}
+
+#endif /* FREEFALL_H_ */
@@ -0,0 +1,73 @@
+/*
+ * gamma_tables.c
+ *
+ * Generated by tools/gamma_gen - do not edit.
+ */
+
+#include "gamma_tables.h"
+
+const uint8_t gamma_timer0[GAMMA_LEVELS] PROGMEM =
+{
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   1,   1,
+	  2,   2,   2,   2,   2,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,
+	  5,   6,   6,   6,   7,   7,   7,   8,   8,   8,   9,   9,  10,  10,  10,  11,
+	 11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,
+	 19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,  26,  26,  27,  27,  28,
+	 29,  30,  30,  31,  32,  32,  33,  34,  35,  35,  36,  37,  38,  38,  39,  40,
+	 41,  42,  43,  43,  44,  45,  46,  47,  48,  49,  50,  50,  51,  52,  53,  54,
+	 55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  69,  70,  71,
+	 72,  73,  74,  75,  76,  77,  79,  80,  81,  82,  83,  85,  86,  87,  88,  90,
+	 91,  92,  93,  95,  96,  97,  99, 100, 101, 103, 104, 105, 107, 108, 109, 111,
+	112, 114, 115, 117, 118, 119, 121, 122, 124, 125, 127, 128, 130, 131, 133, 135,
+	136, 138, 139, 141, 142, 144, 146, 147, 149, 151, 152, 154, 156, 157, 159, 161,
+	163, 164, 166, 168, 170, 171, 173, 175, 177, 178, 180, 182, 184, 186, 188, 190,
+	191, 193, 195, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+	223, 225, 227, 229, 231, 233, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+const uint16_t gamma_timer1[GAMMA_LEVELS] PROGMEM =
+{
+	    0,     0,     0,     0,     0,     1,     2,     3,     4,     5,     7,     9,
+	   11,    13,    16,    19,    22,    25,    28,    32,    36,    40,    45,    49,
+	   54,    59,    65,    71,    77,    83,    89,    96,   103,   110,   118,   126,
+	  134,   142,   151,   160,   169,   178,   188,   198,   209,   219,   230,   241,
+	  253,   264,   277,   289,   302,   315,   328,   341,   355,   369,   384,   398,
+	  414,   429,   445,   460,   477,   493,   510,   527,   545,   563,   581,   599,
+	  618,   637,   657,   676,   696,   717,   737,   758,   780,   801,   823,   845,
+	  868,   891,   914,   938,   962,   986,  1010,  1035,  1061,  1086,  1112,  1138,
+	 1165,  1192,  1219,  1246,  1274,  1303,  1331,  1360,  1389,  1419,  1449,  1479,
+	 1510,  1541,  1572,  1603,  1635,  1668,  1700,  1733,  1767,  1800,  1834,  1869,
+	 1904,  1939,  1974,  2010,  2046,  2083,  2119,  2157,  2194,  2232,  2270,  2309,
+	 2348,  2387,  2427,  2467,  2507,  2548,  2589,  2631,  2673,  2715,  2757,  2800,
+	 2844,  2887,  2931,  2976,  3020,  3065,  3111,  3157,  3203,  3249,  3296,  3344,
+	 3391,  3439,  3488,  3536,  3586,  3635,  3685,  3735,  3786,  3837,  3888,  3940,
+	 3992,  4044,  4097,  4150,  4204,  4258,  4312,  4367,  4422,  4478,  4534,  4590,
+	 4646,  4703,  4761,  4819,  4877,  4935,  4994,  5053,  5113,  5173,  5233,  5294,
+	 5355,  5417,  5479,  5541,  5604,  5667,  5731,  5794,  5859,  5923,  5988,  6054,
+	 6120,  6186,  6252,  6319,  6387,  6455,  6523,  6591,  6660,  6729,  6799,  6869,
+	 6940,  7011,  7082,  7154,  7226,  7298,  7371,  7444,  7518,  7592,  7666,  7741,
+	 7817,  7892,  7968,  8045,  8121,  8199,  8276,  8354,  8433,  8512,  8591,  8670,
+	 8750,  8831,  8912,  8993,  9074,  9157,  9239,  9322,  9405,  9489,  9573,  9657,
+	 9742,  9827,  9913,  9999,
+};
+
+const uint8_t gamma_bam[GAMMA_LEVELS] PROGMEM =
+{
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+	  1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+	  3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+	  6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+	 12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+	 20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+	 30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+	 42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+	 56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+	 73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+	 91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+	113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+	137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+	163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+	192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+	223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
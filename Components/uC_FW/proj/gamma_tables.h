@@ -0,0 +1,26 @@
+/*
+ * gamma_tables.h
+ *
+ * Generated by tools/gamma_gen - do not edit.
+ */
+
+#ifndef GAMMA_TABLES_H_
+#define GAMMA_TABLES_H_
+
+#include <stdint.h>
+
+#include "progmem.h"
+
+#define GAMMA_LEVELS 256
+#define GAMMA_TIMER1_TOP 9999
+
+/*Brightness to OCR0x, gamma 2.2*/
+extern const uint8_t gamma_timer0[GAMMA_LEVELS] PROGMEM;
+
+/*Brightness to OCR1A with TOP = 9999, gamma 2.2*/
+extern const uint16_t gamma_timer1[GAMMA_LEVELS] PROGMEM;
+
+/*Brightness to a bit angle modulation level, gamma 2.2*/
+extern const uint8_t gamma_bam[GAMMA_LEVELS] PROGMEM;
+
+#endif /* GAMMA_TABLES_H_ */
@@ -0,0 +1,311 @@
+/*
+ * lights.c
+ *
+ * Hardware PWM light driver, or bit angle modulation with LIGHTS_BAM - see lights.h.
+ */
+
+#include "common.h"
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "progmem.h"
+#include "gamma_tables.h"
+#include "lights.h"
+#include "bam.h"
+
+#if GAMMA_TIMER1_TOP != ((F_CPU/TICK_HZ) - 1)
+#error "gamma_tables.c was generated for a different Timer1 TOP - fix TIMER1_TOP in tools/Makefile"
+#endif
+
+/*Brightness and fades are kept as 8.8 fixed point so slow fades still move a fraction of a step every tick*/
+typedef struct
+{
+	uint16_t level;		//Current brightness, 8.8
+	int16_t step;		//Added every tick while fading, 8.8
+	uint16_t remaining;	//Ticks left in the fade - 0 when it isn't fading
+	uint8_t target;		//Where the fade ends
+} light_t;
+
+static light_t lights[LIGHT_CHANNELS];
+
+/*Ticks left in the alert - 0 when there isn't one.  While it's running the pins belong to the alert and
+ light_output() isn't called.*/
+static uint16_t alert_remaining = 0;
+static uint8_t alert_flash = 0;		//Ticks left in this half of the flash
+static boolean alert_on = FALSE;
+
+#ifdef LIGHTS_BAM
+
+/*The first BAM channels are the lights, in the same order.  A BAM level of 0 is really off, so there's
+ nothing special about it here.*/
+static void light_output(uint8_t light, uint8_t brightness)
+{
+	bam_set(light,pgm_read_byte(&gamma_bam[brightness]));
+}
+
+/*bam_apply() puts it on the pins right now, not at the end of the period*/
+static void light_alert_output(boolean on)
+{
+	uint8_t i;
+	
+	for(i = 0; i < LIGHT_CHANNELS; i++)
+	{
+		bam_set(i,(FALSE == on) ? 0 : 0xFF);
+	}
+	bam_apply();
+}
+
+static void light_restore(void)
+{
+	uint8_t i;
+	
+	for(i = 0; i < LIGHT_CHANNELS; i++)
+	{
+		light_output(i,(uint8_t)(lights[i].level >> 8));
+	}
+	bam_apply();
+}
+
+#else
+
+/*Put a brightness on the pin.  For 0 the pin is taken off the timer (COMnx1:0 = 00) so the PORT bit,
+ which is always 0, drives it low.*/
+static void light_output(uint8_t light, uint8_t brightness)
+{
+	switch(light)
+	{
+		case LIGHT_GREEN:
+			//ATMega328 Datasheet Section 16.11.1 - TCCR1A bits 7:6 - COM1A1:0
+			if(LIGHT_OFF == brightness)
+			{
+				CLEAR(TCCR1A,7);
+			}
+			else
+			{
+				OCR1A = pgm_read_word(&gamma_timer1[brightness]);
+				SET(TCCR1A,7);	//Non-inverting: set at BOTTOM, clear on compare match
+			}
+			break;
+		case LIGHT_YELLOW:
+			//ATMega328 Datasheet Section 15.9.1 - TCCR0A bits 7:6 - COM0A1:0
+			if(LIGHT_OFF == brightness)
+			{
+				CLEAR(TCCR0A,7);
+			}
+			else
+			{
+				OCR0A = pgm_read_byte(&gamma_timer0[brightness]);
+				SET(TCCR0A,7);
+			}
+			break;
+		case LIGHT_RED:
+			//TCCR0A bits 5:4 - COM0B1:0
+			if(LIGHT_OFF == brightness)
+			{
+				CLEAR(TCCR0A,5);
+			}
+			else
+			{
+				OCR0B = pgm_read_byte(&gamma_timer0[brightness]);
+				SET(TCCR0A,5);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/*All three pins on or off together, taken off the timers.  The PORT bits are set first so a pin that's
+ already on doesn't blink off as it's disconnected.  Every bit here is changed with interrupts off
+ (from the tick ISR, the free-fall ISR or inside an ATOMIC_BLOCK), so the read-modify-writes are safe.*/
+static void light_alert_output(boolean on)
+{
+	if(FALSE == on)
+	{
+		CLEAR(PORTB,1);
+		PORTD &= ~((0x01 << 6) | (0x01 << 5));
+	}
+	else
+	{
+		SET(PORTB,1);
+		PORTD |= (0x01 << 6) | (0x01 << 5);
+	}
+	
+	CLEAR(TCCR1A,7);							//COM1A1 - green off Timer1
+	TCCR0A &= ~((0x01 << 7) | (0x01 << 5));		//COM0A1 and COM0B1 - yellow and red off Timer0
+}
+
+/*Give the pins back to the timers at whatever brightness the lights have got to.  The PORT bits go back
+ to 0 first - that's what 'off' relies on.*/
+static void light_restore(void)
+{
+	uint8_t i;
+	
+	light_alert_output(FALSE);
+	for(i = 0; i < LIGHT_CHANNELS; i++)
+	{
+		light_output(i,(uint8_t)(lights[i].level >> 8));
+	}
+}
+
+#endif
+
+/*Timer0 and the pins.  Timer1's waveform mode is set up with the tick in main() - this only uses OC1A.
+ With LIGHTS_BAM it's Timer2 and the pins, and bam_init() does both.*/
+void lights_init(void)
+{
+	uint8_t i;
+	
+#ifdef LIGHTS_BAM
+	bam_init();
+#else
+	//As per ATMega Datasheet Section 15.9.1 Page 105 Paragraph 1: the DDRn bits for the output compare lines
+	//must be set to output for any of this to work.  The PORT bits stay 0, which is what a disconnected
+	//pin shows - that's how 'off' is really off.
+	CLEAR(PORTB,1);
+	SET(DDRB,1);	//Green - OC1A
+	CLEAR(PORTD,6);
+	SET(DDRD,6);	//Yellow - OC0A
+	CLEAR(PORTD,5);
+	SET(DDRD,5);	//Red - OC0B
+	
+	//Fast PWM mode for Timer 0 
+	//Count increases from 0x00 to 0xFF
+	//It is SET at 0x00 and is CLEARED when it matches the output compare 
+	//Period is set only according to the source
+	
+	TCNT0 = 0x00;
+	//ATMega328 Datasheet Section 15.9.1 Pg 105 - TCCR0A
+	//Both outputs start disconnected (off) - light_output() connects them
+	TCCR0A =	(0x00<<6) |	//Output A (yellow) disconnected
+				(0x00<<4) |	//Output B (red) disconnected
+				(0x03);		//Fast PWM mode 3: Run from 0x00 to 0xFF
+	
+	//ATMega328 Datasheet Section 15.9.6 - TIMSK0
+	TIMSK0 =	0x00;		//No interrupts needed - the fades run off the tick
+	
+	//ATMega328 Datasheet Section 15.9.2 Pg 108 - TCCR0B
+	TCCR0B =	(0x00<<7) |	//Force output compare A - not needed because of PWM
+				(0x00<<6) |	//Force output compare B - not needed because of PWM mode
+				(0x00<<3) |	//WGM most-significant bit - should be set to 0 for this mode
+				(0x01);		//Clock-select = 1 - no prescaling, 8MHz/256 = 31.25kHz period
+#endif
+	
+	for(i = 0; i < LIGHT_CHANNELS; i++)
+	{
+		lights[i].level = 0;
+		lights[i].step = 0;
+		lights[i].remaining = 0;
+		lights[i].target = LIGHT_OFF;
+		light_output(i,LIGHT_OFF);
+	}
+}
+
+/*Jump straight to a brightness, cancelling any fade*/
+void lights_set(uint8_t light, uint8_t brightness)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		lights[light].remaining = 0;
+		lights[light].target = brightness;
+		lights[light].level = (uint16_t)brightness << 8;
+		if(0 == alert_remaining)
+		{
+			light_output(light,brightness);
+		}
+	}
+}
+
+/*Fade from wherever the light is now to brightness over this many ticks*/
+void lights_fade(uint8_t light, uint8_t brightness, uint16_t ticks)
+{
+	int32_t distance;
+	
+	if(0 == ticks)
+	{
+		lights_set(light,brightness);
+		return;
+	}
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		//One divide per fade, here in the main loop - the ISR only adds
+		distance = ((int32_t)brightness << 8) - (int32_t)lights[light].level;
+		lights[light].step = (int16_t)(distance / ticks);
+		lights[light].target = brightness;
+		lights[light].remaining = ticks;
+	}
+}
+
+/*Flash all three lights for this many ticks, starting with them on right now.  Safe to call from an ISR -
+ that's what it's for.  Another alert while one is running starts the flash over; 0 ends it early.*/
+void lights_alert(uint16_t ticks)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if(0 == ticks)
+		{
+			if(0 != alert_remaining)
+			{
+				alert_remaining = 0;
+				light_restore();
+			}
+		}
+		else
+		{
+			light_alert_output(TRUE);
+			alert_on = TRUE;
+			alert_flash = LIGHTS_ALERT_FLASH_TICKS;
+			alert_remaining = ticks;
+		}
+	}
+}
+
+/*Advance the fades by one tick.  Called from the tick ISR - about 40 cycles per light that's fading and
+ 10 per light that isn't.  While an alert is flashing the fades still move, they just don't reach the
+ pins until it's over.*/
+void lights_tick(void)
+{
+	light_t *light = lights;
+	uint8_t i;
+	
+	if(0 != alert_remaining)
+	{
+		alert_remaining--;
+		if(0 == alert_remaining)
+		{
+			light_restore();
+		}
+		else if(0 == --alert_flash)
+		{
+			alert_flash = LIGHTS_ALERT_FLASH_TICKS;
+			alert_on = NOT(alert_on);
+			light_alert_output(alert_on);
+		}
+	}
+	
+	for(i = 0; i < LIGHT_CHANNELS; i++, light++)
+	{
+		if(0 == light->remaining)
+		{
+			continue;
+		}
+		
+		light->remaining--;
+		if(0 == light->remaining)
+		{
+			//Land exactly on the target whatever the rounding of step did on the way
+			light->level = (uint16_t)light->target << 8;
+		}
+		else
+		{
+			light->level += light->step;
+		}
+		
+		if(0 == alert_remaining)
+		{
+			light_output(i,(uint8_t)(light->level >> 8));
+		}
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * lights.h
+ *
+ * The three streetlight channels, all on hardware PWM, with gamma correction and timed fades.
+ *
+ *	Light	Pin		Output	Timer
+ *	--------------------------------------------------------------
+ *	Green	PB1		OC1A	Timer1, fast PWM mode 14 - shares the system tick, 800Hz
+ *	Yellow	PD6		OC0A	Timer0, fast PWM mode 3, 31.25kHz
+ *	Red		PD5		OC0B	Timer0, fast PWM mode 3, 31.25kHz
+ *
+ * Brightness is 0 (off) to 255 (full) and goes through the gamma tables from tools/gamma_gen, so a
+ * fade looks even to the eye.  0 is really off: fast PWM can't do 0% (a compare value of 0 is still a
+ * one-count spike - the old code found that out the hard way), so for 0 the pin is disconnected from
+ * the timer and driven low as a plain output instead.
+ *
+ * Fades are run from the tick ISR: lights_fade() works out a per-tick step once, and lights_tick()
+ * adds it and writes the compare register.  The compare registers are double-buffered in PWM mode, so
+ * a change never glitches the output in the middle of a period, and the main loop never waits for
+ * anything.
+ *
+ * Alerts: lights_alert() takes the pins away from whatever the lights are doing and flashes all three
+ * together - the free-fall detector uses it (see freefall.h).  It has to look instant, so it doesn't wait
+ * for a PWM period: the pins are disconnected from the timers and driven as plain outputs, which
+ * happens on the next instruction (ATMega328 Datasheet Section 14.3 - with the COM bits at 0 the port
+ * gets the pin back).  The levels and fades carry on underneath while it flashes, so when the alert runs
+ * out each light goes straight back to where it would have been.
+ *
+ * With LIGHTS_BAM on (common.h) none of the above timers are used: the three lights are the first three
+ * channels of the bit angle modulation driver on Timer2 (see bam.h), through a gamma table of their own.
+ * Everything here works the same - fades still run from the tick, 0 is still really off, and an alert
+ * still reaches the pins on the spot - but the PWM is 245Hz on all three, and bam_set() can dim five more
+ * outputs alongside them.
+ */
+
+#ifndef LIGHTS_H_
+#define LIGHTS_H_
+
+#include "common.h"
+
+enum Light_Channels
+{
+	LIGHT_GREEN = 0,
+	LIGHT_YELLOW,
+	LIGHT_RED,
+	LIGHT_CHANNELS
+};
+
+#define LIGHT_OFF 0x00
+#define LIGHT_FULL 0xFF
+
+/*Ticks each half of an alert flash lasts - 64 is 80ms on, 80ms off*/
+#define LIGHTS_ALERT_FLASH_TICKS 64
+
+void lights_init(void);
+void lights_set(uint8_t light, uint8_t brightness);
+void lights_fade(uint8_t light, uint8_t brightness, uint16_t ticks);
+void lights_alert(uint16_t ticks);
+void lights_tick(void);
+
+#endif /* LIGHTS_H_ */
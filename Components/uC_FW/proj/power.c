@@ -0,0 +1,107 @@
+/*
+ * power.c
+ *
+ * Clock gating, Idle sleep and duty-cycle measurement - see power.h.
+ */
+
+#include "common.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#include "power.h"
+
+volatile boolean power_sleeping = FALSE;
+volatile uint16_t power_sleep_start = 0;
+volatile uint32_t power_sleep_cycles = 0;
+
+/*Cycles spent awake in the last whole second, latched by power_tick()*/
+static volatile uint32_t power_awake_cycles = POWER_CYCLES_PER_SECOND;
+
+void power_init(void)
+{
+	//ATMega328 Datasheet Section 10.11.3 - PRR - Power Reduction Register
+	//A 1 stops the clock to that peripheral.  Writes to a stopped peripheral's registers are ignored, so
+	//only the ones this project doesn't touch are turned off:
+	//Bit 7 - PRTWI - TWI - not used: 1
+	//Bit 6 - PRTIM2 - Timer2 - not used: 1, unless it's running the lights (LIGHTS_BAM): 0
+	//Bit 5 - PRTIM0 - Timer0 - light PWM: 0, unless the lights are on Timer2: 1
+	//Bit 3 - PRTIM1 - Timer1 - the tick and the ADC trigger: 0
+	//Bit 2 - PRSPI - SPI - only the programmer uses those pins: 1
+	//Bit 1 - PRUSART0 - the debug UART: 0
+	//Bit 0 - PRADC - the accelerometer: 0
+#ifdef LIGHTS_BAM
+	PRR =	(0x01 << 7)
+		|	(0x01 << 5)
+		|	(0x01 << 2);
+#else
+	PRR =	(0x01 << 7)
+		|	(0x01 << 6)
+		|	(0x01 << 2);
+#endif
+	
+	//ATMega328 Datasheet Section 23.3.2 - ACSR
+	//Bit 7 - ACD - Analog comparator disable.  Nobody uses it, and it draws current whether or not
+	//anything is listening: 1
+	ACSR = (0x01 << 7);
+	
+	//Section 10.1 Table 10-1 - Idle stops only clkCPU and clkFLASH
+	set_sleep_mode(SLEEP_MODE_IDLE);
+}
+
+/*Sleep until the next interrupt.  Call with interrupts disabled, after checking there's nothing to
+ do - otherwise an interrupt that arrives between the check and the SLEEP would leave the CPU asleep
+ with work waiting.  Interrupts are enabled again on the way out.*/
+void power_idle(void)
+{
+	power_sleep_start = TCNT1;
+	power_sleeping = TRUE;
+	
+	sleep_enable();
+	//The instruction after SEI always runs before any interrupt, so nothing can sneak in between
+	//these two and the CPU can't miss its wake-up (Section 7.7 - Reset and Interrupt Handling)
+	sei();
+	sleep_cpu();
+	sleep_disable();
+}
+
+/*Sleep cycles counted up to the last tick*/
+static uint32_t power_last_sleep_cycles = 0;
+
+/*Call from the tick ISR, after power_woke().  Returns how many cycles of the tick that just ended the
+ CPU was awake.*/
+uint16_t power_tick(void)
+{
+	static uint16_t tick_count = 0;
+	uint16_t slept;
+	
+	slept = (uint16_t)(power_sleep_cycles - power_last_sleep_cycles);
+	power_last_sleep_cycles = power_sleep_cycles;
+	
+	tick_count++;
+	if(TICK_HZ == tick_count)
+	{
+		tick_count = 0;
+		power_awake_cycles = POWER_CYCLES_PER_SECOND - power_sleep_cycles;
+		power_sleep_cycles = 0;
+		power_last_sleep_cycles = 0;
+	}
+	
+	//A late tick ISR can make the last tick look a little longer than it was
+	return (slept < POWER_CYCLES_PER_TICK) ? (uint16_t)(POWER_CYCLES_PER_TICK - slept) : 0;
+}
+
+/*Fraction of the last second the CPU was awake, in tenths of a percent*/
+uint16_t power_awake_permille(void)
+{
+	uint32_t awake;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		awake = power_awake_cycles;
+	}
+	
+	return (uint16_t)(awake / (POWER_CYCLES_PER_SECOND / 1000));
+}
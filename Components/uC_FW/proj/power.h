@@ -0,0 +1,63 @@
+/*
+ * power.h
+ *
+ * Power saving: peripheral clock gating, Idle sleep whenever the main loop has nothing to do, and a
+ * measurement of how much of the time the CPU is actually awake.
+ *
+ * The main loop used to spin on flags for the whole tick.  Now it sleeps in Idle mode until the next
+ * interrupt.  Idle only stops the CPU and flash clocks (ATMega328 Datasheet Section 10.3), so Timer1,
+ * the ADC and the UART carry on exactly as before - and the ADC scan now runs while the CPU is asleep,
+ * which takes most of the digital noise out of the conversions.
+ *
+ * ADC Noise Reduction mode would be quieter still, but it stops clkIO (Section 10.4, Table 10-1).
+ * That's the clock Timer1 and the UART run on, so every conversion would stop the tick for 13us,
+ * stretch any byte the UART was in the middle of sending, and the scan's Timer1 trigger would never
+ * come.  The sample clock matters more than the last half LSB, so Idle it is.
+ *
+ * Duty cycle: the main loop stamps TCNT1 just before it sleeps and every ISR calls power_woke() as it
+ * starts, which adds up the cycles between the two.  Timer1 counts CPU cycles and the tick always
+ * wakes the CPU before it wraps twice, so a sleep is never longer than one tick.  The total is latched
+ * once a second by power_tick() and the awake fraction goes out in the tick stats frame.  power_tick()
+ * also hands back the awake cycles of each tick for the CPU load histogram (see trace.h).
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#include "common.h"
+
+#include <avr/io.h>
+
+/*CPU cycles in one second and in one tick*/
+#define POWER_CYCLES_PER_SECOND F_CPU
+#define POWER_CYCLES_PER_TICK (F_CPU/TICK_HZ)
+
+extern volatile boolean power_sleeping;
+extern volatile uint16_t power_sleep_start;
+extern volatile uint32_t power_sleep_cycles;
+
+void power_init(void);
+void power_idle(void);
+uint16_t power_tick(void);
+uint16_t power_awake_permille(void);
+
+/*Call at the very start of every ISR.  Costs 4 cycles when the CPU wasn't asleep, about 25 when it was.*/
+static inline void power_woke(void)
+{
+	uint16_t now;
+	
+	if(FALSE != power_sleeping)
+	{
+		now = TCNT1;
+		
+		//Timer1 wraps at the tick, and a sleep can't outlast one
+		if(now < power_sleep_start)
+		{
+			now += POWER_CYCLES_PER_TICK;
+		}
+		power_sleep_cycles += now - power_sleep_start;
+		power_sleeping = FALSE;
+	}
+}
+
+#endif /* POWER_H_ */
@@ -0,0 +1,27 @@
+/*
+ * progmem.h
+ *
+ * Flash-resident constant tables.  On the AVR these live in program memory and have to be read with
+ * the pgm_read_* functions.  Anywhere else (the host build) they're ordinary const data.
+ */
+
+#ifndef PROGMEM_H_
+#define PROGMEM_H_
+
+#if defined(__AVR__)
+
+#include <avr/pgmspace.h>
+
+#else
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_ptr(address) (*(void * const *)(address))
+
+#endif
+
+#endif /* PROGMEM_H_ */
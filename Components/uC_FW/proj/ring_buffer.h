@@ -0,0 +1,79 @@
+/*
+ * ring_buffer.h
+ *
+ * A lock-free single-producer/single-consumer byte queue for passing data between an ISR and
+ * the main loop.
+ *
+ * The trick is that each index is only ever written by one side: the producer owns head and the
+ * consumer owns tail.  Both are 8 bits wide, so the AVR reads and writes them in one instruction
+ * and no interrupts have to be disabled.  The size must be a power of two (and no more than 128)
+ * so wrapping is a mask instead of a divide.  One slot is always left empty to tell 'full' from
+ * 'empty', so a buffer of size N holds N-1 bytes.
+ */
+
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+
+#include "common.h"
+
+typedef struct
+{
+	volatile uint8_t head;	//Next slot to write - only the producer changes this
+	volatile uint8_t tail;	//Next slot to read - only the consumer changes this
+	uint8_t mask;			//Size - 1
+	volatile uint8_t *data;
+} ring_buffer_t;
+
+/*Declare the storage and the ring in one go.  size has to be a power of two.*/
+#define RING_BUFFER(name,size) \
+	volatile uint8_t name##_data[(size)]; \
+	ring_buffer_t name = {0, 0, (size) - 1, name##_data}
+
+static inline boolean ring_empty(ring_buffer_t *ring)
+{
+	return (ring->head == ring->tail)?TRUE:FALSE;
+}
+
+static inline boolean ring_full(ring_buffer_t *ring)
+{
+	return (((ring->head + 1) & ring->mask) == ring->tail)?TRUE:FALSE;
+}
+
+static inline uint8_t ring_count(ring_buffer_t *ring)
+{
+	return (ring->head - ring->tail) & ring->mask;
+}
+
+/*Space left.  The other side can only make this bigger while you're looking at it.*/
+static inline uint8_t ring_free(ring_buffer_t *ring)
+{
+	return ring->mask - ring_count(ring);
+}
+
+/*Producer side.  Returns FALSE and drops the byte if the ring is full.*/
+static inline boolean ring_put(ring_buffer_t *ring, uint8_t value)
+{
+	uint8_t head = ring->head;
+	uint8_t next = (head + 1) & ring->mask;
+
+	if(next == ring->tail)
+	{
+		return FALSE;
+	}
+
+	ring->data[head] = value;
+	ring->head = next;	//Publish only after the data is in place
+	return TRUE;
+}
+
+/*Consumer side.  Only call this when the ring isn't empty.*/
+static inline uint8_t ring_get(ring_buffer_t *ring)
+{
+	uint8_t tail = ring->tail;
+	uint8_t value = ring->data[tail];
+
+	ring->tail = (tail + 1) & ring->mask;	//Hand the slot back only after it's been read
+	return value;
+}
+
+#endif /* RING_BUFFER_H_ */
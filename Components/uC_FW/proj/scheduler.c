@@ -0,0 +1,231 @@
+/*
+ * scheduler.c
+ *
+ * Cooperative task scheduler - see scheduler.h.
+ */
+
+#include "common.h"
+
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "progmem.h"
+#include "trace.h"
+#include "scheduler.h"
+
+uint16_t sched_frame_overruns = 0;
+
+/*The task table lives in flash*/
+static const sched_task_t *sched_tasks;
+static uint8_t sched_count;
+
+/*Ready mask bit n is the task at sched_order[n].  Bit 0 is the most urgent.*/
+static uint8_t sched_order[SCHED_MAX_TASKS];
+static uint8_t sched_bit[SCHED_MAX_TASKS];
+static volatile uint8_t sched_ready = 0;
+
+/*Ticks until each periodic task is next released*/
+static uint16_t sched_countdown[SCHED_MAX_TASKS];
+
+static sched_stats_t sched_stats[SCHED_MAX_TASKS];
+
+/*Ticks so far, counted in the ISR*/
+static volatile uint16_t sched_isr_ticks = 0;
+
+/*CPU cycles at the start of the current tick, also kept by the ISR - sched_now() adds TCNT1 to it.  It's
+ kept in cycles rather than worked out from sched_isr_ticks so it wraps at 2^32 like everything that
+ subtracts two of them expects.  A 16-bit tick count times 10000 wraps at 655,360,000, and a task that
+ ran across that came out ~3.6 billion cycles long.*/
+static volatile uint32_t sched_isr_cycles = 0;
+
+/*Ticks the main loop has handled with sched_tick()*/
+static uint16_t sched_handled_ticks = 0;
+
+/*Lowest set bit of a nibble - 0 isn't used*/
+static const uint8_t sched_lowest_bit[16] PROGMEM = {0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0};
+
+/*CPU cycles since reset.  Wraps every 2^32 cycles, about 9 minutes, so the difference of two is right
+ for anything shorter than that.  Works from an ISR too.*/
+uint32_t sched_now(void)
+{
+	uint32_t cycles;
+	uint16_t count;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		cycles = sched_isr_cycles;
+		count = TCNT1;
+		
+		//If the timer wrapped after interrupts went off the ISR hasn't counted it yet.  ICF1 is its flag
+		//(ATMega328 Datasheet Section 16.11.9 - TIFR1 bit 5).  A small count means the wrap came first.
+		if((0 != READ(TIFR1,5)) && (count < (SCHED_CYCLES_PER_TICK / 2)))
+		{
+			cycles += SCHED_CYCLES_PER_TICK;
+		}
+	}
+	
+	return cycles + count;
+}
+
+void sched_init(const sched_task_t *tasks, uint8_t count)
+{
+	uint8_t i, j, priority;
+	
+	//costume_2012.c checks its table fits at compile time - this just makes sure nobody else's can
+	//write past the end of sched_order[] and friends
+	if(count > SCHED_MAX_TASKS)
+	{
+		count = SCHED_MAX_TASKS;
+	}
+	
+	sched_tasks = tasks;
+	sched_count = count;
+	sched_ready = 0;
+	
+	//Number the tasks by priority - an insertion sort of at most 8 things, once
+	for(i = 0; i < count; i++)
+	{
+		priority = pgm_read_byte(&tasks[i].priority);
+		for(j = i; (j > 0) && (pgm_read_byte(&tasks[sched_order[j - 1]].priority) > priority); j--)
+		{
+			sched_order[j] = sched_order[j - 1];
+		}
+		sched_order[j] = i;
+		
+		sched_countdown[i] = pgm_read_word(&tasks[i].phase);
+		sched_stats[i].worst = 0;
+		sched_stats[i].total = 0;
+		sched_stats[i].runs = 0;
+	}
+	for(i = 0; i < count; i++)
+	{
+		sched_bit[sched_order[i]] = i;
+	}
+}
+
+/*Call from the tick ISR*/
+void sched_tick_isr(void)
+{
+	sched_isr_ticks++;
+	sched_isr_cycles += SCHED_CYCLES_PER_TICK;
+}
+
+/*Call from the main loop once for every tick the ISR counted.  Releases the periodic tasks that are due.*/
+void sched_tick(void)
+{
+	uint16_t period, isr_ticks;
+	uint8_t i;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		isr_ticks = sched_isr_ticks;
+	}
+	
+	//If another tick has already gone by, this one's work didn't get done inside its own frame
+	sched_handled_ticks++;
+	if(isr_ticks != sched_handled_ticks)
+	{
+		sched_frame_overruns++;
+	}
+	
+	for(i = 0; i < sched_count; i++)
+	{
+		period = pgm_read_word(&sched_tasks[i].period);
+		if(0 == period)
+		{
+			continue;
+		}
+		
+		if(0 == sched_countdown[i])
+		{
+			sched_countdown[i] = period;
+			sched_release(i);
+		}
+		sched_countdown[i]--;
+	}
+}
+
+/*Mark a task ready to run.  Safe from an ISR.*/
+void sched_release(uint8_t task)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		sched_ready |= (uint8_t)(0x01 << sched_bit[task]);
+	}
+}
+
+/*TRUE if nothing is ready to run*/
+boolean sched_idle(void)
+{
+	return (0 == sched_ready)?TRUE:FALSE;
+}
+
+/*Run ready tasks, most urgent first, until none are left.  A task released while this is running
+ (including by another task) gets run before it returns.*/
+void sched_run(void)
+{
+	sched_stats_t *stats;
+	uint32_t start, elapsed;
+	uint8_t ready, bit, task;
+	void (*handler)(void);
+	
+	while(0 != (ready = sched_ready))
+	{
+		//Lowest set bit, a nibble at a time
+		if(0 != (ready & 0x0F))
+		{
+			bit = pgm_read_byte(&sched_lowest_bit[ready & 0x0F]);
+		}
+		else
+		{
+			bit = pgm_read_byte(&sched_lowest_bit[ready >> 4]) + 4;
+		}
+		
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			sched_ready &= (uint8_t)~(0x01 << bit);
+		}
+		
+		task = sched_order[bit];
+		handler = (void (*)(void))pgm_read_ptr(&sched_tasks[task].handler);
+		
+		start = sched_now();
+		TRACE_ENTER(TRACE_ID_TASK + task);
+		handler();
+		TRACE_EXIT(TRACE_ID_TASK + task);
+		elapsed = sched_now() - start;
+		
+		stats = &sched_stats[task];
+		if(elapsed > stats->worst)
+		{
+			stats->worst = (elapsed > 0xFFFF) ? 0xFFFF : (uint16_t)elapsed;
+		}
+		stats->total += elapsed;
+		stats->runs++;
+	}
+}
+
+/*Fill in a report (SCHED_REPORT_SIZE bytes) and start a new averaging window.  Returns its length.*/
+uint8_t sched_report(uint8_t *payload)
+{
+	uint8_t *p = payload;
+	uint16_t average;
+	uint8_t i;
+	
+	for(i = 0; i < sched_count; i++)
+	{
+		average = (0 == sched_stats[i].runs) ? 0 : (uint16_t)(sched_stats[i].total / sched_stats[i].runs);
+		
+		*p++ = (uint8_t)(sched_stats[i].worst);
+		*p++ = (uint8_t)(sched_stats[i].worst >> 8);
+		*p++ = (uint8_t)(average);
+		*p++ = (uint8_t)(average >> 8);
+		
+		sched_stats[i].total = 0;
+		sched_stats[i].runs = 0;
+	}
+	*p++ = (uint8_t)(sched_frame_overruns);
+	*p++ = (uint8_t)(sched_frame_overruns >> 8);
+	
+	return (uint8_t)(p - payload);
+}
@@ -0,0 +1,66 @@
+/*
+ * scheduler.h
+ *
+ * Table-driven cooperative task scheduler with per-task execution time measurement.
+ *
+ * Every task is a row in a const table: how often it runs, which tick of its period it runs on, how
+ * urgent it is, and the function to call.  A task with a period of 0 isn't run by the clock - something
+ * else (an ISR handing over data, another task) releases it with sched_release().
+ *
+ * Tasks run to completion - nothing is preempted except by ISRs.  Each task is one bit in a ready mask,
+ * numbered in priority order, so picking the next task to run is a table lookup of the lowest set bit
+ * no matter how many tasks there are.  Releasing the periodic tasks costs one countdown per periodic
+ * task per tick.
+ *
+ * Every run is timed in CPU cycles with Timer1 (see sched_now()), which gives each task's worst case
+ * and average.  Those include any ISRs that landed in the middle, since that's what the main loop
+ * actually loses.  A frame overrun is a tick whose work wasn't finished when the next tick was
+ * handled - that's the 1.25ms budget blown.
+ *
+ * Spread the phases of the heavy tasks so they never land on the same tick.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include "common.h"
+
+/*The ready mask is 8 bits*/
+#define SCHED_MAX_TASKS 8
+
+/*CPU cycles per tick - Timer1 counts 0 to TIMER1_TOP*/
+#define SCHED_CYCLES_PER_TICK (F_CPU/TICK_HZ)
+
+typedef struct
+{
+	uint16_t period;		//Ticks between runs.  0 = only when released by sched_release()
+	uint16_t phase;			//Which tick of the period it runs on - must be less than period
+	uint8_t priority;		//0 is the most urgent.  No two tasks can share one
+	void (*handler)(void);
+} sched_task_t;
+
+/*Execution time of one task, in CPU cycles*/
+typedef struct
+{
+	uint16_t worst;			//Longest run ever (saturates at 0xFFFF)
+	uint32_t total;			//Sum of the runs since the last report
+	uint16_t runs;			//Runs since the last report
+} sched_stats_t;
+
+/*Ticks whose work wasn't done when the next tick was handled (total)*/
+extern uint16_t sched_frame_overruns;
+
+/*Task stats report: worst and average cycles per task in table order, then sched_frame_overruns, all
+ 16-bit little-endian*/
+#define SCHED_REPORT_SIZE(tasks) ((tasks) * 4 + 2)
+
+void sched_init(const sched_task_t *tasks, uint8_t count);
+void sched_tick_isr(void);
+void sched_tick(void);
+void sched_release(uint8_t task);
+boolean sched_idle(void);
+void sched_run(void);
+uint32_t sched_now(void);
+uint8_t sched_report(uint8_t *payload);
+
+#endif /* SCHEDULER_H_ */
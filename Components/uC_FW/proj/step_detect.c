@@ -0,0 +1,97 @@
+/*
+ * step_detect.c
+ *
+ * Multiplierless sliding raised-cosine matched filter for step detection - see step_detect.h.
+ */
+
+#include <stdint.h>
+
+#include "common.h"
+#include "progmem.h"
+#include "step_detect.h"
+
+/*The nested boxes that make up the window, widest first.  Each box covers delays
+ STEP_WINDOW_CENTRE - half_width to STEP_WINDOW_CENTRE + half_width, and its weight is 2^weight_shift
+ quarters.*/
+typedef struct
+{
+	uint8_t half_width;
+	uint8_t weight_shift;
+} step_level_t;
+
+static const step_level_t step_levels[STEP_LEVELS] PROGMEM =
+{
+	{3, 0},		//1/4, delays 0-6
+	{2, 0},		//1/4, delays 1-5
+	{1, 1},		//1/2, delays 2-4
+};
+
+void step_detect_init(step_detect_t *detector)
+{
+	uint8_t i;
+	
+	//An all-zero history is consistent with all-zero sums, which is what the detector sees at rest
+	for(i = 0; i < STEP_HISTORY_SIZE; i++)
+	{
+		detector->history[i] = 0;
+	}
+	for(i = 0; i < STEP_LEVELS; i++)
+	{
+		detector->box[i] = 0;
+	}
+	detector->newest = 0;
+	detector->output = 0;
+	detector->stepping = FALSE;
+	detector->steps = 0;
+}
+
+/*Feed one 20Hz motion sample (Q16.16 ADC counts).  Returns TRUE if a step was counted.*/
+boolean step_detect_run(step_detect_t *detector, int32_t motion)
+{
+	const uint8_t mask = STEP_HISTORY_SIZE - 1;
+	uint32_t rectified;
+	uint32_t output = 0;
+	uint8_t newest, half_width, i;
+	
+	//Rectify and drop to Q8.8 - anything that doesn't fit in 16 bits is a bigger jolt than the
+	//ADC can even measure, so it just saturates
+	rectified = (uint32_t)((motion < 0) ? -motion : motion) >> 8;
+	if(rectified > 0xFFFFUL)
+	{
+		rectified = 0xFFFFUL;
+	}
+	
+	newest = (detector->newest + 1) & mask;
+	detector->newest = newest;
+	detector->history[newest] = (uint16_t)rectified;
+	
+	//Slide every box along one sample.  The one coming in is at delay centre - half_width, the one
+	//going out was at centre + half_width last time, which is centre + half_width + 1 now.
+	for(i = 0; i < STEP_LEVELS; i++)
+	{
+		half_width = pgm_read_byte(&step_levels[i].half_width);
+		
+		detector->box[i] += detector->history[(newest - (STEP_WINDOW_CENTRE - half_width)) & mask];
+		detector->box[i] -= detector->history[(newest - (STEP_WINDOW_CENTRE + half_width + 1)) & mask];
+		output += detector->box[i] << pgm_read_byte(&step_levels[i].weight_shift);
+	}
+	
+	output >>= STEP_WEIGHT_SHIFT;
+	detector->output = output;
+	
+	if(FALSE == detector->stepping)
+	{
+		if(output > STEP_ON_THRESHOLD)
+		{
+			detector->stepping = TRUE;
+			detector->steps++;
+			return TRUE;
+		}
+	}
+	else if(output < STEP_OFF_THRESHOLD)
+	{
+		detector->stepping = FALSE;
+	}
+	
+	return FALSE;
+}
@@ -0,0 +1,77 @@
+/*
+ * step_detect.h
+ *
+ * Step detection: a raised-cosine matched filter on the rectified motion signal, followed by a
+ * threshold with hysteresis.
+ *
+ * This is the detector from accel_script.m, which convolves the rectified signal with a 250-point
+ * cosine window and compares it against two thresholds.  In Octave that's conv() - M multiplies per
+ * sample.  Here the window is quantized so every tap is a power of two (what cosine_script.m was
+ * trying to do), and then it can be split into a handful of nested rectangular windows:
+ *
+ *	Delay	0		1		2		3		4		5		6
+ *	Cosine	0.22	0.62	0.90	1		0.90	0.62	0.22
+ *	Taps	1/4		1/2		1		1		1		1/2		1/4
+ *
+ *	 = 1/4 x box(delays 0-6) + 1/4 x box(1-5) + 1/2 x box(2-4)
+ *
+ * A box is a running sum - add the sample coming in, subtract the one going out - so each costs two
+ * adds per sample no matter how wide it is, and the weights are shifts.  The cost is O(levels), and
+ * with power-of-two levels that's O(log) of the window's dynamic range rather than O(M).  No
+ * multiplies anywhere.  A longer window is just more rows in step_levels[] and a bigger history.
+ *
+ * The Octave window was 250 samples at 800Hz, 0.31s.  This runs on the 20Hz decimated motion signal,
+ * so the same width is 7 samples (0.35s), and the output is delayed by 3 samples (0.15s) because the
+ * window is centred.
+ *
+ * Cost: about 200 cycles per 20Hz sample (three boxes at ~45 cycles, the rectify and the thresholds),
+ * so 4000 cycles a second - 0.05% of the CPU.  That's an estimate from counting instructions, not a
+ * measurement.
+ *
+ * A step is counted each time the filter output rises through STEP_ON_THRESHOLD.  Another one can't be
+ * counted until it has fallen back through STEP_OFF_THRESHOLD, so noise on the edge doesn't count twice.
+ */
+
+#ifndef STEP_DETECT_H_
+#define STEP_DETECT_H_
+
+#include <stdint.h>
+
+#include "common.h"
+
+/*Window length and the delay of its centre*/
+#define STEP_WINDOW 7
+#define STEP_WINDOW_CENTRE 3
+
+/*History of rectified samples - needs STEP_WINDOW + 1 entries and a power of two so wrapping is a mask*/
+#define STEP_HISTORY_SIZE 8
+
+/*Number of nested boxes the window is made of, and the shift that turns their weights (in quarters)
+ back into taps*/
+#define STEP_LEVELS 3
+#define STEP_WEIGHT_SHIFT 2
+
+/*Sum of the window taps: 3 x 1 + 2 x 1/2 + 2 x 1/4 = 4.5.  A steady rectified input of A ADC counts
+ comes out as A * 4.5.*/
+#define STEP_WINDOW_GAIN_Q8 1152UL	//4.5 in Q8.8
+
+/*Thresholds: the average rectified amplitude across the window, Q8.8 ADC counts, times the window gain.
+ accel_script.m had two thresholds as well.  These were picked from accel_data.txt, where moving averages
+ well over 6 counts and standing still 1-3.*/
+#define STEP_ON_THRESHOLD ((6UL << 8) * STEP_WINDOW_GAIN_Q8 >> 8)
+#define STEP_OFF_THRESHOLD ((3UL << 8) * STEP_WINDOW_GAIN_Q8 >> 8)
+
+typedef struct
+{
+	uint16_t history[STEP_HISTORY_SIZE];	//Rectified samples, Q8.8 ADC counts
+	uint8_t newest;							//Index of the newest sample in history
+	uint32_t box[STEP_LEVELS];				//Running sum of each box, Q8.8 ADC counts
+	uint32_t output;						//Filter output, Q8.8 ADC counts
+	boolean stepping;						//TRUE from rising through ON to falling through OFF
+	uint16_t steps;							//Steps counted so far (wraps)
+} step_detect_t;
+
+void step_detect_init(step_detect_t *detector);
+boolean step_detect_run(step_detect_t *detector, int32_t motion);
+
+#endif /* STEP_DETECT_H_ */
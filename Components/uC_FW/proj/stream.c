@@ -0,0 +1,89 @@
+/*
+ * stream.c
+ *
+ * Delta/nibble encoder for the compressed sample stream - see stream.h for the format.
+ */
+
+#include "common.h"
+#include "stream.h"
+
+/*Start a new frame*/
+void stream_reset(stream_encoder_t *stream)
+{
+	stream->payload[0] = 0;
+	stream->nibbles = 0;
+}
+
+static void stream_put_nibble(stream_encoder_t *stream, uint8_t nibble)
+{
+	uint8_t *byte = &stream->payload[STREAM_HEADER_SIZE + (stream->nibbles >> 1)];
+	
+	if(0 == (stream->nibbles & 0x01))
+	{
+		*byte = (uint8_t)(nibble << 4);	//Low nibble stays 0 as padding until it's used
+	}
+	else
+	{
+		*byte |= nibble;
+	}
+	stream->nibbles++;
+}
+
+/*Payload bytes in the frame so far*/
+uint8_t stream_length(const stream_encoder_t *stream)
+{
+	return STREAM_HEADER_SIZE + ((stream->nibbles + 1) >> 1);
+}
+
+/*Add one 10-bit sample per axis.  Returns TRUE when the frame is ready to go: send stream->payload,
+ stream_length() bytes long, and then stream_reset().*/
+boolean stream_encode(stream_encoder_t *stream, const uint16_t *sample)
+{
+	uint16_t zigzag;
+	int16_t delta;
+	uint8_t axis;
+	
+	if(0 == stream->payload[0])
+	{
+		for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+		{
+			stream->payload[1 + axis * 2] = (uint8_t)(sample[axis]);
+			stream->payload[2 + axis * 2] = (uint8_t)(sample[axis] >> 8);
+		}
+	}
+	else
+	{
+		for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+		{
+			delta = (int16_t)(sample[axis] - stream->last[axis]);
+			zigzag = (uint16_t)((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15);
+			
+			if(zigzag < STREAM_ESCAPE)
+			{
+				stream_put_nibble(stream,(uint8_t)zigzag);
+			}
+			else
+			{
+				stream_put_nibble(stream,STREAM_ESCAPE);
+				stream_put_nibble(stream,(uint8_t)((zigzag >> 8) & 0x0F));
+				stream_put_nibble(stream,(uint8_t)((zigzag >> 4) & 0x0F));
+				stream_put_nibble(stream,(uint8_t)(zigzag & 0x0F));
+			}
+		}
+	}
+	
+	for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+	{
+		stream->last[axis] = sample[axis];
+	}
+	stream->payload[0]++;
+	
+	//Full, or the next sample might not fit
+	if((STREAM_FRAME_SAMPLES == stream->payload[0])
+	|| ((stream->nibbles + STREAM_SAMPLE_MAX_NIBBLES) > ((STREAM_PAYLOAD_SIZE - STREAM_HEADER_SIZE) * 2)))
+	{
+		return TRUE;
+	}
+	
+	return FALSE;
+}
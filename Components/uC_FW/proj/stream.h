@@ -0,0 +1,63 @@
+/*
+ * stream.h
+ *
+ * Compressed 10-bit, three-axis sample stream - the CHANNEL_ACCEL_XYZ frames.
+ *
+ * The accelerometer changes very little from one 800Hz sample to the next, so instead of sending
+ * each 10-bit sample (two bytes, and 4800 bytes a second for three axes) each frame starts with one
+ * whole sample and then only sends how much each axis changed.  Most of those changes fit in a
+ * nibble, so a quiet signal takes 1.5 bytes per three-axis sample instead of 6.
+ *
+ * Payload layout:
+ *
+ *	Byte	Contents
+ *	-------------------------------------------------------------
+ *	0		Number of samples N in the frame (1 to STREAM_FRAME_SAMPLES)
+ *	1..6	First sample: X, Y, Z, 10 bits each in 16-bit little-endian
+ *	7..		Samples 2 to N as nibbles, high nibble first: X, Y, Z deltas from the sample before.
+ *			A padding nibble of 0 finishes an odd count.
+ *
+ * Each delta d (new - old, -1023 to 1023) is zig-zag coded so small changes either way are small
+ * numbers: z = 2d for d >= 0, -2d - 1 for d < 0.  z from 0 to 14 is sent as that one nibble.
+ * Anything bigger is the escape nibble 0xF followed by z in three nibbles, most significant first.
+ *
+ * Every frame starts over with a whole sample, so a dropped frame never spoils the ones after it.
+ * The encoder closes a frame early if the next sample might not fit, so a burst of big changes
+ * makes more frames instead of overflowing one.
+ *
+ * The decoder is host/decode.c.
+ */
+
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include "common.h"
+#include "adc_scan.h"
+#include "uart.h"
+
+/*Samples per frame at most - 16 samples is a frame every 20ms*/
+#define STREAM_FRAME_SAMPLES 16
+
+/*Count plus the first sample*/
+#define STREAM_HEADER_SIZE (1 + ADC_SCAN_AXES * 2)
+
+/*Zig-zag values up to this go in one nibble, and this nibble means a 12-bit value follows*/
+#define STREAM_ESCAPE 0x0F
+
+/*The most one sample's deltas can take - every axis escaped*/
+#define STREAM_SAMPLE_MAX_NIBBLES (ADC_SCAN_AXES * 4)
+
+#define STREAM_PAYLOAD_SIZE UART_MAX_PAYLOAD
+
+typedef struct
+{
+	uint8_t payload[STREAM_PAYLOAD_SIZE];
+	uint8_t nibbles;					//Nibbles used after the header
+	uint16_t last[ADC_SCAN_AXES];		//The sample before, for the deltas
+} stream_encoder_t;
+
+void stream_reset(stream_encoder_t *stream);
+boolean stream_encode(stream_encoder_t *stream, const uint16_t *sample);
+uint8_t stream_length(const stream_encoder_t *stream);
+
+#endif /* STREAM_H_ */
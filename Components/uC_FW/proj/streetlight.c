@@ -0,0 +1,93 @@
+/*
+ * streetlight.c
+ *
+ * The streetlight state machine - see streetlight.h.
+ */
+
+#include "common.h"
+#include "progmem.h"
+#include "streetlight.h"
+
+/*Next states by input.  The input is MOVING + STARTED x 2 + EXPIRED x 4, so the columns are:
+
+	0 - stopped				4 - stopped, time up
+	1 - walking				5 - walking, time up
+	2 - (can't happen)		6 - (can't happen)
+	3 - just started		7 - just started, time up
+
+ STARTED never comes without MOVING - those two columns are filled in as if it did.*/
+#define G_MIN STREET_GREEN_MIN
+#define GREEN STREET_GREEN
+#define YELL STREET_YELLOW
+#define R_ON STREET_RED_ON
+#define HELD STREET_RED_HELD
+
+const street_state_t street_states[STREET_STATES] PROGMEM =
+{
+	//Lights				Steps						0		1		2		3		4		5		6		7
+	{STREET_GREEN_LIGHT,	STREET_GREEN_MIN_STEPS,		{G_MIN,	G_MIN,	G_MIN,	G_MIN,	YELL,	GREEN,	GREEN,	GREEN}},	//STREET_GREEN_MIN
+	{STREET_GREEN_LIGHT,	0,							{YELL,	GREEN,	GREEN,	GREEN,	YELL,	GREEN,	GREEN,	GREEN}},	//STREET_GREEN
+	{STREET_YELLOW_LIGHT,	STREET_YELLOW_STEPS,		{YELL,	YELL,	YELL,	YELL,	R_ON,	R_ON,	R_ON,	R_ON}},		//STREET_YELLOW
+	{STREET_RED_LIGHT,		STREET_RED_ON_STEPS,		{R_ON,	R_ON,	R_ON,	R_ON,	HELD,	HELD,	HELD,	HELD}},		//STREET_RED_ON
+	{STREET_RED_LIGHT,		0,							{HELD,	HELD,	G_MIN,	G_MIN,	HELD,	HELD,	G_MIN,	G_MIN}}		//STREET_RED_HELD
+};
+
+#undef G_MIN
+#undef GREEN
+#undef YELL
+#undef R_ON
+#undef HELD
+
+/*Red, stopped - requirement 1*/
+void streetlight_init(streetlight_t *light)
+{
+	light->state = STREET_RED_HELD;
+	light->remaining = 0;
+	light->walk_left = 0;
+}
+
+/*One step, with whether a step was counted on this decimated sample.  Returns TRUE if the state changed
+ - streetlight_lights() has what it shows.*/
+boolean streetlight_step(streetlight_t *light, boolean stepped)
+{
+	uint8_t input = 0;
+	uint8_t next;
+	
+	if(FALSE != stepped)
+	{
+		if(0 == light->walk_left)
+		{
+			input = STREET_IN_STARTED;
+		}
+		light->walk_left = STREET_WALK_STEPS;
+	}
+	else if(0 != light->walk_left)
+	{
+		light->walk_left--;
+	}
+	if(0 != light->walk_left)
+	{
+		input |= STREET_IN_MOVING;
+	}
+	
+	//A state that entered with n steps runs out on its nth step, so it's shown for exactly n
+	if((0 != light->remaining) && (0 == --light->remaining))
+	{
+		input |= STREET_IN_EXPIRED;
+	}
+	
+	next = pgm_read_byte(&street_states[light->state].next[input]);
+	if(next == light->state)
+	{
+		return FALSE;
+	}
+	
+	light->state = next;
+	light->remaining = pgm_read_byte(&street_states[next].steps);
+	return TRUE;
+}
+
+uint8_t streetlight_lights(const streetlight_t *light)
+{
+	return pgm_read_byte(&street_states[light->state].lights);
+}
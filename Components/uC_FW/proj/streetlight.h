@@ -0,0 +1,98 @@
+/*
+ * streetlight.h
+ *
+ * The streetlight itself: which light is on, and when it changes - the rules at the top of
+ * costume_2012.c, finally.
+ *
+ * It's a table, not a pile of ifs.  Every state has a row in street_states[] with the lights it shows,
+ * how many steps it lasts (if it has a time limit) and the state to go to for every combination of
+ * three inputs:
+ *
+ *	STREET_IN_MOVING	The wearer is walking - a step has been counted in the last STREET_WALK_STEPS
+ *	STREET_IN_STARTED	...and wasn't before this step.  Only a walk that starts here counts for red.
+ *	STREET_IN_EXPIRED	The state's time just ran out, this step
+ *
+ * so a step is: work out the three bits, look up the next state, and if it changed load its time.  The
+ * same few instructions whatever state it's in, and adding a rule is editing a table row.
+ *
+ *	State		Lights	Time	Goes to
+ *	-------------------------------------------------------------------------------------------------
+ *	GREEN_MIN	Green	1s		GREEN if still walking when it runs out, YELLOW if not
+ *	GREEN		Green	-		YELLOW the moment the wearer stops
+ *	YELLOW		Yellow	3s		RED_ON - walking or not
+ *	RED_ON		Red		1s		RED_HELD - walking or not.  A walk that starts now doesn't count.
+ *	RED_HELD	Red		-		GREEN_MIN when a walk starts
+ *
+ * It starts in RED_HELD (requirement 1 - red, and the first step taken turns it green).
+ *
+ * About the walk-while-red case in costume_2012.c: red is 'On' for its first second and 'Held' after
+ * that, and only a walk that starts while it's Held turns it green.  One that starts while it's On is
+ * ignored all the way through - the wearer has to stop and start again.
+ *
+ * It's stepped once per decimated sample, 20 times a second, with whether any axis's step detector
+ * counted a step on that sample (see dsp_chain.h).  So everything here is counted in 50ms steps, and
+ * 'stopped' means no step for STREET_WALK_STEPS.  Nothing in here touches a register, so host/streetsim
+ * runs this same code against a virtual clock - hours of motion in milliseconds, checked against the
+ * rules step by step.
+ */
+
+#ifndef STREETLIGHT_H_
+#define STREETLIGHT_H_
+
+#include "common.h"
+#include "dsp_chain.h"
+#include "lights.h"
+
+/*Steps a second - one per decimated sample*/
+#define STREET_STEP_HZ (TICK_HZ / DSP_DECIMATE_RATIO)
+
+/*The times from the requirements, in steps.  The table keeps them in a byte, so 12.75s at most.*/
+#define STREET_GREEN_MIN_STEPS (STREET_STEP_HZ * 1)
+#define STREET_YELLOW_STEPS (STREET_STEP_HZ * 3)
+#define STREET_RED_ON_STEPS (STREET_STEP_HZ * 1)
+
+/*Walking lasts this long after the last step counted - 1.5s.  Slower than that isn't walking.*/
+#define STREET_WALK_STEPS ((STREET_STEP_HZ * 3) / 2)
+
+enum Street_States
+{
+	STREET_GREEN_MIN = 0,
+	STREET_GREEN,
+	STREET_YELLOW,
+	STREET_RED_ON,
+	STREET_RED_HELD,
+	STREET_STATES
+};
+
+/*The inputs, and the table has a column for every combination of them*/
+#define STREET_IN_MOVING 0x01
+#define STREET_IN_STARTED 0x02
+#define STREET_IN_EXPIRED 0x04
+#define STREET_INPUTS 8
+
+/*The lights a state shows - a bit for each enum Light_Channels*/
+#define STREET_GREEN_LIGHT (0x01 << LIGHT_GREEN)
+#define STREET_YELLOW_LIGHT (0x01 << LIGHT_YELLOW)
+#define STREET_RED_LIGHT (0x01 << LIGHT_RED)
+
+typedef struct
+{
+	uint8_t lights;					//STREET_*_LIGHT bits
+	uint8_t steps;					//How long it lasts - 0 if it only ends on an input
+	uint8_t next[STREET_INPUTS];	//enum Street_States, by input
+} street_state_t;
+
+typedef struct
+{
+	uint8_t state;			//enum Street_States
+	uint8_t remaining;		//Steps left before the state's time runs out - 0 if it has none
+	uint8_t walk_left;		//Steps left before the wearer counts as stopped - 0 when they have
+} streetlight_t;
+
+extern const street_state_t street_states[STREET_STATES] PROGMEM;
+
+void streetlight_init(streetlight_t *light);
+boolean streetlight_step(streetlight_t *light, boolean stepped);
+uint8_t streetlight_lights(const streetlight_t *light);
+
+#endif /* STREETLIGHT_H_ */
@@ -0,0 +1,170 @@
+/*
+ * trace.c
+ *
+ * Trace ring, CPU load histogram and stack painting - see trace.h.
+ */
+
+#include "common.h"
+
+#ifdef TRACE_ENABLED
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "uart.h"
+#include "trace.h"
+
+trace_entry_t trace_ring[TRACE_RING_SIZE];
+uint8_t trace_head = 0;
+volatile uint8_t trace_ticks = 0;
+volatile boolean trace_frozen = FALSE;
+
+static volatile uint16_t trace_load_counts[TRACE_LOAD_BUCKETS];
+
+/*Dump progress.  trace_dump_next is the next entry to send, TRACE_RING_SIZE when there's nothing to
+ send.*/
+static uint8_t trace_dump_next = TRACE_RING_SIZE;
+static boolean trace_profile_wanted = FALSE;
+
+/*The linker's names for the end of the variables and the top of SRAM*/
+extern uint8_t _end;
+extern uint8_t __stack;
+
+/*Paint SRAM from the end of the variables to the top.  This runs in .init1, before avr-libc has set
+ up the stack pointer or the zero register, so it has to be assembler that uses neither.  It's called
+ by nobody - the startup code just falls through it.*/
+void trace_paint_stack(void) __attribute__((naked, used, section(".init1")));
+void trace_paint_stack(void)
+{
+	__asm__ volatile (
+		"ldi r30, lo8(_end)"		"\n\t"
+		"ldi r31, hi8(_end)"		"\n\t"
+		"ldi r24, %[paint]"			"\n\t"
+		"ldi r25, hi8(__stack)"		"\n\t"
+		"rjmp 2f"					"\n"
+		"1:"						"\n\t"
+		"st Z+, r24"				"\n"
+		"2:"						"\n\t"
+		"cpi r30, lo8(__stack)"		"\n\t"
+		"cpc r31, r25"				"\n\t"
+		"brlo 1b"					"\n\t"
+		"breq 1b"
+		:
+		: [paint] "M" (TRACE_STACK_PAINT)
+	);
+}
+
+/*Called from the tick ISR*/
+void trace_load(uint16_t awake)
+{
+	uint8_t bucket = (uint8_t)(awake >> TRACE_LOAD_SHIFT);
+	
+	trace_ticks++;
+	
+	if(bucket >= TRACE_LOAD_BUCKETS)
+	{
+		bucket = TRACE_LOAD_BUCKETS - 1;
+	}
+	if(0xFFFF != trace_load_counts[bucket])
+	{
+		trace_load_counts[bucket]++;
+	}
+}
+
+/*Freeze the ring and start sending it.  Marks stop being recorded until it's all gone out.*/
+void trace_request_trace(void)
+{
+	trace_frozen = TRUE;
+	trace_dump_next = 0;
+}
+
+void trace_request_profile(void)
+{
+	trace_profile_wanted = TRUE;
+}
+
+/*Bytes of stack that have never been touched*/
+static uint16_t trace_stack_unused(void)
+{
+	const uint8_t *p = &_end;
+	
+	while((p <= &__stack) && (TRACE_STACK_PAINT == *p))
+	{
+		p++;
+	}
+	
+	return (uint16_t)(p - &_end);
+}
+
+/*Send whatever's been asked for, a frame at a time and only when the UART queue has room for it, so a
+ dump never pushes out the sample stream's frames.  Call this regularly from the main loop.*/
+void trace_service(void)
+{
+	uint8_t payload[TRACE_PROFILE_SIZE];	//The bigger of the two frames
+	uint16_t value;
+	uint16_t stack_size;
+	uint8_t i, slot;
+	uint8_t *p;
+	
+	if(TRACE_RING_SIZE != trace_dump_next)
+	{
+		if(uart_tx_free() < (TRACE_FRAME_SIZE + UART_FRAME_OVERHEAD))
+		{
+			return;
+		}
+		
+		//The ring is frozen, so trace_head is the oldest entry
+		p = payload;
+		*p++ = trace_dump_next;
+		for(i = 0; i < TRACE_FRAME_ENTRIES; i++)
+		{
+			slot = (trace_head + trace_dump_next + i) & TRACE_RING_MASK;
+			*p++ = trace_ring[slot].id;
+			*p++ = trace_ring[slot].tick;
+			*p++ = (uint8_t)(trace_ring[slot].stamp);
+			*p++ = (uint8_t)(trace_ring[slot].stamp >> 8);
+		}
+		uart_send_frame(CHANNEL_TRACE,payload,TRACE_FRAME_SIZE);
+		
+		trace_dump_next += TRACE_FRAME_ENTRIES;
+		if(TRACE_RING_SIZE == trace_dump_next)
+		{
+			trace_frozen = FALSE;
+		}
+		return;
+	}
+	
+	if(TRUE == trace_profile_wanted)
+	{
+		if(uart_tx_free() < (TRACE_PROFILE_SIZE + UART_FRAME_OVERHEAD))
+		{
+			return;
+		}
+		
+		//The histogram starts over with every dump
+		p = payload;
+		for(i = 0; i < TRACE_LOAD_BUCKETS; i++)
+		{
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				value = trace_load_counts[i];
+				trace_load_counts[i] = 0;
+			}
+			*p++ = (uint8_t)(value);
+			*p++ = (uint8_t)(value >> 8);
+		}
+		
+		stack_size = (uint16_t)(&__stack - &_end) + 1;
+		value = stack_size - trace_stack_unused();
+		*p++ = (uint8_t)(value);
+		*p++ = (uint8_t)(value >> 8);
+		*p++ = (uint8_t)(stack_size);
+		*p++ = (uint8_t)(stack_size >> 8);
+		uart_send_frame(CHANNEL_PROFILE,payload,TRACE_PROFILE_SIZE);
+		
+		trace_profile_wanted = FALSE;
+	}
+}
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * trace.h
+ *
+ * On-target profiling: a cycle-stamped trace of ISR and task entries and exits, a histogram of how
+ * busy each tick was, and the deepest the stack has ever gone.  All three are dumped over the UART on
+ * request - see the command task in costume_2012.c.
+ *
+ * Everything here compiles to nothing unless TRACE_ENABLED is defined in common.h, so the markers can
+ * stay in the code for good.
+ *
+ * Trace: TRACE_ENTER()/TRACE_EXIT() write a 4-byte entry into a ring in SRAM: the marker id, the low
+ * byte of the tick count and TCNT1.  Timer1 counts CPU cycles within the tick, so tick * 10000 + TCNT1
+ * is a cycle timestamp that wraps every 320ms - plenty to see what happened in the last few ticks.
+ * The ring just overwrites its oldest entry, so it always holds the most recent TRACE_RING_SIZE marks.
+ * A mark is about 25 cycles counted from the instructions - the frozen check, reading TCNT1 and the
+ * tick, and four stores into the ring.  That's the entry itself, and a smaller entry would lose the
+ * stamp.  From the main loop TRACE_ENTER()/TRACE_EXIT() wrap it in saving SREG and turning interrupts
+ * off, a few cycles more, so an ISR can't mark halfway through.  ISRs don't need that - nothing in this
+ * firmware lets an ISR be interrupted, so they're already running with interrupts off - and use
+ * TRACE_ISR_ENTER()/TRACE_ISR_EXIT(), which leave the wrapper out.
+ *
+ * The stamp is read inside the marker, not at the event, so an ISR's entry mark includes its prologue.
+ * An entry stamped right at a tick boundary can show the old tick with a TCNT1 that has already wrapped.
+ *
+ * CPU load: every tick, the awake cycles of the tick that just ended (from power_tick()) go into one of
+ * TRACE_LOAD_BUCKETS buckets, each 512 cycles (5.12% of a tick) wide.  The last bucket also catches
+ * ticks that ran long.
+ *
+ * Stack: at reset, before even the stack pointer is set up, all of SRAM above the variables is painted
+ * with TRACE_STACK_PAINT.  The stack grows down from the top of SRAM and overwrites the paint as it
+ * goes, so the first unpainted byte from the bottom is the deepest it's ever been.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "common.h"
+
+#ifdef TRACE_ENABLED
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/*Entries in the trace ring - a power of two*/
+#define TRACE_RING_SIZE 32
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+/*Bit 7 of the id says whether it's an entry or an exit*/
+#define TRACE_EXIT_FLAG 0x80
+
+/*Marker ids.  Tasks are TRACE_ID_TASK plus their index in the task table.*/
+enum Trace_Ids
+{
+	TRACE_ID_TASK = 0x00,
+	TRACE_ID_TICK_ISR = 0x10,
+	TRACE_ID_ADC_ISR = 0x11,
+	TRACE_ID_UDRE_ISR = 0x12,
+	TRACE_ID_RX_ISR = 0x13,
+	TRACE_ID_FREEFALL_ISR = 0x14,
+	TRACE_ID_BAM_ISR = 0x15
+};
+
+/*CPU load histogram: 512 cycles per bucket*/
+#define TRACE_LOAD_SHIFT 9
+#define TRACE_LOAD_BUCKETS 20
+
+/*What's written over the free SRAM at reset*/
+#define TRACE_STACK_PAINT 0xC5
+
+/*Trace entries per CHANNEL_TRACE frame.  The payload is the index (oldest = 0) of the first entry,
+ then the entries, 4 bytes each: id, tick, TCNT1 low, TCNT1 high*/
+#define TRACE_FRAME_ENTRIES 8
+#define TRACE_FRAME_SIZE (1 + TRACE_FRAME_ENTRIES * 4)
+
+/*CHANNEL_PROFILE payload: the load histogram, then the most stack ever used and the space the stack
+ has (both in bytes), all 16-bit little-endian*/
+#define TRACE_PROFILE_SIZE (TRACE_LOAD_BUCKETS * 2 + 4)
+
+typedef struct
+{
+	uint8_t id;
+	uint8_t tick;
+	uint16_t stamp;		//TCNT1
+} trace_entry_t;
+
+extern trace_entry_t trace_ring[TRACE_RING_SIZE];
+extern uint8_t trace_head;
+extern volatile uint8_t trace_ticks;
+extern volatile boolean trace_frozen;
+
+void trace_load(uint16_t awake);
+void trace_request_trace(void);
+void trace_request_profile(void);
+void trace_service(void);
+
+/*Only with interrupts off - from an ISR, or inside trace_mark()*/
+static inline void trace_mark_isr(uint8_t id)
+{
+	trace_entry_t *entry;
+	
+	if(FALSE == trace_frozen)
+	{
+		entry = &trace_ring[trace_head];
+		entry->id = id;
+		entry->tick = trace_ticks;
+		entry->stamp = TCNT1;
+		trace_head = (trace_head + 1) & TRACE_RING_MASK;
+	}
+}
+
+/*Works from an ISR or the main loop*/
+static inline void trace_mark(uint8_t id)
+{
+	uint8_t sreg = SREG;
+	
+	cli();
+	trace_mark_isr(id);
+	SREG = sreg;
+}
+
+#define TRACE_ENTER(id) trace_mark(id)
+#define TRACE_EXIT(id) trace_mark((id) | TRACE_EXIT_FLAG)
+
+/*The same from inside an ISR, without the interrupts-off wrapper*/
+#define TRACE_ISR_ENTER(id) trace_mark_isr(id)
+#define TRACE_ISR_EXIT(id) trace_mark_isr((id) | TRACE_EXIT_FLAG)
+
+/*Call from the tick ISR with the awake cycles of the tick that just ended*/
+#define TRACE_TICK(awake) trace_load(awake)
+
+#else
+
+#define TRACE_ENTER(id)
+#define TRACE_EXIT(id)
+#define TRACE_ISR_ENTER(id)
+#define TRACE_ISR_EXIT(id)
+#define TRACE_TICK(awake) ((void)(awake))
+
+#endif
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,178 @@
+/*
+ * uart.c
+ *
+ * Interrupt-driven UART transmit queue, framing and receive queue.
+ * See uart.h for the frame format.
+ */
+
+#include "common.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "ring_buffer.h"
+#include "power.h"
+#include "trace.h"
+#include "uart.h"
+
+RING_BUFFER(uart_tx_ring,UART_TX_RING_SIZE);
+RING_BUFFER(uart_rx_ring,UART_RX_RING_SIZE);
+
+volatile boolean transmit_adc_enabled = FALSE;
+uint16_t uart_frames_dropped = 0;
+
+static uint8_t frame_sequence = 0;
+
+void uart_init(void)
+{
+	//Configure UART for 250000 8N1 Tx Communication
+	//We want to transmit accelerometer information for debug purposes
+	
+	//Step 1 - Baud rate
+	//ATMega328 Datasheet Section 20.10 - Table 20-6 pg 192
+	//Baud rate settings for fosc of 8MHZ
+	//This used to be 38.4K (U2Xn = 0, UBRRn = 12) for minimum error - which is still 0.2%, and 3840 bytes a
+	//second isn't enough for three 10-bit axes at 800Hz.  With U2Xn = 1 the baud rate is fosc/(8 * (UBRRn + 1))
+	//(Table 20-1), so 8MHz divides exactly into 1M, 500k and 250k - 0.0% error.  250k is the slowest of
+	//those, so it's the most forgiving of cables, and every USB serial adapter I have does it.
+	//U2Xn = 1
+	//UBRRn = 3
+	
+	UBRR0 = 3;
+	
+ 	//UCSR0A - UART 0 Control and Status Register A
+	//ATMega328 Datasheet Section 20.11.2 pg 194
+	//Bits 7:2 - Status bits
+	//Bit 1 - Double UART transmission speed - Yes : 1
+	//Bit 0 - Multi-Processor Communication Mode - No:0
+	
+	UCSR0A = (0x01 << 1);
+	
+	//UCSR0B - UART 0 Control and Status Register B
+	//ATMega328 Datasheet Section 20.11.3 pg 195
+	//Bit 7 - Rx Complete Interrupt Enable - The ISR queues commands for the main loop - 1
+	//Bit 6 - Tx Complete Interrupt Enable - 0
+	//Bit 5 - USART Data Register Empty interrupt enable - 0 for now, uart_put turns it on when there's data
+	//Bit 4 - Receiver Enable - Set to 1
+	//Bit 3 - Transmitter Enable - Set to 1
+	//Bit 2 - Character Size Bit 2 - Set to 0 for 8 bits
+	//Bit 1 - 9th receive bit - Ignore
+	//Bit 0 - 9th transmit bit - Ignore
+	
+	UCSR0B = 0x00	| (1 << 3)
+					| (1 << 4)
+					| (1 << 7);
+	
+	//UCSR0C - UART 0 Control and Status Register C
+	//ATMega328 Datasheet Section 20.11.4 - Pg 196
+	//BIts 7:6 - Set to asynchronous (clockless) mode: 00
+	//Bits 5:4 - Parity setting - None : 00
+	//Bit 3 - Stop select - 1 : 0
+	//Bit 2:1 - Character size - 8 : 11
+	//Bit 0 - Clock polarity: Don't care : 0
+	
+	UCSR0C = 0x03 << 1;
+}
+
+/*Queue one byte for transmission.  Never waits - returns FALSE if the queue is full.
+ Only call this from the main loop: the queue has exactly one producer.*/
+boolean uart_put(uint8_t value)
+{
+	if(FALSE == ring_put(&uart_tx_ring,value))
+	{
+		return FALSE;
+	}
+	
+	//The UDRE interrupt turns itself off when it runs out of data, so turn it back on
+	SET(UCSR0B,5);
+	return TRUE;
+}
+
+/*Space left in the transmit queue, in bytes.  It can only grow while you're looking at it.*/
+uint8_t uart_tx_free(void)
+{
+	return ring_free(&uart_tx_ring);
+}
+
+/*Take the next received byte, if there is one.  Only call this from the main loop.*/
+boolean uart_get(uint8_t *value)
+{
+	if(TRUE == ring_empty(&uart_rx_ring))
+	{
+		return FALSE;
+	}
+	
+	*value = ring_get(&uart_rx_ring);
+	return TRUE;
+}
+
+/*Queue a whole frame, or none of it.  A frame is only useful to the host if it's complete, so
+ if there isn't room for all of it the frame is dropped.  Its sequence number is used up either way -
+ that's deliberate, the gap is how the host's capture knows samples went missing (see uart.h).*/
+boolean uart_send_frame(uint8_t channel, const uint8_t *payload, uint8_t length)
+{
+	uint8_t sequence = frame_sequence++;
+	uint8_t checksum;
+	uint8_t i;
+	
+	//The length has to be checked on its own first - anything over UART_MAX_PAYLOAD can never fit, and
+	//near 255 length + UART_FRAME_OVERHEAD wraps in 8 bits and would look like it does
+	if((length > UART_MAX_PAYLOAD) || (ring_free(&uart_tx_ring) < (length + UART_FRAME_OVERHEAD)))
+	{
+		uart_frames_dropped++;
+		return FALSE;
+	}
+	
+	ring_put(&uart_tx_ring,UART_SYNC_0);
+	ring_put(&uart_tx_ring,UART_SYNC_1);
+	ring_put(&uart_tx_ring,sequence);
+	ring_put(&uart_tx_ring,channel);
+	ring_put(&uart_tx_ring,length);
+	checksum = sequence + channel + length;
+	
+	for(i = 0; i < length; i++)
+	{
+		ring_put(&uart_tx_ring,payload[i]);
+		checksum += payload[i];
+	}
+	
+	ring_put(&uart_tx_ring,(uint8_t)(0 - checksum));
+	
+	SET(UCSR0B,5);	//Start (or keep) the UDRE interrupt going
+	return TRUE;
+}
+
+//ATMega328 Datasheet Section 11.1 Table 11-1 - USART Data Register Empty vector
+//This fires whenever UDR0 can take another byte and UDRIE is set
+ISR(USART_UDRE_vect)
+{
+	power_woke();
+	TRACE_ISR_ENTER(TRACE_ID_UDRE_ISR);
+	
+	if(TRUE == ring_empty(&uart_tx_ring))
+	{
+		CLEAR(UCSR0B,5);	//Nothing left - stop interrupting until uart_put has more
+	}
+	else
+	{
+		UDR0 = ring_get(&uart_tx_ring);
+	}
+	
+	TRACE_ISR_EXIT(TRACE_ID_UDRE_ISR);
+}
+
+//ATMega328 Datasheet Section 11.1 Table 11-1 - USART Rx Complete vector
+ISR(USART_RX_vect)
+{
+	uint8_t command = UDR0;	//Reading UDR0 clears RXC0
+	
+	power_woke();
+	TRACE_ISR_ENTER(TRACE_ID_RX_ISR);
+	
+	//The commands used to be handled right here, but a dump can be bigger than the whole transmit queue.
+	//Now they're queued for the command task in the main loop, which can take its time.  If the queue
+	//is full the command is lost - send it again.
+	ring_put(&uart_rx_ring,command);
+	
+	TRACE_ISR_EXIT(TRACE_ID_RX_ISR);
+}
@@ -0,0 +1,84 @@
+/*
+ * uart.h
+ *
+ * Interrupt-driven UART: a transmit queue emptied by the UDRE interrupt, framed binary
+ * streaming on top of it, and a receive queue filled by the RX interrupt for the main loop's
+ * command task.
+ *
+ * Nothing here ever waits on the UART.  If the queue is full the data is dropped and counted
+ * instead - the sample clock is more important than the debug stream.
+ *
+ * Frame format (all multi-byte payload values are little-endian):
+ *
+ *	Byte	Contents
+ *	-------------------------------------------------------------
+ *	0		UART_SYNC_0 (0xA5)
+ *	1		UART_SYNC_1 (0x5A)
+ *	2		Sequence number - incremented for every frame, including dropped ones
+ *	3		Channel id - see enum Frame_Channels
+ *	4		Payload length N
+ *	5..N+4	Payload
+ *	N+5		Checksum - two's complement of the 8-bit sum of bytes 2..N+4, so bytes 2..N+5 sum to 0
+ *
+ * A gap in the sequence numbers means a frame never made it to the host - either the link lost it or
+ * uart_send_frame() dropped it on this end because it didn't fit.  The drops on this end are counted
+ * in uart_frames_dropped, which goes out in the tick stats, so the host can tell the two apart.  A bad
+ * checksum means it's misaligned and should hunt for the next sync word.
+ */
+
+#ifndef UART_H_
+#define UART_H_
+
+#include "common.h"
+
+#define UART_SYNC_0 0xA5
+#define UART_SYNC_1 0x5A
+
+/*Sync, sequence, channel, length and checksum*/
+#define UART_FRAME_OVERHEAD 6
+
+/*Transmit queue size - has to be a power of two no bigger than 128 (see ring_buffer.h)*/
+#define UART_TX_RING_SIZE 64
+
+/*Largest payload that can ever fit in the queue at once*/
+#define UART_MAX_PAYLOAD (UART_TX_RING_SIZE - 1 - UART_FRAME_OVERHEAD)
+
+/*Channel ids carried in byte 3 of each frame*/
+enum Frame_Channels
+{
+	CHANNEL_ACCEL_Y = 0x01,		/*Raw 8-bit Y-axis samples, oldest first*/
+	CHANNEL_ACCEL_XYZ = 0x02,	/*Compressed 10-bit X, Y and Z samples - see stream.h*/
+	CHANNEL_TICK_STATS = 0x10,	/*Timing health - see the 500ms handler in costume_2012.c*/
+	CHANNEL_FILTER_BENCH = 0x11,	/*Filter cycle counts, sent once at startup - see filter_bench.c*/
+	CHANNEL_TASK_STATS = 0x12,	/*Per-task worst/average cycles and frame overruns - see sched_report()*/
+	CHANNEL_TRACE = 0x13,		/*Trace ring dump, on request - see trace.h*/
+	CHANNEL_PROFILE = 0x14,		/*CPU load histogram and stack high water mark, on request - see trace.h*/
+	CHANNEL_FREEFALL = 0x15,	/*A fall the 0g-detect pin saw - see freefall.h*/
+	CHANNEL_BOOT = 0x16,		/*Boot calibration, self-test and time to valid output, once - see task_boot()*/
+	CHANNEL_BLACKBOX = 0x17		/*The black box recorder's window, on request - see blackbox.h*/
+};
+
+/*Receive queue size - a power of two.  Commands are one byte each and nobody types that fast.*/
+#define UART_RX_RING_SIZE 16
+
+/*Commands received on the UART*/
+#define UART_CMD_TOGGLE_STREAM 0x30	//'0' - toggle sample streaming
+#define UART_CMD_STREAM_FORMAT 0x31	//'1' - switch between raw Y samples and the compressed X, Y, Z stream
+#define UART_CMD_BLACKBOX_DUMP 0x42	//'B' - send the black box recorder's window and start it recording again
+#define UART_CMD_PROFILE_DUMP 0x50	//'P' - send the CPU load histogram and stack high water mark
+#define UART_CMD_TRACE_DUMP 0x54	//'T' - send the trace ring
+
+/*Sample streaming is toggled by the command task*/
+extern volatile boolean transmit_adc_enabled;
+
+/*Frames that didn't fit in the transmit queue, or were too long to ever fit - each one left a gap in
+ the sequence numbers*/
+extern uint16_t uart_frames_dropped;
+
+void uart_init(void);
+boolean uart_put(uint8_t value);
+uint8_t uart_tx_free(void);
+boolean uart_get(uint8_t *value);
+boolean uart_send_frame(uint8_t channel, const uint8_t *payload, uint8_t length);
+
+#endif /* UART_H_ */
@@ -0,0 +1,728 @@
+/*
+ * costume_sim.c
+ *
+ * Runs the real firmware ELF headless under simavr - no board, no accelerometer - and checks how long
+ * everything takes.  Every change gets the same cycle-accurate numbers on any Linux machine.
+ *
+ *	costume_sim [-s seconds] [-b budgets [-w new budgets]] [-u uart.bin] [-p pwm.csv] [-n noise] [-c commands]
+ *				[-g seconds] firmware.elf capture
+ *
+ *	-s seconds		Simulated time to run for (default 10)
+ *	-b budgets		Check every measurement against a budget file (budgets.txt) and exit non-zero if
+ *					anything is over, or a budgeted measurement never turned up
+ *	-w new budgets	Also write the budget file back out with every limit set from this run: the measurement
+ *					plus a quarter (BUDGET_HEADROOM), comments and order kept.  A limit of 0 stays 0.
+ *					'make budgets' does this - check the diff before copying it over budgets.txt.
+ *	-u uart.bin		Save everything the firmware sent - host/decode reads it
+ *	-p pwm.csv		Log every light PWM change as cycle,light,value
+ *	-n noise		Counts of uniform noise added to each 10-bit ADC sample (default 1).  The
+ *					oversampling in adc_scan.c needs noise to work with, like the real accelerometer has.
+ *	-c commands		Sent to the firmware's UART 100ms in (default "0" - start streaming, which
+ *					also turns on the timing reports)
+ *	-g seconds		Drop the costume this far in: 0G detect goes high for 300ms, bouncing as it goes high
+ *					and again as it goes low, like the real one
+ *
+ * The capture is fed into the ADC one tick at a time, the same way replay feeds the chain: a raw file of
+ * 8-bit Y samples, or a capture file (host/capfile.h) - accel_x, accel_y and accel_z if it has them,
+ * accel_y8 if it doesn't.  Axes that aren't in the capture sit at 0g (X) and 1g (Z), and 0G detect
+ * stays low unless -g says otherwise.  When the capture runs out it starts again from the top.  For the
+ * first REST_SECONDS every axis sits still at 0g, 0g, 1g instead, like a costume switched on lying flat,
+ * so the boot calibration has something to measure.
+ *
+ * What gets measured:
+ *
+ *	stretch_max		Longest the CPU was ever awake in one go, in cycles.  The main loop sleeps as soon
+ *					as a tick's work is done, so this is the worst main-loop frame, ISRs and all.
+ *					Anything near 10000 is a frame that ran into the next tick.
+ *	load_permille	Cycles awake out of every 1000, from the end of startup to the end of the run
+ *	task.<name>.worst, task.<name>.mean
+ *					The scheduler's own per-task cycle counts (CHANNEL_TASK_STATS, see sched_report()),
+ *					worst over the run
+ *	frame_overruns	Ticks the scheduler didn't get to in time (CHANNEL_TASK_STATS)
+ *	tick_overruns, tick_late_max, adc_overruns, uart_dropped
+ *					From CHANNEL_TICK_STATS
+ *	filter.lp.max, filter.hp.max, filter.biquad.max, filter.mismatches
+ *					From the startup filter benchmark (CHANNEL_FILTER_BENCH) - build with FILTER_BENCHMARK,
+ *					which 'make sim' in proj/ does
+ *	bad_checksums, missed_frames
+ *					Anything wrong with the UART stream itself
+ *	freefall.latency	Cycles from 0G detect going high to all three light pins being high - the alert
+ *					(see lights_alert()).  Any one pin going high on its own is a PWM, BAM or fade edge
+ *					that was going to happen anyway, so it doesn't count.  -g only.
+ *	freefall.events	Falls the firmware reported (CHANNEL_FREEFALL) - a bouncing pin still has to be one
+ *	boot.valid_ms	From the first tick to the first motion output from a calibrated bias (CHANNEL_BOOT)
+ *	boot.selftest_failures
+ *					Boot self-test checks that failed - still, in range, 1g (CHANNEL_BOOT)
+ *
+ * The numbers that come from the firmware are timed with Timer1 on the simulated AVR, so they're as
+ * cycle-accurate as simavr is.  stretch_max and load_permille are counted by the simulator itself and
+ * don't depend on the firmware's bookkeeping being right.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "sim_irq.h"
+#include "avr_adc.h"
+#include "avr_ioport.h"
+#include "avr_timer.h"
+#include "avr_uart.h"
+
+#include "common.h"
+#include "uart.h"
+#include "adc_scan.h"
+#include "frames.h"
+#include "capfile.h"
+
+/*ADC reference - AVCC, see main()*/
+#define AVCC_MILLIVOLTS 5000
+
+/*MMA7361L at 1.5g: 0g is half the supply and 1g is 800mV more - in 10-bit counts on a 5V reference*/
+#define ZERO_G_COUNTS 338
+#define ONE_G_COUNTS 502
+
+/*The costume lies still this long before the capture starts - see above*/
+#define REST_SECONDS 0.25
+
+/*When the commands go in - after the firmware's done starting up*/
+#define COMMAND_SECONDS 0.1
+
+#define MAX_METRICS 64
+
+/*-w sets each limit to the measurement plus 1/BUDGET_HEADROOM of it*/
+#define BUDGET_HEADROOM 4
+
+/*The light pins, as bits of sim_t.light_pins*/
+#define PIN_GREEN 0x01
+#define PIN_YELLOW 0x02
+#define PIN_RED 0x04
+#define PINS_ALERT (PIN_GREEN | PIN_YELLOW | PIN_RED)
+
+/*How long a simulated fall holds 0G detect high - about a 45cm drop*/
+#define FALL_CYCLES (F_CPU * 3 / 10)
+
+/*0G detect during a simulated fall, in cycles from the start of it: 20us of chatter on the way up and
+ again on the way down*/
+static const struct
+{
+	unsigned long cycles;
+	uint32_t level;
+} fall_edges[] =
+{
+	{0, 1}, {160, 0}, {320, 1},
+	{FALL_CYCLES, 0}, {FALL_CYCLES + 160, 1}, {FALL_CYCLES + 320, 0}
+};
+#define FALL_EDGES (sizeof(fall_edges) / sizeof(fall_edges[0]))
+
+/*The scheduler's tasks, in enum Tasks order (costume_2012.c)*/
+static const char *task_names[] = {"samples", "decimate", "heartbeat", "tick_stats", "task_stats", "commands", "boot"};
+#define TASK_NAMES (sizeof(task_names) / sizeof(task_names[0]))
+
+typedef struct
+{
+	char name[48];
+	unsigned long value;
+} metric_t;
+
+typedef struct
+{
+	avr_t *avr;
+	avr_irq_t *adc_inputs[ADC_SCAN_CHANNELS];
+	uint16_t *axes[ADC_SCAN_AXES];	/*10-bit counts, or NULL to sit still*/
+	size_t samples;
+	unsigned int noise;
+	uint32_t random;
+	frames_parser_t parser;
+	FILE *uart_out;
+	FILE *pwm_out;
+	avr_cycle_count_t fall_start;	/*When the first 0G detect edge went in - 0 until it has*/
+	int fall_seen;					/*TRUE once the alert has shown on the pins since*/
+	uint8_t light_pins;				/*PIN_* bits for the light pins that are high*/
+	unsigned long falls;
+	metric_t metrics[MAX_METRICS];
+	int metric_count;
+} sim_t;
+
+/*Keep the worst value seen for a measurement*/
+static void metric(sim_t *sim, const char *name, unsigned long value)
+{
+	int i;
+
+	for(i = 0; i < sim->metric_count; i++)
+	{
+		if(0 == strcmp(sim->metrics[i].name, name))
+		{
+			if(value > sim->metrics[i].value)
+			{
+				sim->metrics[i].value = value;
+			}
+			return;
+		}
+	}
+	if(sim->metric_count < MAX_METRICS)
+	{
+		snprintf(sim->metrics[sim->metric_count].name, sizeof(sim->metrics[0].name), "%s", name);
+		sim->metrics[sim->metric_count++].value = value;
+	}
+}
+
+static unsigned int get16(const uint8_t *payload, int index)
+{
+	return payload[2 * index] | ((unsigned int)payload[2 * index + 1] << 8);
+}
+
+static void on_frame(void *context, uint8_t channel, const uint8_t *payload, uint8_t length, unsigned int missed)
+{
+	sim_t *sim = context;
+	char name[48];
+	unsigned int i;
+
+	(void)missed;
+	switch(channel)
+	{
+		case CHANNEL_TASK_STATS:
+			for(i = 0; i < (unsigned int)(length - 2) / 4 && i < TASK_NAMES; i++)
+			{
+				snprintf(name, sizeof(name), "task.%s.worst", task_names[i]);
+				metric(sim, name, get16(payload, 2 * i));
+				snprintf(name, sizeof(name), "task.%s.mean", task_names[i]);
+				metric(sim, name, get16(payload, 2 * i + 1));
+			}
+			metric(sim, "frame_overruns", get16(payload, (length - 2) / 2));
+			break;
+		case CHANNEL_TICK_STATS:
+			if(length >= 12)
+			{
+				metric(sim, "tick_late_max", get16(payload, 1));
+				metric(sim, "tick_overruns", get16(payload, 3));
+				metric(sim, "adc_overruns", get16(payload, 4));
+				metric(sim, "uart_dropped", get16(payload, 5));
+			}
+			break;
+		case CHANNEL_FILTER_BENCH:
+			if(length >= 24)
+			{
+				metric(sim, "filter.lp.max", get16(payload, 4));
+				metric(sim, "filter.hp.max", get16(payload, 8));
+				metric(sim, "filter.mismatches", get16(payload, 9));
+				metric(sim, "filter.biquad.max", get16(payload, 11));
+			}
+			break;
+		case CHANNEL_BOOT:
+			if(length >= 6)
+			{
+				metric(sim, "boot.valid_ms", (get16(payload, 0) | ((unsigned long)get16(payload, 1) << 16)) / (F_CPU / 1000));
+				//CAL_STILL, CAL_IN_RANGE and CAL_ONE_G_OK - proj/calibrate.h
+				metric(sim, "boot.selftest_failures",
+					   ((payload[5] & 0x01) ? 0 : 1) + ((payload[5] & 0x02) ? 0 : 1) + ((payload[5] & 0x04) ? 0 : 1));
+			}
+			break;
+		case CHANNEL_FREEFALL:
+			metric(sim, "freefall.events", ++sim->falls);
+			break;
+		default:
+			break;
+	}
+}
+
+static void on_uart_byte(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	sim_t *sim = param;
+	uint8_t byte = (uint8_t)value;
+
+	(void)irq;
+	frames_feed(&sim->parser, &byte, 1);
+	if(NULL != sim->uart_out)
+	{
+		fputc(byte, sim->uart_out);
+	}
+}
+
+/*The ADC is about to convert a channel - put this tick's value on it*/
+static void on_adc_trigger(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	sim_t *sim = param;
+	union
+	{
+		avr_adc_mux_t mux;
+		uint32_t value;
+	} event = {.value = value};
+	size_t sample = (size_t)(sim->avr->cycle / (F_CPU / TICK_HZ)) % sim->samples;
+	int32_t counts;
+	unsigned int channel = event.mux.src;
+
+	(void)irq;
+	if(ADC_MUX_SINGLE != event.mux.kind || channel >= ADC_SCAN_CHANNELS)
+	{
+		return;
+	}
+
+	if(NULL != sim->axes[channel] && sim->avr->cycle >= (avr_cycle_count_t)(REST_SECONDS * F_CPU))
+	{
+		counts = sim->axes[channel][sample];
+	}
+	else
+	{
+		counts = (ADC_ACCEL_Z == channel) ? ONE_G_COUNTS : ZERO_G_COUNTS;
+	}
+	if(0 != sim->noise)
+	{
+		sim->random = sim->random * 1103515245u + 12345u;	//Same noise every run
+		counts += (int32_t)((sim->random >> 16) % (2 * sim->noise + 1)) - (int32_t)sim->noise;
+	}
+	counts = (counts < 0) ? 0 : (counts > 1023) ? 1023 : counts;
+
+	avr_raise_irq(sim->adc_inputs[channel], (uint32_t)((counts * AVCC_MILLIVOLTS + 511) / 1023));
+}
+
+static void on_pwm(sim_t *sim, const char *light, uint32_t value)
+{
+	if(NULL != sim->pwm_out)
+	{
+		fprintf(sim->pwm_out, "%llu,%s,%u\n", (unsigned long long)sim->avr->cycle, light, value);
+	}
+}
+
+/*Timer1 OCR1A, Timer0 OCR0A and OCR0B - see lights.c*/
+static void on_pwm_1a(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	(void)irq;
+	on_pwm(param, "OCR1A", value);
+}
+
+static void on_pwm_0a(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	(void)irq;
+	on_pwm(param, "OCR0A", value);
+}
+
+static void on_pwm_0b(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	(void)irq;
+	on_pwm(param, "OCR0B", value);
+}
+
+/*PB1, PD6 and PD5.  The free-fall alert drives all three high at once (see lights.h).  Nothing else
+ ever lights all three - the streetlight shows one, and a fade between two leaves the third off - so all
+ three high is the alert and not an edge that was already coming.*/
+static void on_light_pin(sim_t *sim, uint8_t pin, uint32_t value)
+{
+	if(0 != value)
+	{
+		sim->light_pins |= pin;
+	}
+	else
+	{
+		sim->light_pins &= (uint8_t)~pin;
+	}
+
+	if(0 != sim->fall_start && !sim->fall_seen && PINS_ALERT == sim->light_pins)
+	{
+		metric(sim, "freefall.latency", (unsigned long)(sim->avr->cycle - sim->fall_start));
+		sim->fall_seen = 1;
+	}
+}
+
+static void on_green_pin(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	(void)irq;
+	on_light_pin(param, PIN_GREEN, value);
+}
+
+static void on_yellow_pin(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	(void)irq;
+	on_light_pin(param, PIN_YELLOW, value);
+}
+
+static void on_red_pin(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	(void)irq;
+	on_light_pin(param, PIN_RED, value);
+}
+
+/*Load the capture's axes as 10-bit counts*/
+static int load_capture(sim_t *sim, const char *path)
+{
+	static const char *wide_names[ADC_SCAN_AXES] = {"accel_x", "accel_y", "accel_z"};
+	uint8_t *bytes = NULL;
+	size_t i;
+	int axis;
+
+	if(capfile_is_capture(path))
+	{
+		capfile_t file;
+		uint64_t rows;
+		const uint8_t *narrow;
+
+		if(0 != capfile_open(&file, path))
+		{
+			return -1;
+		}
+		for(axis = 0; axis < ADC_SCAN_AXES; axis++)
+		{
+			const uint16_t *wide = capfile_data(&file, capfile_find(&file, wide_names[axis]), CAPFILE_U16, &rows);
+
+			if(NULL != wide && rows > 0)
+			{
+				sim->samples = (0 == sim->samples || rows < sim->samples) ? (size_t)rows : sim->samples;
+				sim->axes[axis] = malloc((size_t)rows * sizeof(uint16_t));
+				if(NULL != sim->axes[axis])
+				{
+					memcpy(sim->axes[axis], wide, (size_t)rows * sizeof(uint16_t));
+				}
+			}
+		}
+		if(0 == sim->samples)
+		{
+			narrow = capfile_data(&file, capfile_find(&file, "accel_y8"), CAPFILE_U8, &rows);
+			if(NULL != narrow && rows > 0)
+			{
+				bytes = malloc((size_t)rows);
+				if(NULL != bytes)
+				{
+					memcpy(bytes, narrow, (size_t)rows);
+					sim->samples = (size_t)rows;
+				}
+			}
+		}
+		capfile_close(&file);
+	}
+	else
+	{
+		FILE *raw = fopen(path, "rb");
+		size_t allocated = 4096;
+
+		if(NULL == raw)
+		{
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			return -1;
+		}
+		bytes = malloc(allocated);
+		while(NULL != bytes)
+		{
+			size_t got = fread(bytes + sim->samples, 1, allocated - sim->samples, raw);
+
+			sim->samples += got;
+			if(sim->samples < allocated)
+			{
+				break;
+			}
+			allocated *= 2;
+			bytes = realloc(bytes, allocated);
+		}
+		fclose(raw);
+	}
+
+	if(NULL != bytes)
+	{
+		//8-bit Y samples - put them back to 10 bits
+		sim->axes[ADC_ACCEL_Y] = malloc(sim->samples * sizeof(uint16_t));
+		for(i = 0; NULL != sim->axes[ADC_ACCEL_Y] && i < sim->samples; i++)
+		{
+			sim->axes[ADC_ACCEL_Y][i] = (uint16_t)(bytes[i] << 2);
+		}
+		free(bytes);
+	}
+
+	if(0 == sim->samples)
+	{
+		fprintf(stderr, "%s: no samples\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/*Compare every measurement against the budget file.  If out isn't NULL the file is copied there with
+ every limit set from this run - see -w.  Returns the number of failures.*/
+static int check_budgets(const sim_t *sim, const char *path, FILE *out)
+{
+	FILE *budgets = fopen(path, "r");
+	char line[256], name[48];
+	unsigned long limit, measured;
+	int failures = 0, line_number = 0, i;
+
+	if(NULL == budgets)
+	{
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	while(NULL != fgets(line, sizeof(line), budgets))
+	{
+		line_number++;
+		if(2 != sscanf(line, "%47s %lu", name, &limit) || '#' == name[0])
+		{
+			if(NULL != out)
+			{
+				fputs(line, out);
+			}
+			continue;
+		}
+		for(i = 0; i < sim->metric_count && 0 != strcmp(sim->metrics[i].name, name); i++)
+		{
+		}
+		if(NULL != out)
+		{
+			/*A limit of 0 is a rule, not a measurement - it stays, and a run that broke it still fails*/
+			measured = (i == sim->metric_count) ? limit : sim->metrics[i].value;
+			fprintf(out, "%-27s %lu\n", name, (0 == limit) ? 0 : measured + measured / BUDGET_HEADROOM);
+		}
+		if(i == sim->metric_count)
+		{
+			printf("FAIL  %-24s never reported (%s:%d)\n", name, path, line_number);
+			failures++;
+		}
+		else if(sim->metrics[i].value > limit)
+		{
+			printf("FAIL  %-24s %8lu > %lu (%s:%d)\n", name, sim->metrics[i].value, limit, path, line_number);
+			failures++;
+		}
+		else
+		{
+			printf("ok    %-24s %8lu <= %lu\n", name, sim->metrics[i].value, limit);
+		}
+	}
+
+	fclose(budgets);
+	return failures;
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [-s seconds] [-b budgets [-w new budgets]] [-u uart.bin] [-p pwm.csv] [-n noise] "
+			"[-c commands] [-g seconds] firmware.elf capture\n", program);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	static sim_t sim;
+	elf_firmware_t firmware;
+	const char *budgets = NULL, *commands = "0";
+	FILE *new_budgets = NULL;
+	double seconds = 10.0, fall_seconds = -1.0;
+	avr_cycle_count_t end, command_cycle, fall_cycle = 0, woke = 0, awake = 0, booted = 0;
+	avr_irq_t *zero_g;
+	size_t fall_edge = FALL_EDGES;
+	int state, previous = cpu_Running, option, channel, failures = 0;
+	uint32_t flags = 0;
+
+	sim.noise = 1;
+	sim.random = 1;
+	while(-1 != (option = getopt(argc, argv, "s:b:w:u:p:n:c:g:")))
+	{
+		switch(option)
+		{
+			case 's':
+				seconds = atof(optarg);
+				break;
+			case 'b':
+				budgets = optarg;
+				break;
+			case 'w':
+				new_budgets = fopen(optarg, "w");
+				if(NULL == new_budgets)
+				{
+					fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+					return 1;
+				}
+				break;
+			case 'u':
+				sim.uart_out = fopen(optarg, "wb");
+				if(NULL == sim.uart_out)
+				{
+					fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+					return 1;
+				}
+				break;
+			case 'p':
+				sim.pwm_out = fopen(optarg, "w");
+				if(NULL == sim.pwm_out)
+				{
+					fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+					return 1;
+				}
+				break;
+			case 'n':
+				sim.noise = (unsigned int)atoi(optarg);
+				break;
+			case 'c':
+				commands = optarg;
+				break;
+			case 'g':
+				fall_seconds = atof(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(optind + 2 != argc || seconds <= 0.0 || (NULL != new_budgets && NULL == budgets))
+	{
+		usage(argv[0]);
+	}
+
+	if(0 != load_capture(&sim, argv[optind + 1]))
+	{
+		return 1;
+	}
+
+	memset(&firmware, 0, sizeof(firmware));
+	if(0 != elf_read_firmware(argv[optind], &firmware))
+	{
+		fprintf(stderr, "%s: couldn't read the firmware\n", argv[optind]);
+		return 1;
+	}
+	sim.avr = avr_make_mcu_by_name("atmega328p");
+	if(NULL == sim.avr)
+	{
+		fprintf(stderr, "simavr doesn't know the atmega328p\n");
+		return 1;
+	}
+	avr_init(sim.avr);
+	avr_load_firmware(sim.avr, &firmware);
+	sim.avr->frequency = F_CPU;
+	sim.avr->avcc = AVCC_MILLIVOLTS;
+	sim.avr->aref = AVCC_MILLIVOLTS;
+
+	//UART - collect the bytes instead of letting simavr print them
+	avr_ioctl(sim.avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(sim.avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	avr_irq_register_notify(avr_io_getirq(sim.avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), on_uart_byte, &sim);
+	frames_init(&sim.parser, on_frame, &sim);
+
+	//ADC - a value on every channel as it's converted
+	for(channel = 0; channel < ADC_SCAN_CHANNELS; channel++)
+	{
+		sim.adc_inputs[channel] = avr_io_getirq(sim.avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0 + channel);
+	}
+	avr_irq_register_notify(avr_io_getirq(sim.avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_OUT_TRIGGER), on_adc_trigger, &sim);
+
+	//Lights
+	avr_irq_register_notify(avr_io_getirq(sim.avr, AVR_IOCTL_TIMER_GETIRQ('1'), TIMER_IRQ_OUT_PWM0), on_pwm_1a, &sim);
+	avr_irq_register_notify(avr_io_getirq(sim.avr, AVR_IOCTL_TIMER_GETIRQ('0'), TIMER_IRQ_OUT_PWM0), on_pwm_0a, &sim);
+	avr_irq_register_notify(avr_io_getirq(sim.avr, AVR_IOCTL_TIMER_GETIRQ('0'), TIMER_IRQ_OUT_PWM1), on_pwm_0b, &sim);
+	avr_irq_register_notify(avr_io_getirq(sim.avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 1), on_green_pin, &sim);
+	avr_irq_register_notify(avr_io_getirq(sim.avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 6), on_yellow_pin, &sim);
+	avr_irq_register_notify(avr_io_getirq(sim.avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 5), on_red_pin, &sim);
+
+	//0G detect - PC3
+	zero_g = avr_io_getirq(sim.avr, AVR_IOCTL_IOPORT_GETIRQ('C'), 3);
+	avr_raise_irq(zero_g, 0);
+	if(fall_seconds >= 0.0)
+	{
+		fall_cycle = (avr_cycle_count_t)(fall_seconds * F_CPU);
+		fall_edge = 0;
+	}
+
+	end = (avr_cycle_count_t)(seconds * F_CPU);
+	command_cycle = (avr_cycle_count_t)(COMMAND_SECONDS * F_CPU);
+
+	while(sim.avr->cycle < end)
+	{
+		state = avr_run(sim.avr);
+		if(cpu_Done == state || cpu_Crashed == state)
+		{
+			fprintf(stderr, "firmware %s at cycle %llu\n", (cpu_Crashed == state) ? "crashed" : "stopped",
+					(unsigned long long)sim.avr->cycle);
+			return 1;
+		}
+
+		//Awake stretches - from waking up to going back to sleep.  The first one is the whole of
+		//startup, which isn't a frame, so the counting starts when it first goes to sleep.
+		if(cpu_Sleeping == state && cpu_Sleeping != previous)
+		{
+			if(0 != booted)
+			{
+				awake += sim.avr->cycle - woke;
+				metric(&sim, "stretch_max", (unsigned long)(sim.avr->cycle - woke));
+			}
+			else
+			{
+				booted = sim.avr->cycle;
+			}
+		}
+		else if(cpu_Sleeping != state && cpu_Sleeping == previous)
+		{
+			woke = sim.avr->cycle;
+		}
+		previous = state;
+
+		if(NULL != commands && sim.avr->cycle >= command_cycle)
+		{
+			avr_irq_t *input = avr_io_getirq(sim.avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+
+			while('\0' != *commands)
+			{
+				avr_raise_irq(input, (uint8_t)*commands++);
+			}
+			commands = NULL;
+		}
+
+		if(fall_edge < FALL_EDGES && sim.avr->cycle >= fall_cycle + fall_edges[fall_edge].cycles)
+		{
+			if(0 == fall_edge)
+			{
+				sim.fall_start = sim.avr->cycle;
+			}
+			avr_raise_irq(zero_g, fall_edges[fall_edge++].level);
+		}
+	}
+	if(0 == booted)
+	{
+		fprintf(stderr, "firmware never went to sleep - it's stuck starting up, or every frame overruns\n");
+		return 1;
+	}
+	if(cpu_Sleeping != previous)
+	{
+		awake += sim.avr->cycle - woke;
+	}
+
+	metric(&sim, "load_permille", (unsigned long)(awake * 1000 / (sim.avr->cycle - booted)));
+	metric(&sim, "bad_checksums", sim.parser.stats.bad_checksums);
+	metric(&sim, "missed_frames", sim.parser.stats.missed_frames);
+
+	printf("%s: %.1f simulated seconds, %lu frames from the UART\n\n", argv[optind], seconds, sim.parser.stats.frames);
+	if(NULL != budgets)
+	{
+		failures = check_budgets(&sim, budgets, new_budgets);
+	}
+	else
+	{
+		for(channel = 0; channel < sim.metric_count; channel++)
+		{
+			printf("%-24s %8lu\n", sim.metrics[channel].name, sim.metrics[channel].value);
+		}
+	}
+
+	if(NULL != new_budgets)
+	{
+		fclose(new_budgets);
+	}
+	if(NULL != sim.uart_out)
+	{
+		fclose(sim.uart_out);
+	}
+	if(NULL != sim.pwm_out)
+	{
+		fclose(sim.pwm_out);
+	}
+	avr_terminate(sim.avr);
+
+	if(0 != failures)
+	{
+		printf("\n%d over budget\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,316 @@
+/*
+ * biquad_design.c
+ *
+ * Butterworth biquad design and quantization - see biquad_design.h.
+ *
+ * Each filter is a Butterworth low-pass or high-pass designed with the bilinear transform, with the
+ * cutoff pre-warped so it lands where it's asked to.  An order N filter is split into N/2 second-order
+ * sections (plus a first-order one if N is odd), each with unity gain in its pass band.
+ *
+ * Quantization is where the worksheet used to go wrong, so it's done carefully:
+ *	- a1 and a2 are rounded to a_frac fraction bits first.
+ *	- The b's are then scaled so the pass-band gain of the *rounded* section is exactly 1.
+ *	- The b's are stored as b0 times the exact pattern [1 2 1] or [1 -2 1] so a low-pass passes DC
+ *	  exactly and a high-pass blocks it exactly.
+ *	- b_shift is the biggest shift that keeps every b inside the coefficient width.
+ */
+
+#include <ctype.h>
+#include <complex.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "biquad_design.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*dc_gain is always Q2.14 - BIQUAD_DC_GAIN_FRAC_BITS in biquad.h*/
+#define DC_GAIN_FRAC_BITS 14
+
+static int64_t quantize(double value, int frac_bits)
+{
+	return (int64_t)llround(ldexp(value, frac_bits));
+}
+
+static int64_t magnitude(int64_t value)
+{
+	return (value < 0) ? -value : value;
+}
+
+/*Design one section from its (normalized, pre-warped) analog prototype.
+ Second order: H(s) = 1/(s^2 + q s + 1) or s^2/(s^2 + q s + 1).  First order (q < 0): 1/(s + 1) or s/(s + 1).
+ w is tan(pi fc/fs), so s = (1/w)(z - 1)/(z + 1).*/
+static int design_section(design_section_t *section, const design_filter_t *filter, double q, double w)
+{
+	double a0, a1, a2, b[3], pattern[3], gain_quantized, ideal_gain, pattern_gain;
+	int64_t limit = ((int64_t)1 << (filter->width - 1)) - 1;
+	int64_t one = (int64_t)1 << filter->a_frac;
+	int first_order = (q < 0.0);
+	int highpass = filter->highpass;
+	int shift, i;
+
+	if(first_order)
+	{
+		a0 = 1.0 + w;
+		a1 = (w - 1.0) / a0;
+		a2 = 0.0;
+		pattern[0] = 1.0;
+		pattern[1] = highpass ? -1.0 : 1.0;
+		pattern[2] = 0.0;
+	}
+	else
+	{
+		a0 = 1.0 + q * w + w * w;
+		a1 = (2.0 * w * w - 2.0) / a0;
+		a2 = (1.0 - q * w + w * w) / a0;
+		pattern[0] = 1.0;
+		pattern[1] = highpass ? -2.0 : 2.0;
+		pattern[2] = 1.0;
+	}
+
+	section->a1 = quantize(a1, filter->a_frac);
+	section->a2 = quantize(a2, filter->a_frac);
+	if(magnitude(section->a1) > limit || magnitude(section->a2) > limit)
+	{
+		return DESIGN_BAD_FORMAT;
+	}
+
+	/*Gain of 1 at DC (z = 1) for a low-pass, at Nyquist (z = -1) for a high-pass, using the rounded a's*/
+	if(highpass)
+	{
+		gain_quantized = 1.0 - ldexp((double)section->a1, -filter->a_frac) + ldexp((double)section->a2, -filter->a_frac);
+		ideal_gain = 1.0 - a1 + a2;
+		pattern_gain = pattern[0] - pattern[1] + pattern[2];
+	}
+	else
+	{
+		gain_quantized = 1.0 + ldexp((double)section->a1, -filter->a_frac) + ldexp((double)section->a2, -filter->a_frac);
+		ideal_gain = 1.0 + a1 + a2;
+		pattern_gain = pattern[0] + pattern[1] + pattern[2];
+	}
+
+	/*Rounding can push poles that were just inside the unit circle onto or past it.  The stability
+	 triangle for a biquad is |a2| < 1 and |a1| < 1 + a2.  A pole right on z = 1 is an integrator, which
+	 never forgets a rounding error.*/
+	if(magnitude(section->a2) >= one || magnitude(section->a1) >= one + section->a2)
+	{
+		return DESIGN_UNSTABLE;
+	}
+
+	for(i = 0; i < 3; i++)
+	{
+		b[i] = pattern[i] * (gain_quantized / pattern_gain);
+		section->ideal_b[i] = pattern[i] * (ideal_gain / pattern_gain);
+	}
+	section->ideal_a[0] = a1;
+	section->ideal_a[1] = a2;
+
+	/*Largest shift where the biggest b (which is b1 = 2 b0 for a second-order section) still fits*/
+	for(shift = filter->width - 1; shift > -16; shift--)
+	{
+		int64_t b0 = quantize(b[0], 16 + shift);
+
+		if(magnitude(b0 * (int64_t)fabs(pattern[1])) <= limit && b0 != 0)
+		{
+			break;
+		}
+	}
+
+	section->b_shift = shift;
+	section->b0 = quantize(b[0], 16 + shift);
+	section->b1 = section->b0 * (int64_t)pattern[1];
+	section->b2 = section->b0 * (int64_t)pattern[2];
+	section->dc_gain = highpass ? 0 : (1 << DC_GAIN_FRAC_BITS);
+	section->pole_radius = first_order ? fabs(ldexp((double)section->a1, -filter->a_frac))
+									   : sqrt(fabs(ldexp((double)section->a2, -filter->a_frac)));
+	return DESIGN_OK;
+}
+
+/*Fill in filter->section[] from the name, type, order, cutoff, sample rate, width and a_frac.
+ Returns DESIGN_OK or one of enum Design_Errors.*/
+int design_filter(design_filter_t *filter)
+{
+	double w;
+	int k, error = DESIGN_OK;
+
+	filter->sections = 0;
+	if(filter->order < 1 || (filter->order + 1) / 2 > DESIGN_MAX_SECTIONS)
+	{
+		return DESIGN_BAD_ORDER;
+	}
+	if(filter->cutoff_hz <= 0.0 || filter->cutoff_hz >= filter->sample_hz / 2.0)
+	{
+		return DESIGN_BAD_CUTOFF;
+	}
+	/*Two integer bits at least (|a1| < 2), and nothing the shifts in fixed_point.h can't handle*/
+	if(filter->width < 8 || filter->width > 32 || filter->a_frac < 1 || filter->a_frac > filter->width - 2)
+	{
+		return DESIGN_BAD_FORMAT;
+	}
+
+	w = tan(M_PI * filter->cutoff_hz / filter->sample_hz);
+
+	/*Butterworth pole pairs: q = 2 sin((2k - 1) pi / 2N)*/
+	for(k = 1; k <= filter->order / 2 && DESIGN_OK == error; k++)
+	{
+		double q = 2.0 * sin((2.0 * k - 1.0) * M_PI / (2.0 * filter->order));
+		error = design_section(&filter->section[filter->sections++], filter, q, w);
+	}
+	if((filter->order & 1) && DESIGN_OK == error)
+	{
+		error = design_section(&filter->section[filter->sections++], filter, -1.0, w);
+	}
+
+	return error;
+}
+
+const char *design_error(int error)
+{
+	switch(error)
+	{
+	case DESIGN_OK:
+		return "no error";
+	case DESIGN_BAD_ORDER:
+		return "order must be 1 to 16";
+	case DESIGN_BAD_CUTOFF:
+		return "cutoff must be between 0 and half the sample rate";
+	case DESIGN_BAD_FORMAT:
+		return "the coefficients don't fit - a1 needs two integer bits";
+	case DESIGN_UNSTABLE:
+		return "poles are too close to z = 1 to survive rounding - "
+			   "use a lower order or move the cutoff away from 0 and fs/2";
+	}
+	return "unknown error";
+}
+
+/*Magnitude of the whole cascade at hz, with the rounded coefficients or the ideal ones*/
+double design_response(const design_filter_t *filter, double hz, int quantized)
+{
+	double complex z1 = cexp(-I * 2.0 * M_PI * hz / filter->sample_hz);	//z^-1
+	double complex z2 = z1 * z1;
+	double gain = 1.0;
+	int s;
+
+	for(s = 0; s < filter->sections; s++)
+	{
+		const design_section_t *section = &filter->section[s];
+		double b0, b1, b2, a1, a2;
+
+		if(quantized)
+		{
+			b0 = ldexp((double)section->b0, -(16 + section->b_shift));
+			b1 = ldexp((double)section->b1, -(16 + section->b_shift));
+			b2 = ldexp((double)section->b2, -(16 + section->b_shift));
+			a1 = ldexp((double)section->a1, -filter->a_frac);
+			a2 = ldexp((double)section->a2, -filter->a_frac);
+		}
+		else
+		{
+			b0 = section->ideal_b[0];
+			b1 = section->ideal_b[1];
+			b2 = section->ideal_b[2];
+			a1 = section->ideal_a[0];
+			a2 = section->ideal_a[1];
+		}
+		gain *= cabs((b0 + b1 * z1 + b2 * z2) / (1.0 + a1 * z1 + a2 * z2));
+	}
+
+	return gain;
+}
+
+/*What a Butterworth of this order and cutoff should do at hz - the bilinear transform squeezes the
+ whole analog axis into 0 to fs/2, so it's the analog formula on pre-warped frequencies*/
+double design_butterworth(const design_filter_t *filter, double hz)
+{
+	double ratio = tan(M_PI * hz / filter->sample_hz) / tan(M_PI * filter->cutoff_hz / filter->sample_hz);
+
+	if(filter->highpass)
+	{
+		ratio = (ratio > 0.0) ? 1.0 / ratio : HUGE_VAL;
+	}
+	return 1.0 / sqrt(1.0 + pow(ratio, 2.0 * filter->order));
+}
+
+static void upper(char *out, const char *in)
+{
+	while(*in)
+	{
+		*out++ = (char)toupper((unsigned char)*in++);
+	}
+	*out = '\0';
+}
+
+/*Write <base>.c and <base>.h in the form proj/biquad.c takes.  Every filter has to have 16-bit
+ coefficients.*/
+int design_write(const char *base, const char *generator, const char *source,
+				 const design_filter_t *filters, int count)
+{
+	char path[512], guard[64], name[32];
+	const char *file_name = strrchr(base, '/');
+	FILE *out;
+	int f, s;
+
+	for(f = 0; f < count; f++)
+	{
+		if(16 != filters[f].width)
+		{
+			fprintf(stderr, "%s: only 16-bit coefficients fit biquad_coeffs_t\n", filters[f].name);
+			return -1;
+		}
+	}
+
+	file_name = (NULL == file_name) ? base : file_name + 1;
+
+	snprintf(path, sizeof(path), "%s.h", base);
+	out = fopen(path, "w");
+	if(NULL == out)
+	{
+		perror(path);
+		return -1;
+	}
+	upper(guard, file_name);
+	fprintf(out, "/*\r\n * %s.h\r\n *\r\n * Generated by %s from %s - do not edit.\r\n */\r\n\r\n", file_name, generator, source);
+	fprintf(out, "#ifndef %s_H_\r\n#define %s_H_\r\n\r\n#include \"biquad.h\"\r\n\r\n", guard, guard);
+	for(f = 0; f < count; f++)
+	{
+		upper(name, filters[f].name);
+		fprintf(out, "/*%s: order %d Butterworth %s, %g Hz at %g Hz%s%s*/\r\n", filters[f].name, filters[f].order,
+				filters[f].highpass ? "high-pass" : "low-pass", filters[f].cutoff_hz, filters[f].sample_hz,
+				('\0' == filters[f].comment[0]) ? "" : " - ", filters[f].comment);
+		fprintf(out, "#define BIQUAD_%s_SECTIONS %d\r\n", name, filters[f].sections);
+		fprintf(out, "extern const biquad_coeffs_t biquad_%s[BIQUAD_%s_SECTIONS] PROGMEM;\r\n\r\n", filters[f].name, name);
+	}
+	fprintf(out, "#endif /* %s_H_ */\r\n", guard);
+	fclose(out);
+
+	snprintf(path, sizeof(path), "%s.c", base);
+	out = fopen(path, "w");
+	if(NULL == out)
+	{
+		perror(path);
+		return -1;
+	}
+	fprintf(out, "/*\r\n * %s.c\r\n *\r\n * Generated by %s from %s - do not edit.\r\n", file_name, generator, source);
+	fprintf(out, " *\r\n * Per section: b0, b1, b2 (scaled by 2^(16 + b_shift)), a1, a2 (scaled by 2^a_shift), "
+			"dc_gain (Q2.14), b_shift, a_shift\r\n */\r\n\r\n");
+	fprintf(out, "#include \"%s.h\"\r\n", file_name);
+	for(f = 0; f < count; f++)
+	{
+		upper(name, filters[f].name);
+		fprintf(out, "\r\nconst biquad_coeffs_t biquad_%s[BIQUAD_%s_SECTIONS] PROGMEM =\r\n{\r\n", filters[f].name, name);
+		for(s = 0; s < filters[f].sections; s++)
+		{
+			const design_section_t *section = &filters[f].section[s];
+			fprintf(out, "\t{%6d, %6d, %6d, %6d, %6d, %6d, %3d, %2d},\t//Pole radius %.6f\r\n",
+					(int)section->b0, (int)section->b1, (int)section->b2, (int)section->a1, (int)section->a2,
+					section->dc_gain, section->b_shift, filters[f].a_frac, section->pole_radius);
+		}
+		fprintf(out, "};\r\n");
+	}
+	fclose(out);
+	return 0;
+}
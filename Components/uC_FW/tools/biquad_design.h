@@ -0,0 +1,66 @@
+/*
+ * biquad_design.h
+ *
+ * Butterworth biquad design and quantization, shared by tools/biquad_gen (which designs what
+ * filter_spec.txt asks for) and tools/filter_explore (which designs hundreds of candidates and picks
+ * the best).  This runs on the build machine, not the AVR.
+ *
+ * A design is a cascade of sections in the same form proj/biquad.c runs:
+ *
+ *	y[n] = b0*x[n] + b1*x[n-1] + b2*x[n-2] - a1*y[n-1] - a2*y[n-2]
+ *
+ * with the a's carrying a_frac fraction bits and the b's 16 + b_shift.  'width' is how many bits each
+ * coefficient gets.  The firmware kernels only take 16 - the wider ones are there so the explorer can
+ * say what a 24 or 32-bit kernel would buy before anybody writes one.
+ */
+
+#ifndef BIQUAD_DESIGN_H_
+#define BIQUAD_DESIGN_H_
+
+#include <stdint.h>
+
+#define DESIGN_MAX_SECTIONS 8
+
+/*Why design_filter() said no*/
+enum Design_Errors
+{
+	DESIGN_OK = 0,
+	DESIGN_BAD_ORDER,		/*Order outside 1 to 2 * DESIGN_MAX_SECTIONS*/
+	DESIGN_BAD_CUTOFF,		/*Cutoff not between 0 and half the sample rate*/
+	DESIGN_BAD_FORMAT,		/*Width or fraction bits that don't leave room for |a1| < 2*/
+	DESIGN_UNSTABLE			/*A pole rounded onto or outside the unit circle*/
+};
+
+typedef struct
+{
+	int64_t b0, b1, b2;		//Scaled by 2^(16 + b_shift)
+	int64_t a1, a2;			//a_frac fraction bits
+	int dc_gain;			//Steady-state output/input, always Q2.14 - see biquad.h
+	int b_shift;
+	double pole_radius;
+	double ideal_b[3];		//The same section before any rounding, for the reference model
+	double ideal_a[2];
+} design_section_t;
+
+typedef struct
+{
+	char name[32];
+	int highpass;
+	int order;
+	double cutoff_hz;
+	double sample_hz;
+	int width;				//Bits per coefficient
+	int a_frac;				//Fraction bits in a1 and a2
+	int sections;
+	design_section_t section[DESIGN_MAX_SECTIONS];
+	char comment[160];		//Written after the description in the header, if there is one
+} design_filter_t;
+
+int design_filter(design_filter_t *filter);
+const char *design_error(int error);
+double design_response(const design_filter_t *filter, double hz, int quantized);
+double design_butterworth(const design_filter_t *filter, double hz);
+int design_write(const char *base, const char *generator, const char *source,
+				 const design_filter_t *filters, int count);
+
+#endif /* BIQUAD_DESIGN_H_ */
@@ -0,0 +1,117 @@
+/*
+ * biquad_gen.c
+ *
+ * Turns a filter design spec (proj/filter_spec.txt) into the flash coefficient tables used by
+ * proj/biquad.c.  This runs on the build machine, not the AVR.
+ *
+ *	biquad_gen <spec file> <output base name>
+ *
+ * writes <base>.c and <base>.h.  The design and quantization are in biquad_design.c, which
+ * filter_explore uses too - the spec just says which design to take.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "biquad_design.h"
+
+/*Q2.14 unless the spec says otherwise*/
+#define DEFAULT_A_FRAC_BITS 14
+#define MAX_FILTERS 32
+
+static int parse_spec(const char *path, design_filter_t *filters)
+{
+	FILE *spec = fopen(path, "r");
+	char line[256], type[32];
+	int count = 0, line_number = 0;
+
+	if(NULL == spec)
+	{
+		perror(path);
+		return -1;
+	}
+
+	while(NULL != fgets(line, sizeof(line), spec))
+	{
+		design_filter_t *filter = &filters[count];
+		char *p = line;
+		int fields, error;
+
+		line_number++;
+		while(isspace((unsigned char)*p))
+		{
+			p++;
+		}
+		if('\0' == *p || '#' == *p)
+		{
+			continue;
+		}
+		if(count == MAX_FILTERS)
+		{
+			fprintf(stderr, "%s:%d: too many filters\n", path, line_number);
+			fclose(spec);
+			return -1;
+		}
+		memset(filter, 0, sizeof(*filter));
+		filter->width = 16;
+		filter->a_frac = DEFAULT_A_FRAC_BITS;
+		fields = sscanf(p, "%31s %31s %d %lf %lf %d", filter->name, type, &filter->order,
+						&filter->cutoff_hz, &filter->sample_hz, &filter->a_frac);
+		if(fields < 5)
+		{
+			fprintf(stderr, "%s:%d: expected name type order cutoff_hz sample_hz [a_frac_bits]\n", path, line_number);
+			fclose(spec);
+			return -1;
+		}
+		if(0 == strcmp(type, "lowpass"))
+		{
+			filter->highpass = 0;
+		}
+		else if(0 == strcmp(type, "highpass"))
+		{
+			filter->highpass = 1;
+		}
+		else
+		{
+			fprintf(stderr, "%s:%d: type must be lowpass or highpass\n", path, line_number);
+			fclose(spec);
+			return -1;
+		}
+		error = design_filter(filter);
+		if(DESIGN_OK != error)
+		{
+			fprintf(stderr, "%s:%d: %s: %s\n", path, line_number, filter->name, design_error(error));
+			fclose(spec);
+			return -1;
+		}
+		count++;
+	}
+
+	fclose(spec);
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	static design_filter_t filters[MAX_FILTERS];
+	const char *spec_name;
+	int count;
+
+	if(3 != argc)
+	{
+		fprintf(stderr, "usage: %s <spec file> <output base name>\n", argv[0]);
+		return 1;
+	}
+
+	count = parse_spec(argv[1], filters);
+	if(count < 0)
+	{
+		return 1;
+	}
+
+	spec_name = strrchr(argv[1], '/');
+	spec_name = (NULL == spec_name) ? argv[1] : spec_name + 1;
+
+	return (0 == design_write(argv[2], "tools/biquad_gen", spec_name, filters, count)) ? 0 : 1;
+}
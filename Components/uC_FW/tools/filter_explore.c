@@ -0,0 +1,854 @@
+/*
+ * filter_explore.c
+ *
+ * Fixed-point filter design-space explorer.  Instead of trying one design at a time in the fixed-point
+ * worksheet, this designs every combination of order, cutoff, coefficient width and a1/a2 format,
+ * runs each one over real captures with exactly the firmware's arithmetic, and ranks what it finds.
+ * This runs on the build machine, not the AVR.
+ *
+ *	filter_explore [options] lowpass|highpass sample_hz capture...
+ *
+ *	-o orders		Orders to try: a list and/or ranges, e.g. 1-4 or 2,4 (default 1-4)
+ *	-f lo:hi:count	Cutoffs to try, log-spaced from lo to hi Hz (required)
+ *	-w widths		Coefficient widths in bits (default 16,24,32)
+ *	-q bits			Integer bits in a1 and a2, e.g. 2 for Q2.14 at 16 bits (default 2-4)
+ *	-d factor		Box-average the captures down by this much first (default 1).  The motion
+ *					high-pass runs after dsp_chain's 40:1 decimator, so that's -d 40 at 800Hz.
+ *	-c column		Which column of a capture file to use (default accel_y8)
+ *	-p hz:db		Pass band requirement: no more than db of attenuation at hz.  Up to 8.
+ *	-s hz:db		Stop band requirement: at least db of attenuation at hz.  Up to 8.
+ *	-W noise:dev	Score weights (default 10:1) - see below
+ *	-j threads		Worker threads (default one per CPU)
+ *	-n count		How many of the ranked designs to list (default 20)
+ *	-g base			Write the best -k 16-bit designs to <base>.c/.h as biquad_<name>_<rank>,
+ *					ready for the firmware to include
+ *	-k count		How many designs -g writes (default 3)
+ *	-N name			Name for the -g tables (default explore)
+ *
+ * Captures are raw 8-bit samples like replay takes, or capture files (host/capfile.h).  A 10-bit
+ * column is scaled to the same units, with the two extra bits kept as fraction.  Each capture goes
+ * into the filters as Q16.16, the same as dsp_chain feeds them.
+ *
+ * For every candidate:
+ *
+ *	f3dB		Where the rounded design is really 3dB down
+ *	dev			The most the rounded design's response strays from the ideal Butterworth, in dB, anywhere
+ *				the ideal one is above -40dB
+ *	noise		RMS difference between the fixed-point output and a double-precision run of the unrounded
+ *				design over the same captures, in 8-bit ADC counts.  That's coefficient rounding and
+ *				arithmetic rounding together - everything the fixed point costs.
+ *	head		Bits of headroom left in the biggest 32-bit value the kernel saw (states and, for the
+ *				16-bit kernel, the 32-bit accumulator tops in fixed_point.h).  A design that overflows
+ *				is thrown out.
+ *	cycles		AVR cycles per sample for the whole cascade, and what that is as CPU load at 8MHz.
+ *				The 16-bit figure is the model in biquad.h (about 500 per section worst case).  The
+ *				24 and 32-bit ones are estimates for kernels that don't exist yet: 6 and 8 MULs per
+ *				product instead of 4, and a 64-bit accumulator that costs more to shift.
+ *
+ * score = CPU% + noise weight * noise + dev weight * dev, lowest first, out of the designs that meet
+ * every -p and -s.
+ *
+ * The emulation is bit-exact - the same 48-bit products, the same floor, the same 32-bit wrap.  To
+ * keep it honest every 16-bit candidate is also run through proj/biquad.c itself, and any difference
+ * at all is an error.  Only 16-bit designs can be written out, since that's what biquad_coeffs_t holds.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "biquad_design.h"
+#include "biquad.h"
+#include "capfile.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#ifndef M_SQRT1_2
+#define M_SQRT1_2 0.70710678118654752440
+#endif
+
+/*Same as the firmware*/
+#define F_CPU 8000000.0
+
+#define MAX_LIST 16
+#define MAX_REQUIREMENTS 8
+#define RESPONSE_POINTS 400
+
+/*AVR cycle model - see the comment at the top*/
+#define SECTION_OVERHEAD_CYCLES 150		//Loads, stores and loop, everything but the products
+#define SHIFT_CYCLES_PER_BIT 6			//Each bit fix_acc_shift has to move a 32-bit value
+#define WIDE_SHIFT_CYCLES_PER_BIT 10	//The same for a 64-bit accumulator
+
+typedef struct
+{
+	double hz;
+	double db;
+} requirement_t;
+
+typedef struct
+{
+	design_filter_t filter;
+	int error;				//enum Design_Errors, or one of the rejections below
+	double f3db;
+	double max_dev_db;
+	double noise;
+	double worst;			//Largest single difference from the reference, in counts
+	int headroom;
+	int cycles;
+	double cpu;
+	double score;
+	int firmware_checked;
+} candidate_t;
+
+/*Rejections, after the design ones*/
+enum Rejections
+{
+	REJECT_OVERFLOW = 100,
+	REJECT_REQUIREMENT,
+	REJECT_FIRMWARE_MISMATCH
+};
+
+typedef struct
+{
+	int32_t *samples;		//Q16.16
+	size_t count;
+} input_t;
+
+static input_t *inputs;
+static int input_count;
+static candidate_t *candidates;
+static int candidate_count;
+static int next_candidate;
+static requirement_t passband[MAX_REQUIREMENTS], stopband[MAX_REQUIREMENTS];
+static int passband_count, stopband_count;
+static double noise_weight = 10.0, dev_weight = 1.0;
+
+/*"1-4", "2,4" or "1-2,6" - returns how many values*/
+static int parse_list(const char *text, int *values, int max)
+{
+	int count = 0;
+
+	while('\0' != *text)
+	{
+		char *end;
+		long first = strtol(text, &end, 10), last, v;
+
+		if(end == text)
+		{
+			return -1;
+		}
+		last = first;
+		text = end;
+		if('-' == *text)
+		{
+			last = strtol(text + 1, &end, 10);
+			if(end == text + 1)
+			{
+				return -1;
+			}
+			text = end;
+		}
+		for(v = first; v <= last; v++)
+		{
+			if(count == max)
+			{
+				return -1;
+			}
+			values[count++] = (int)v;
+		}
+		if(',' == *text)
+		{
+			text++;
+		}
+		else if('\0' != *text)
+		{
+			return -1;
+		}
+	}
+
+	return count;
+}
+
+static int parse_requirement(const char *text, requirement_t *list, int *count)
+{
+	if(*count == MAX_REQUIREMENTS || 2 != sscanf(text, "%lf:%lf", &list[*count].hz, &list[*count].db))
+	{
+		return -1;
+	}
+	(*count)++;
+	return 0;
+}
+
+/*Load a capture as Q16.16 samples, box-averaged down by 'decimate'*/
+static int load_input(const char *path, const char *column_name, int decimate, input_t *input)
+{
+	capfile_t file;
+	const uint8_t *narrow = NULL;
+	const uint16_t *wide = NULL;
+	uint8_t *bytes = NULL;
+	uint64_t rows = 0, i;
+	int64_t sum = 0;
+	int mapped = 0;
+
+	if(capfile_is_capture(path))
+	{
+		int column;
+
+		if(0 != capfile_open(&file, path))
+		{
+			return -1;
+		}
+		mapped = 1;
+		column = capfile_find(&file, column_name);
+		narrow = capfile_data(&file, column, CAPFILE_U8, &rows);
+		if(NULL == narrow)
+		{
+			wide = capfile_data(&file, column, CAPFILE_U16, &rows);
+		}
+		if(NULL == narrow && NULL == wide)
+		{
+			fprintf(stderr, "%s: no 8 or 16-bit column called %s\n", path, column_name);
+			capfile_close(&file);
+			return -1;
+		}
+	}
+	else
+	{
+		FILE *raw = fopen(path, "rb");
+		size_t allocated = 4096;
+
+		if(NULL == raw)
+		{
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			return -1;
+		}
+		bytes = malloc(allocated);
+		while(NULL != bytes)
+		{
+			size_t got = fread(bytes + rows, 1, allocated - rows, raw);
+
+			rows += got;
+			if(rows < allocated)
+			{
+				break;
+			}
+			allocated *= 2;
+			bytes = realloc(bytes, allocated);
+		}
+		fclose(raw);
+		narrow = bytes;
+	}
+
+	input->count = 0;
+	input->samples = malloc((size_t)(rows / decimate + 1) * sizeof(int32_t));
+	if(NULL == input->samples || (NULL == narrow && NULL == wide))
+	{
+		fprintf(stderr, "%s: out of memory\n", path);
+		free(bytes);
+		if(mapped)
+		{
+			capfile_close(&file);
+		}
+		return -1;
+	}
+
+	for(i = 0; i < rows; i++)
+	{
+		//8-bit counts in Q16.16, or 10-bit counts scaled down to them
+		sum += (NULL != narrow) ? ((int64_t)narrow[i] << 16) : ((int64_t)wide[i] << 14);
+		if(0 == (i + 1) % decimate)
+		{
+			input->samples[input->count++] = (int32_t)(sum / decimate);
+			sum = 0;
+		}
+	}
+
+	free(bytes);
+	if(mapped)
+	{
+		capfile_close(&file);
+	}
+	if(0 == input->count)
+	{
+		fprintf(stderr, "%s: no samples\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static int bits_used(int64_t value)
+{
+	int bits = 0;
+
+	if(value < 0)
+	{
+		value = -value;
+	}
+	while(value > 0)
+	{
+		bits++;
+		value >>= 1;
+	}
+	return bits;
+}
+
+/*floor(sum / 2^shift) the way the kernel does it.  The 16-bit kernel keeps floor(sum / 2^16) in 32
+ bits (fix_acc_shift), so if that doesn't fit it goes wrong exactly the way the AVR would.  The wide
+ kernels are assumed to have a 64-bit accumulator.*/
+static int32_t kernel_shift(__int128 sum, int shift, int wide, int64_t *peak)
+{
+	__int128 high = sum >> 16;
+	uint32_t high32 = (uint32_t)high;
+	uint16_t remainder = (uint16_t)sum;
+
+	if(wide)
+	{
+		return (int32_t)(uint32_t)(sum >> shift);
+	}
+
+	if(high > INT64_MAX || high < INT64_MIN)
+	{
+		*peak = INT64_MAX;
+	}
+	else if(bits_used((int64_t)high) > bits_used(*peak))
+	{
+		*peak = (int64_t)high;
+	}
+
+	if(shift >= 16)
+	{
+		return (int32_t)high32 >> (shift - 16);
+	}
+	return (int32_t)((high32 << (16 - shift)) + (remainder >> shift));
+}
+
+/*One sample through the emulated cascade.  'overflow' is set if any y didn't fit in 32 bits.*/
+static int32_t emulate(const design_filter_t *filter, int32_t state[][4], int32_t x, int64_t *peak, int *overflow)
+{
+	int wide = (filter->width > 16);
+	int s;
+
+	for(s = 0; s < filter->sections; s++)
+	{
+		const design_section_t *section = &filter->section[s];
+		int32_t *st = state[s];	//x1, x2, y1, y2
+		__int128 feed_forward = (__int128)section->b0 * x + (__int128)section->b1 * st[0] + (__int128)section->b2 * st[1];
+		__int128 feedback = (__int128)section->a1 * st[2] + (__int128)section->a2 * st[3];
+		__int128 exact = (feed_forward >> (16 + section->b_shift)) - (feedback >> filter->a_frac);
+		int32_t y = (int32_t)((uint32_t)kernel_shift(feed_forward, 16 + section->b_shift, wide, peak)
+							- (uint32_t)kernel_shift(feedback, filter->a_frac, wide, peak));
+
+		if(exact != (__int128)y)
+		{
+			*overflow = 1;
+		}
+		if(bits_used(y) > bits_used(*peak))
+		{
+			*peak = y;
+		}
+
+		st[1] = st[0];
+		st[0] = x;
+		st[3] = st[2];
+		st[2] = y;
+		x = y;
+	}
+
+	return x;
+}
+
+static void emulate_preload(const design_filter_t *filter, int32_t state[][4], int32_t x)
+{
+	int64_t peak = 0;
+	int s;
+
+	for(s = 0; s < filter->sections; s++)
+	{
+		int32_t y = kernel_shift((__int128)filter->section[s].dc_gain * x, BIQUAD_DC_GAIN_FRAC_BITS, 0, &peak);
+
+		state[s][0] = x;
+		state[s][1] = x;
+		state[s][2] = y;
+		state[s][3] = y;
+		x = y;
+	}
+}
+
+static double reference(const design_filter_t *filter, double state[][4], double x)
+{
+	int s;
+
+	for(s = 0; s < filter->sections; s++)
+	{
+		const design_section_t *section = &filter->section[s];
+		double *st = state[s];
+		double y = section->ideal_b[0] * x + section->ideal_b[1] * st[0] + section->ideal_b[2] * st[1]
+				 - section->ideal_a[0] * st[2] - section->ideal_a[1] * st[3];
+
+		st[1] = st[0];
+		st[0] = x;
+		st[3] = st[2];
+		st[2] = y;
+		x = y;
+	}
+
+	return x;
+}
+
+static void reference_preload(const design_filter_t *filter, double state[][4], double x)
+{
+	int s;
+
+	for(s = 0; s < filter->sections; s++)
+	{
+		double y = filter->highpass ? 0.0 : x;
+
+		state[s][0] = x;
+		state[s][1] = x;
+		state[s][2] = y;
+		state[s][3] = y;
+		x = y;
+	}
+}
+
+static void to_firmware(const design_filter_t *filter, biquad_coeffs_t *coeffs)
+{
+	int s;
+
+	for(s = 0; s < filter->sections; s++)
+	{
+		coeffs[s].b0 = (int16_t)filter->section[s].b0;
+		coeffs[s].b1 = (int16_t)filter->section[s].b1;
+		coeffs[s].b2 = (int16_t)filter->section[s].b2;
+		coeffs[s].a1 = (int16_t)filter->section[s].a1;
+		coeffs[s].a2 = (int16_t)filter->section[s].a2;
+		coeffs[s].dc_gain = (int16_t)filter->section[s].dc_gain;
+		coeffs[s].b_shift = (int8_t)filter->section[s].b_shift;
+		coeffs[s].a_shift = (int8_t)filter->a_frac;
+	}
+}
+
+/*Run every capture through the emulator, the reference and (for 16-bit designs) proj/biquad.c*/
+static void simulate(candidate_t *candidate)
+{
+	const design_filter_t *filter = &candidate->filter;
+	int32_t state[DESIGN_MAX_SECTIONS][4];
+	double ideal[DESIGN_MAX_SECTIONS][4];
+	biquad_coeffs_t coeffs[DESIGN_MAX_SECTIONS];
+	biquad_state_t firmware[DESIGN_MAX_SECTIONS];
+	int firmware_format = (16 == filter->width);
+	double squares = 0.0;
+	size_t total = 0, i;
+	int64_t peak = 0;
+	int overflow = 0, c;
+
+	candidate->worst = 0.0;
+	to_firmware(filter, coeffs);
+
+	for(c = 0; c < input_count; c++)
+	{
+		const input_t *input = &inputs[c];
+
+		emulate_preload(filter, state, input->samples[0]);
+		reference_preload(filter, ideal, ldexp(input->samples[0], -16));
+		if(firmware_format)
+		{
+			biquad_preload(coeffs, firmware, (uint8_t)filter->sections, input->samples[0]);
+		}
+
+		for(i = 0; i < input->count; i++)
+		{
+			int32_t y = emulate(filter, state, input->samples[i], &peak, &overflow);
+			double error = ldexp(y, -16) - reference(filter, ideal, ldexp(input->samples[i], -16));
+
+			if(firmware_format && y != biquad_run(coeffs, firmware, (uint8_t)filter->sections, input->samples[i]))
+			{
+				candidate->error = REJECT_FIRMWARE_MISMATCH;
+				return;
+			}
+			squares += error * error;
+			if(fabs(error) > candidate->worst)
+			{
+				candidate->worst = fabs(error);
+			}
+		}
+		total += input->count;
+	}
+
+	candidate->firmware_checked = firmware_format;
+	candidate->noise = sqrt(squares / (double)total);
+	candidate->headroom = 31 - bits_used(peak);
+	if(overflow || candidate->headroom < 0)
+	{
+		candidate->error = REJECT_OVERFLOW;
+	}
+}
+
+static double to_db(double gain)
+{
+	return 20.0 * log10((gain > 1e-300) ? gain : 1e-300);
+}
+
+/*Response checks - deviation from the ideal, the real -3dB point and the requirements*/
+static void measure_response(candidate_t *candidate)
+{
+	const design_filter_t *filter = &candidate->filter;
+	double nyquist = filter->sample_hz / 2.0;
+	double low = nyquist * 1e-4, high = nyquist * 0.999;
+	double previous_hz = 0.0, previous_gain = 0.0;
+	int i;
+
+	candidate->max_dev_db = 0.0;
+	candidate->f3db = 0.0;
+	for(i = 0; i < RESPONSE_POINTS; i++)
+	{
+		double hz = low * pow(high / low, (double)i / (RESPONSE_POINTS - 1));
+		double ideal = design_butterworth(filter, hz);
+		double gain = design_response(filter, hz, 1);
+
+		if(to_db(ideal) > -40.0 && fabs(to_db(gain) - to_db(ideal)) > candidate->max_dev_db)
+		{
+			candidate->max_dev_db = fabs(to_db(gain) - to_db(ideal));
+		}
+
+		//Bisect the first crossing of -3dB that's nearest the nominal cutoff
+		if(i > 0 && (previous_gain - M_SQRT1_2) * (gain - M_SQRT1_2) <= 0.0 &&
+		   (0.0 == candidate->f3db || fabs(hz - filter->cutoff_hz) < fabs(candidate->f3db - filter->cutoff_hz)))
+		{
+			double a = previous_hz, b = hz;
+			int step;
+
+			for(step = 0; step < 50; step++)
+			{
+				double middle = sqrt(a * b);
+
+				if((design_response(filter, a, 1) - M_SQRT1_2) * (design_response(filter, middle, 1) - M_SQRT1_2) <= 0.0)
+				{
+					b = middle;
+				}
+				else
+				{
+					a = middle;
+				}
+			}
+			candidate->f3db = sqrt(a * b);
+		}
+		previous_hz = hz;
+		previous_gain = gain;
+	}
+
+	for(i = 0; i < passband_count; i++)
+	{
+		if(passband[i].hz >= nyquist || -to_db(design_response(filter, passband[i].hz, 1)) > passband[i].db)
+		{
+			candidate->error = REJECT_REQUIREMENT;
+		}
+	}
+	for(i = 0; i < stopband_count; i++)
+	{
+		if(stopband[i].hz >= nyquist || -to_db(design_response(filter, stopband[i].hz, 1)) < stopband[i].db)
+		{
+			candidate->error = REJECT_REQUIREMENT;
+		}
+	}
+}
+
+/*AVR cycles per sample for the cascade - see the comment at the top*/
+static int estimate_cycles(const design_filter_t *filter)
+{
+	int mac = (filter->width <= 16) ? 50 : (filter->width <= 24) ? 80 : 110;
+	int shift_cost = (filter->width <= 16) ? SHIFT_CYCLES_PER_BIT : WIDE_SHIFT_CYCLES_PER_BIT;
+	int cycles = 0, s;
+
+	for(s = 0; s < filter->sections; s++)
+	{
+		cycles += SECTION_OVERHEAD_CYCLES + 5 * mac
+				+ shift_cost * (abs(filter->section[s].b_shift) + abs(filter->a_frac - 16));
+	}
+	return cycles;
+}
+
+static void evaluate(candidate_t *candidate)
+{
+	candidate->error = design_filter(&candidate->filter);
+	if(DESIGN_OK != candidate->error)
+	{
+		return;
+	}
+
+	measure_response(candidate);
+	if(DESIGN_OK != candidate->error)
+	{
+		return;
+	}
+
+	simulate(candidate);
+	candidate->cycles = estimate_cycles(&candidate->filter);
+	candidate->cpu = 100.0 * candidate->cycles * candidate->filter.sample_hz / F_CPU;
+	candidate->score = candidate->cpu + noise_weight * candidate->noise + dev_weight * candidate->max_dev_db;
+}
+
+static void *worker(void *unused)
+{
+	int index;
+
+	(void)unused;
+	while((index = __atomic_fetch_add(&next_candidate, 1, __ATOMIC_RELAXED)) < candidate_count)
+	{
+		evaluate(&candidates[index]);
+	}
+	return NULL;
+}
+
+static int by_score(const void *a, const void *b)
+{
+	const candidate_t *x = a, *y = b;
+
+	if((DESIGN_OK == x->error) != (DESIGN_OK == y->error))
+	{
+		return (DESIGN_OK == x->error) ? -1 : 1;
+	}
+	return (x->score < y->score) ? -1 : (x->score > y->score) ? 1 : 0;
+}
+
+static void usage(const char *program)
+{
+	fprintf(stderr, "usage: %s [-o orders] -f lo:hi:count [-w widths] [-q int_bits] [-d factor] [-c column]\n"
+			"       [-p hz:db]... [-s hz:db]... [-W noise:dev] [-j threads] [-n count] [-g base] [-k count] [-N name]\n"
+			"       lowpass|highpass sample_hz capture...\n", program);
+}
+
+int main(int argc, char **argv)
+{
+	int orders[MAX_LIST], widths[MAX_LIST], int_bits[MAX_LIST];
+	int order_count = parse_list("1-4", orders, MAX_LIST);
+	int width_count = parse_list("16,24,32", widths, MAX_LIST);
+	int int_bit_count = parse_list("2-4", int_bits, MAX_LIST);
+	double cutoff_low = 0.0, cutoff_high = 0.0, sample_hz;
+	int cutoff_count = 0, decimate = 1, show = 20, keep = 3, highpass;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *column = "accel_y8", *generate = NULL, *name = "explore";
+	int counts[REJECT_FIRMWARE_MISMATCH + 1] = {0};
+	int option, o, f, w, q, i, passed, checked = 0;
+	pthread_t *pool;
+
+	while(-1 != (option = getopt(argc, argv, "o:f:w:q:d:c:p:s:W:j:n:g:k:N:")))
+	{
+		switch(option)
+		{
+		case 'o':
+			order_count = parse_list(optarg, orders, MAX_LIST);
+			break;
+		case 'f':
+			if(3 != sscanf(optarg, "%lf:%lf:%d", &cutoff_low, &cutoff_high, &cutoff_count))
+			{
+				cutoff_count = 0;
+			}
+			break;
+		case 'w':
+			width_count = parse_list(optarg, widths, MAX_LIST);
+			break;
+		case 'q':
+			int_bit_count = parse_list(optarg, int_bits, MAX_LIST);
+			break;
+		case 'd':
+			decimate = atoi(optarg);
+			break;
+		case 'c':
+			column = optarg;
+			break;
+		case 'p':
+			if(0 != parse_requirement(optarg, passband, &passband_count))
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 's':
+			if(0 != parse_requirement(optarg, stopband, &stopband_count))
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'W':
+			if(2 != sscanf(optarg, "%lf:%lf", &noise_weight, &dev_weight))
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'j':
+			threads = atol(optarg);
+			break;
+		case 'n':
+			show = atoi(optarg);
+			break;
+		case 'g':
+			generate = optarg;
+			break;
+		case 'k':
+			keep = atoi(optarg);
+			break;
+		case 'N':
+			name = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(argc - optind < 3 || order_count < 1 || width_count < 1 || int_bit_count < 1 || cutoff_count < 1 ||
+	   cutoff_low <= 0.0 || cutoff_high < cutoff_low || decimate < 1 || (strcmp(argv[optind], "lowpass") &&
+	   strcmp(argv[optind], "highpass")))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	highpass = (0 == strcmp(argv[optind], "highpass"));
+	sample_hz = atof(argv[optind + 1]) / decimate;
+	if(threads < 1)
+	{
+		threads = 1;
+	}
+
+	input_count = argc - optind - 2;
+	inputs = calloc((size_t)input_count, sizeof(input_t));
+	for(i = 0; i < input_count; i++)
+	{
+		if(0 != load_input(argv[optind + 2 + i], column, decimate, &inputs[i]))
+		{
+			return 1;
+		}
+	}
+
+	candidate_count = order_count * cutoff_count * width_count * int_bit_count;
+	candidates = calloc((size_t)candidate_count, sizeof(candidate_t));
+	if(NULL == candidates)
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	i = 0;
+	for(o = 0; o < order_count; o++)
+	{
+		for(f = 0; f < cutoff_count; f++)
+		{
+			for(w = 0; w < width_count; w++)
+			{
+				for(q = 0; q < int_bit_count; q++)
+				{
+					design_filter_t *filter = &candidates[i++].filter;
+
+					snprintf(filter->name, sizeof(filter->name), "%s", name);
+					filter->highpass = highpass;
+					filter->order = orders[o];
+					filter->cutoff_hz = (cutoff_count > 1) ?
+						cutoff_low * pow(cutoff_high / cutoff_low, (double)f / (cutoff_count - 1)) : cutoff_low;
+					filter->sample_hz = sample_hz;
+					filter->width = widths[w];
+					filter->a_frac = widths[w] - int_bits[q];
+				}
+			}
+		}
+	}
+
+	pool = calloc((size_t)threads, sizeof(pthread_t));
+	for(i = 0; i < threads; i++)
+	{
+		if(0 != pthread_create(&pool[i], NULL, worker, NULL))
+		{
+			threads = i;
+			break;
+		}
+	}
+	if(0 == threads)
+	{
+		worker(NULL);
+	}
+	for(i = 0; i < threads; i++)
+	{
+		pthread_join(pool[i], NULL);
+	}
+
+	qsort(candidates, (size_t)candidate_count, sizeof(candidate_t), by_score);
+
+	for(i = 0, passed = 0; i < candidate_count; i++)
+	{
+		counts[candidates[i].error]++;
+		passed += (DESIGN_OK == candidates[i].error);
+		checked += candidates[i].firmware_checked;
+	}
+
+	printf("%d candidates at %g Hz over %d capture%s (%ld threads): %d passed, %d couldn't be designed, "
+		   "%d overflowed, %d missed a requirement\n", candidate_count, sample_hz, input_count,
+		   (1 == input_count) ? "" : "s", threads, passed,
+		   counts[DESIGN_BAD_FORMAT] + counts[DESIGN_UNSTABLE] + counts[DESIGN_BAD_CUTOFF] + counts[DESIGN_BAD_ORDER],
+		   counts[REJECT_OVERFLOW], counts[REJECT_REQUIREMENT]);
+	printf("%d 16-bit designs bit-exact against proj/biquad.c", checked);
+	if(0 != counts[REJECT_FIRMWARE_MISMATCH])
+	{
+		printf(", %d DIFFERENT - the emulator is wrong", counts[REJECT_FIRMWARE_MISMATCH]);
+	}
+	printf("\n\n");
+
+	printf("rank order  cutoff_hz    f3dB_hz  width  a_fmt  dev_db     noise     worst  head  cycles   cpu%%   score\n");
+	for(i = 0; i < passed && i < show; i++)
+	{
+		const candidate_t *candidate = &candidates[i];
+		const design_filter_t *filter = &candidate->filter;
+
+		printf("%4d %5d %10.4g %10.4g %6d  Q%d.%-2d %6.3f %9.2e %9.2e %5d %7d %6.2f %7.3f\n", i + 1, filter->order,
+			   filter->cutoff_hz, candidate->f3db, filter->width, filter->width - filter->a_frac, filter->a_frac,
+			   candidate->max_dev_db, candidate->noise, candidate->worst, candidate->headroom, candidate->cycles,
+			   candidate->cpu, candidate->score);
+	}
+
+	if(NULL != generate)
+	{
+		static design_filter_t best[DESIGN_MAX_SECTIONS];
+		char source[128];
+		int count = 0;
+
+		for(i = 0; i < passed && count < keep && count < DESIGN_MAX_SECTIONS; i++)
+		{
+			const candidate_t *candidate = &candidates[i];
+
+			if(16 != candidate->filter.width)
+			{
+				continue;
+			}
+			best[count] = candidate->filter;
+			snprintf(best[count].name, sizeof(best[count].name), "%s_%d", name, count + 1);
+			snprintf(best[count].comment, sizeof(best[count].comment),
+					 "rank %d, Q%d.%d a's, -3dB at %.4g Hz, noise %.2e counts, %d cycles",
+					 i + 1, 16 - candidate->filter.a_frac, candidate->filter.a_frac, candidate->f3db,
+					 candidate->noise, candidate->cycles);
+			printf("\nfilter_spec.txt line for %s:\n%-11s %-10s %-6d %-10g %-9g %d\n", best[count].name,
+				   best[count].name, highpass ? "highpass" : "lowpass", candidate->filter.order,
+				   candidate->filter.cutoff_hz, sample_hz, candidate->filter.a_frac);
+			count++;
+		}
+
+		snprintf(source, sizeof(source), "a %s sweep of %d candidates", argv[optind], candidate_count);
+		if(0 == count)
+		{
+			fprintf(stderr, "no 16-bit design passed - nothing to write\n");
+			return 1;
+		}
+		if(0 != design_write(generate, "tools/filter_explore", source, best, count))
+		{
+			return 1;
+		}
+	}
+
+	return (0 == counts[REJECT_FIRMWARE_MISMATCH]) ? 0 : 1;
+}
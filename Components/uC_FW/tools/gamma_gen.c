@@ -0,0 +1,131 @@
+/*
+ * gamma_gen.c
+ *
+ * Generates the gamma-correction tables the light driver (proj/lights.c) uses to turn a brightness
+ * into a PWM compare value.  This runs on the build machine, not the AVR.
+ *
+ *	gamma_gen <gamma> <timer1 top> <output base name>
+ *
+ * writes <base>.c and <base>.h.
+ *
+ * Eyes don't see brightness linearly - half the duty cycle looks a lot brighter than half as bright,
+ * and a fade done in duty cycle spends most of its time looking nearly full on.  So brightness b from 0
+ * to 255 is mapped to a duty cycle of (b/255)^gamma.
+ *
+ * In fast PWM a compare value of n gives a duty cycle of (n + 1)/(TOP + 1) (ATMega328 Datasheet Sections
+ * 15.7.3 and 16.9.3), so each entry is the duty cycle times TOP + 1, minus one.  Entry 255 comes out as
+ * TOP, which is fully on.  There's no entry that's fully off - even 0 is a one-count spike - which is why
+ * the light driver disconnects the pin for brightness 0.
+ *
+ * Timer0 (yellow and red) is 8 bits, so its TOP is 255.  Timer1 (green) is also the system tick and its
+ * TOP is whatever the tick needs, so that's a parameter.
+ *
+ * The bit angle modulation driver (proj/bam.c) has a table of its own.  A BAM level of n is on for n of
+ * the 255 time units in a period, so its entries are just the duty cycle times 255 - 0 really is off and
+ * 255 really is on, no spikes either way.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEVELS 256
+
+static long gamma_entry(int brightness, double gamma, long top)
+{
+	double duty = pow((double)brightness / (LEVELS - 1), gamma);
+	long entry = lround(duty * (double)(top + 1)) - 1;
+
+	return (entry < 0) ? 0 : entry;
+}
+
+static long gamma_bam_entry(int brightness, double gamma)
+{
+	return lround(pow((double)brightness / (LEVELS - 1), gamma) * (LEVELS - 1));
+}
+
+static int write_outputs(const char *base, double gamma, long timer1_top)
+{
+	char path[512];
+	const char *file_name = strrchr(base, '/');
+	FILE *out;
+	int i;
+
+	file_name = (NULL == file_name) ? base : file_name + 1;
+
+	snprintf(path, sizeof(path), "%s.h", base);
+	out = fopen(path, "w");
+	if(NULL == out)
+	{
+		perror(path);
+		return -1;
+	}
+	fprintf(out, "/*\r\n * %s.h\r\n *\r\n * Generated by tools/gamma_gen - do not edit.\r\n */\r\n\r\n", file_name);
+	fprintf(out, "#ifndef GAMMA_TABLES_H_\r\n#define GAMMA_TABLES_H_\r\n\r\n#include <stdint.h>\r\n\r\n#include \"progmem.h\"\r\n\r\n");
+	fprintf(out, "#define GAMMA_LEVELS %d\r\n", LEVELS);
+	fprintf(out, "#define GAMMA_TIMER1_TOP %ld\r\n\r\n", timer1_top);
+	fprintf(out, "/*Brightness to OCR0x, gamma %g*/\r\n", gamma);
+	fprintf(out, "extern const uint8_t gamma_timer0[GAMMA_LEVELS] PROGMEM;\r\n\r\n");
+	fprintf(out, "/*Brightness to OCR1A with TOP = %ld, gamma %g*/\r\n", timer1_top, gamma);
+	fprintf(out, "extern const uint16_t gamma_timer1[GAMMA_LEVELS] PROGMEM;\r\n\r\n");
+	fprintf(out, "/*Brightness to a bit angle modulation level, gamma %g*/\r\n", gamma);
+	fprintf(out, "extern const uint8_t gamma_bam[GAMMA_LEVELS] PROGMEM;\r\n\r\n");
+	fprintf(out, "#endif /* GAMMA_TABLES_H_ */\r\n");
+	fclose(out);
+
+	snprintf(path, sizeof(path), "%s.c", base);
+	out = fopen(path, "w");
+	if(NULL == out)
+	{
+		perror(path);
+		return -1;
+	}
+	fprintf(out, "/*\r\n * %s.c\r\n *\r\n * Generated by tools/gamma_gen - do not edit.\r\n */\r\n\r\n", file_name);
+	fprintf(out, "#include \"%s.h\"\r\n\r\n", file_name);
+
+	fprintf(out, "const uint8_t gamma_timer0[GAMMA_LEVELS] PROGMEM =\r\n{");
+	for(i = 0; i < LEVELS; i++)
+	{
+		fprintf(out, "%s%3ld,", (0 == i % 16) ? "\r\n\t" : " ", gamma_entry(i, gamma, 255));
+	}
+	fprintf(out, "\r\n};\r\n\r\n");
+
+	fprintf(out, "const uint16_t gamma_timer1[GAMMA_LEVELS] PROGMEM =\r\n{");
+	for(i = 0; i < LEVELS; i++)
+	{
+		fprintf(out, "%s%5ld,", (0 == i % 12) ? "\r\n\t" : " ", gamma_entry(i, gamma, timer1_top));
+	}
+	fprintf(out, "\r\n};\r\n\r\n");
+
+	fprintf(out, "const uint8_t gamma_bam[GAMMA_LEVELS] PROGMEM =\r\n{");
+	for(i = 0; i < LEVELS; i++)
+	{
+		fprintf(out, "%s%3ld,", (0 == i % 16) ? "\r\n\t" : " ", gamma_bam_entry(i, gamma));
+	}
+	fprintf(out, "\r\n};\r\n");
+	fclose(out);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	double gamma;
+	long timer1_top;
+
+	if(4 != argc)
+	{
+		fprintf(stderr, "usage: %s <gamma> <timer1 top> <output base name>\n", argv[0]);
+		return 1;
+	}
+
+	gamma = atof(argv[1]);
+	timer1_top = atol(argv[2]);
+	if(gamma <= 0.0 || timer1_top < 255 || timer1_top > 65535)
+	{
+		fprintf(stderr, "gamma must be positive and timer1 top from 255 to 65535\n");
+		return 1;
+	}
+
+	return (0 == write_outputs(argv[3], gamma, timer1_top)) ? 0 : 1;
+}